@@ -0,0 +1,584 @@
+/**
+ * CMSC 341 - Spring 2021
+ * Project 2 - Binary Trees
+ * ARTIndex.cpp
+ * Implementation for the ARTIndex class.
+ */
+
+#include "artindex.h"
+#include <cstring>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+/**
+ * Adds a username to the tree.
+ * @param username key to add
+ * @param node UNode holding the username
+ * @return true if the username was added, false if it was already present
+ */
+bool ARTIndex::insert(const string& username, UNode* node) {
+    if(!AssistInsert(_root, username, 0, node)){
+        return false;
+    }
+    _size++;
+    return true;
+}
+
+/**
+ * Finds the UNode holding a username. The cost depends only on the length of the username.
+ * @param username key to search for
+ * @return the UNode, nullptr if the username is not in the tree
+ */
+UNode* ARTIndex::find(const string& username) const {
+    ARTNode* node = _root;
+    size_t depth = 0;
+    while(node != nullptr){
+        size_t length = node->prefix.size();
+        if(username.compare(depth, length, node->prefix) != 0 || username.size() < depth + length){
+            return nullptr;
+        }
+        depth += length;
+        if(depth == username.size()){
+            return node->value;
+        }
+        ARTNode** child = findChild(node, username[depth]);
+        if(child == nullptr){
+            return nullptr;
+        }
+        node = *child;
+        depth++;
+    }
+    return nullptr;
+}
+
+/**
+ * Removes a username, emptied nodes are deleted and single child chains merged back into one path.
+ * @param username key to remove
+ * @return true if the username was removed, false if it was not in the tree
+ */
+bool ARTIndex::erase(const string& username) {
+    if(!AssistErase(_root, username, 0)){
+        return false;
+    }
+    _size--;
+    return true;
+}
+
+/**
+ * Removes every username.
+ */
+void ARTIndex::clear() {
+    AssistClear(_root);
+    _root = nullptr;
+    _size = 0;
+}
+
+/**
+ * Visits every UNode in username order.
+ * @param visit function called once per UNode
+ */
+void ARTIndex::forEach(const std::function<void(UNode*)>& visit) const {
+    AssistVisit(_root, [&](UNode* node) {
+        visit(node);
+        return true;
+    });
+}
+
+/**
+ * Finds usernames that start with a prefix. Only the subtree below the prefix is visited.
+ * @param prefix start of the usernames to find
+ * @param limit largest number of results
+ * @return matching UNodes in username order
+ */
+std::vector<UNode*> ARTIndex::prefixSearch(const string& prefix, int limit) const {
+    std::vector<UNode*> found;
+    ARTNode* node = _root;
+    size_t depth = 0;
+    while(node != nullptr && limit > 0){
+        // Compare as much of the compressed path as the prefix covers
+        size_t length = node->prefix.size();
+        size_t overlap = prefix.size() - depth < length ? prefix.size() - depth : length;
+        if(prefix.compare(depth, overlap, node->prefix, 0, overlap) != 0){
+            break;
+        }
+        depth += overlap;
+        if(depth == prefix.size()){
+            // Every username below this node starts with the prefix
+            AssistVisit(node, [&](UNode* match) {
+                found.push_back(match);
+                return (int) found.size() < limit;
+            });
+            break;
+        }
+        ARTNode** child = findChild(node, prefix[depth]);
+        node = child == nullptr ? nullptr : *child;
+        depth++;
+    }
+    return found;
+}
+
+/**
+ * Places a cursor on the smallest username.
+ * @param cursor cursor to set, it ends empty if the index is
+ */
+void ARTIndex::first(ARTCursor& cursor) const {
+    cursor.clear();
+    if(_root != nullptr){
+        cursor.push_back({_root, -1});
+        advance(cursor);
+    }
+}
+
+/**
+ * Places a cursor on the first username >= key, only the nodes along the path of key are searched.
+ * Edge bytes and prefixes compare as unsigned bytes, the same order as string::compare.
+ * @param cursor cursor to set, it ends empty if no username is >= key
+ * @param key username to search for
+ */
+void ARTIndex::seek(ARTCursor& cursor, const string& key) const {
+    cursor.clear();
+    const ARTNode* node = _root;
+    size_t depth = 0;
+    while(node != nullptr){
+        size_t length = node->prefix.size();
+        size_t matched = 0;
+        while(matched < length && depth + matched < key.size() && node->prefix[matched] == key[depth + matched]){
+            matched++;
+        }
+        if(matched < length){
+            if(depth + matched < key.size() && (uint8_t) node->prefix[matched] < (uint8_t) key[depth + matched]){
+                // Every username below node is smaller, the walk resumes after it
+                break;
+            }
+            // Every username below node is larger, or key ends inside the prefix
+            cursor.push_back({node, -1});
+            break;
+        }
+        depth += length;
+        if(depth == key.size()){
+            // The value of node, if any, is key itself and everything below is larger
+            cursor.push_back({node, -1});
+            break;
+        }
+        // The value of node is a proper prefix of key, so it is smaller and skipped
+        uint8_t byte = key[depth];
+        const ARTNode* const* child = findChild(const_cast<ARTNode*>(node), byte);
+        cursor.push_back({node, child == nullptr ? byte : byte + 1});
+        node = child == nullptr ? nullptr : *child;
+        depth++;
+    }
+    // Resumes with the first value or child the search did not rule out
+    advance(cursor);
+}
+
+/**
+ * Moves a cursor to the next username in order. A node's value comes before its children, and the
+ * children follow in edge byte order.
+ * @param cursor cursor to move, a cursor fresh from first or seek may still hold a pending root
+ */
+void ARTIndex::advance(ARTCursor& cursor) {
+    while(!cursor.empty()){
+        std::pair<const ARTNode*, int>& top = cursor.back();
+        if(top.second == -1){
+            top.second = 0;
+            if(top.first->value != nullptr) return;
+            continue;
+        }
+        int byte;
+        const ARTNode* child = top.second < 256 ? childFrom(top.first, top.second, byte) : nullptr;
+        if(child == nullptr){
+            cursor.pop_back();
+            continue;
+        }
+        top.second = byte + 1;
+        cursor.push_back({child, -1});
+    }
+}
+
+// Helper Functions
+
+/**
+ * Recursive insert. A compressed path that diverges from the key is split at the first differing byte.
+ * @param ref slot holding the subtree, replaced when the node is split or grown
+ * @param key username to insert
+ * @param depth number of key bytes matched above ref
+ * @param value UNode to store
+ * @return true if the key was inserted, false if it already existed
+ */
+bool ARTIndex::AssistInsert(ARTNode*& ref, const string& key, int depth, UNode* value) {
+    if(ref == nullptr){
+        ref = makeLeaf(key.substr(depth), value);
+        return true;
+    }
+
+    ARTNode* node = ref;
+    size_t match = 0;
+    while(match < node->prefix.size() && depth + match < key.size() && node->prefix[match] == key[depth + match]){
+        match++;
+    }
+
+    if(match < node->prefix.size()){
+        // Split the compressed path, the old node keeps the part after the differing byte
+        ARTNode4* parent = new ARTNode4();
+        parent->prefix = node->prefix.substr(0, match);
+        uint8_t edge = node->prefix[match];
+        node->prefix.erase(0, match + 1);
+        placeChild(parent, edge, node);
+        if(depth + match == key.size()){
+            parent->value = value;
+        }else{
+            placeChild(parent, key[depth + match], makeLeaf(key.substr(depth + match + 1), value));
+        }
+        ref = parent;
+        return true;
+    }
+
+    depth += match;
+    if(depth == (int) key.size()){
+        if(node->value != nullptr) return false;
+        node->value = value;
+        return true;
+    }
+
+    ARTNode** child = findChild(node, key[depth]);
+    if(child != nullptr){
+        return AssistInsert(*child, key, depth + 1, value);
+    }
+    addChild(ref, key[depth], makeLeaf(key.substr(depth + 1), value));
+    return true;
+}
+
+/**
+ * Recursive erase, the nodes on the way back up are shrunk and compacted.
+ * @param ref slot holding the subtree
+ * @param key username to remove
+ * @param depth number of key bytes matched above ref
+ * @return true if the key was removed
+ */
+bool ARTIndex::AssistErase(ARTNode*& ref, const string& key, int depth) {
+    ARTNode* node = ref;
+    if(node == nullptr) return false;
+    size_t length = node->prefix.size();
+    if(key.compare(depth, length, node->prefix) != 0 || key.size() < depth + length){
+        return false;
+    }
+    depth += length;
+
+    if(depth == (int) key.size()){
+        if(node->value == nullptr) return false;
+        node->value = nullptr;
+        compact(ref);
+        return true;
+    }
+
+    uint8_t edge = key[depth];
+    ARTNode** child = findChild(node, edge);
+    if(child == nullptr || !AssistErase(*child, key, depth + 1)){
+        return false;
+    }
+    if(*child == nullptr){
+        removeChild(ref, edge);
+    }
+    compact(ref);
+    return true;
+}
+
+/**
+ * In-order walk: the value of a node comes before its children, children in edge byte order.
+ * @param node root of the subtree, may be nullptr
+ * @param visit function called per UNode, returning false stops the walk
+ * @return false if the walk was stopped
+ */
+bool ARTIndex::AssistVisit(const ARTNode* node, const std::function<bool(UNode*)>& visit) const {
+    if(node == nullptr) return true;
+    if(node->value != nullptr && !visit(node->value)) return false;
+    return forEachChild(node, [&](uint8_t, ARTNode* child) {
+        return AssistVisit(child, visit);
+    });
+}
+
+/**
+ * Deletes every node of a subtree, the UNodes belong to the UTree.
+ * @param node root of the subtree, may be nullptr
+ */
+void ARTIndex::AssistClear(ARTNode* node) {
+    if(node == nullptr) return;
+    forEachChild(node, [](uint8_t, ARTNode* child) {
+        AssistClear(child);
+        return true;
+    });
+    destroy(node);
+}
+
+/**
+ * Creates a leaf, a Node4 without children.
+ * @param path compressed path below the parent's edge byte
+ * @param value UNode to store
+ * @return the new leaf
+ */
+ARTNode* ARTIndex::makeLeaf(const string& path, UNode* value) {
+    ARTNode4* leaf = new ARTNode4();
+    leaf->prefix = path;
+    leaf->value = value;
+    return leaf;
+}
+
+/**
+ * Finds the child slot for an edge byte.
+ * @param node node to search
+ * @param byte edge byte
+ * @return pointer to the child slot, nullptr if there is no child for byte
+ */
+ARTNode** ARTIndex::findChild(ARTNode* node, uint8_t byte) {
+    switch(node->type){
+        case ART_NODE4: {
+            ARTNode4* small = (ARTNode4*) node;
+            for(int i = 0; i < small->count; i++){
+                if(small->keys[i] == byte) return &small->children[i];
+            }
+            return nullptr;
+        }
+        case ART_NODE16: {
+            ARTNode16* medium = (ARTNode16*) node;
+#ifdef __SSE2__
+            // Compares all 16 edge bytes at once
+            __m128i matches = _mm_cmpeq_epi8(_mm_set1_epi8((char) byte),
+                                             _mm_loadu_si128((const __m128i*) medium->keys));
+            int mask = _mm_movemask_epi8(matches) & ((1 << medium->count) - 1);
+            return mask == 0 ? nullptr : &medium->children[__builtin_ctz(mask)];
+#else
+            for(int i = 0; i < medium->count; i++){
+                if(medium->keys[i] == byte) return &medium->children[i];
+            }
+            return nullptr;
+#endif
+        }
+        case ART_NODE48: {
+            ARTNode48* large = (ARTNode48*) node;
+            return large->index[byte] == 0 ? nullptr : &large->children[large->index[byte] - 1];
+        }
+        default: {
+            ARTNode256* full = (ARTNode256*) node;
+            return full->children[byte] == nullptr ? nullptr : &full->children[byte];
+        }
+    }
+}
+
+/**
+ * Stores a child in a node with room for it, Node4 and Node16 keep their edge bytes sorted.
+ * @param node node receiving the child
+ * @param byte edge byte, not yet present in node
+ * @param child child to store
+ */
+void ARTIndex::placeChild(ARTNode* node, uint8_t byte, ARTNode* child) {
+    if(node->type == ART_NODE4 || node->type == ART_NODE16){
+        uint8_t* keys = node->type == ART_NODE4 ? ((ARTNode4*) node)->keys : ((ARTNode16*) node)->keys;
+        ARTNode** children = node->type == ART_NODE4 ? ((ARTNode4*) node)->children : ((ARTNode16*) node)->children;
+        int i = node->count;
+        while(i > 0 && keys[i - 1] > byte){
+            keys[i] = keys[i - 1];
+            children[i] = children[i - 1];
+            i--;
+        }
+        keys[i] = byte;
+        children[i] = child;
+    }else if(node->type == ART_NODE48){
+        ARTNode48* large = (ARTNode48*) node;
+        // Removals leave holes, so the first free slot is not always count
+        int slot = 0;
+        while(large->children[slot] != nullptr) slot++;
+        large->children[slot] = child;
+        large->index[byte] = slot + 1;
+    }else{
+        ((ARTNode256*) node)->children[byte] = child;
+    }
+    node->count++;
+}
+
+/**
+ * Adds a child, growing the node to the next size when every slot is used.
+ * @param ref slot holding the node, replaced when the node grows
+ * @param byte edge byte, not yet present in the node
+ * @param child child to add
+ */
+void ARTIndex::addChild(ARTNode*& ref, uint8_t byte, ARTNode* child) {
+    ARTNode* node = ref;
+    ARTNode* larger = nullptr;
+    if(node->type == ART_NODE4 && node->count == 4){
+        larger = new ARTNode16();
+    }else if(node->type == ART_NODE16 && node->count == 16){
+        larger = new ARTNode48();
+    }else if(node->type == ART_NODE48 && node->count == 48){
+        larger = new ARTNode256();
+    }
+    if(larger != nullptr){
+        moveChildren(node, larger);
+        destroy(node);
+        ref = node = larger;
+    }
+    placeChild(node, byte, child);
+}
+
+/**
+ * Removes a child, shrinking the node to the next size down once it is sparse enough.
+ * @param ref slot holding the node, replaced when the node shrinks
+ * @param byte edge byte of the child to remove
+ */
+void ARTIndex::removeChild(ARTNode*& ref, uint8_t byte) {
+    ARTNode* node = ref;
+    if(node->type == ART_NODE4 || node->type == ART_NODE16){
+        uint8_t* keys = node->type == ART_NODE4 ? ((ARTNode4*) node)->keys : ((ARTNode16*) node)->keys;
+        ARTNode** children = node->type == ART_NODE4 ? ((ARTNode4*) node)->children : ((ARTNode16*) node)->children;
+        int i = 0;
+        while(keys[i] != byte) i++;
+        for(; i < node->count - 1; i++){
+            keys[i] = keys[i + 1];
+            children[i] = children[i + 1];
+        }
+    }else if(node->type == ART_NODE48){
+        ARTNode48* large = (ARTNode48*) node;
+        large->children[large->index[byte] - 1] = nullptr;
+        large->index[byte] = 0;
+    }else{
+        ((ARTNode256*) node)->children[byte] = nullptr;
+    }
+    node->count--;
+
+    // Shrink with some slack so a node on the boundary does not flip between sizes
+    ARTNode* smaller = nullptr;
+    if(node->type == ART_NODE16 && node->count <= 3){
+        smaller = new ARTNode4();
+    }else if(node->type == ART_NODE48 && node->count <= 12){
+        smaller = new ARTNode16();
+    }else if(node->type == ART_NODE256 && node->count <= 37){
+        smaller = new ARTNode48();
+    }
+    if(smaller != nullptr){
+        moveChildren(node, smaller);
+        destroy(node);
+        ref = smaller;
+    }
+}
+
+/**
+ * Deletes a node without a value or children, and merges a node without a value into its only child
+ * so the compressed path stays as short as possible.
+ * @param ref slot holding the node, set to nullptr or to the merged child
+ */
+void ARTIndex::compact(ARTNode*& ref) {
+    ARTNode* node = ref;
+    if(node->value != nullptr || node->count > 1) return;
+    if(node->count == 0){
+        destroy(node);
+        ref = nullptr;
+        return;
+    }
+    forEachChild(node, [&](uint8_t byte, ARTNode* child) {
+        child->prefix = node->prefix + (char) byte + child->prefix;
+        ref = child;
+        return false;
+    });
+    destroy(node);
+}
+
+/**
+ * Copies the header and every child of a node into an empty node of another size.
+ * @param from node being replaced
+ * @param to empty replacement with room for every child
+ */
+void ARTIndex::moveChildren(ARTNode* from, ARTNode* to) {
+    to->prefix.swap(from->prefix);
+    to->value = from->value;
+    forEachChild(from, [&](uint8_t byte, ARTNode* child) {
+        placeChild(to, byte, child);
+        return true;
+    });
+}
+
+/**
+ * Finds the first child at or after an edge byte.
+ * @param node node whose children are searched
+ * @param from smallest edge byte to accept, 0 to 255
+ * @param byte set to the edge byte of the child found
+ * @return the child, nullptr if every edge byte is below from
+ */
+const ARTNode* ARTIndex::childFrom(const ARTNode* node, int from, int& byte) {
+    switch(node->type){
+        case ART_NODE4:
+        case ART_NODE16: {
+            const uint8_t* keys = node->type == ART_NODE4 ? ((ARTNode4*) node)->keys : ((ARTNode16*) node)->keys;
+            ARTNode* const* children = node->type == ART_NODE4 ? ((ARTNode4*) node)->children
+                                                               : ((ARTNode16*) node)->children;
+            for(int i = 0; i < node->count; i++){
+                if(keys[i] >= from){
+                    byte = keys[i];
+                    return children[i];
+                }
+            }
+            return nullptr;
+        }
+        case ART_NODE48: {
+            const ARTNode48* large = (const ARTNode48*) node;
+            for(byte = from; byte < 256; byte++){
+                if(large->index[byte] != 0) return large->children[large->index[byte] - 1];
+            }
+            return nullptr;
+        }
+        default: {
+            const ARTNode256* full = (const ARTNode256*) node;
+            for(byte = from; byte < 256; byte++){
+                if(full->children[byte] != nullptr) return full->children[byte];
+            }
+            return nullptr;
+        }
+    }
+}
+
+/**
+ * Calls visit on every child in edge byte order.
+ * @param node node whose children are visited
+ * @param visit function called per child, returning false stops the walk
+ * @return false if the walk was stopped
+ */
+bool ARTIndex::forEachChild(const ARTNode* node, const std::function<bool(uint8_t, ARTNode*)>& visit) {
+    switch(node->type){
+        case ART_NODE4:
+        case ART_NODE16: {
+            const uint8_t* keys = node->type == ART_NODE4 ? ((ARTNode4*) node)->keys : ((ARTNode16*) node)->keys;
+            ARTNode* const* children = node->type == ART_NODE4 ? ((ARTNode4*) node)->children
+                                                               : ((ARTNode16*) node)->children;
+            for(int i = 0; i < node->count; i++){
+                if(!visit(keys[i], children[i])) return false;
+            }
+            return true;
+        }
+        case ART_NODE48: {
+            const ARTNode48* large = (const ARTNode48*) node;
+            for(int byte = 0; byte < 256; byte++){
+                if(large->index[byte] != 0 && !visit(byte, large->children[large->index[byte] - 1])) return false;
+            }
+            return true;
+        }
+        default: {
+            const ARTNode256* full = (const ARTNode256*) node;
+            for(int byte = 0; byte < 256; byte++){
+                if(full->children[byte] != nullptr && !visit(byte, full->children[byte])) return false;
+            }
+            return true;
+        }
+    }
+}
+
+/**
+ * Deletes a single node through its real type.
+ * @param node node to delete
+ */
+void ARTIndex::destroy(ARTNode* node) {
+    switch(node->type){
+        case ART_NODE4: delete (ARTNode4*) node; break;
+        case ART_NODE16: delete (ARTNode16*) node; break;
+        case ART_NODE48: delete (ARTNode48*) node; break;
+        default: delete (ARTNode256*) node; break;
+    }
+}
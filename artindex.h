@@ -0,0 +1,138 @@
+/**
+ * CMSC 341 - Spring 2021
+ * Project 2 - Binary Trees
+ * ARTIndex.h
+ * An interface for the ARTIndex class, an adaptive radix tree from username to UNode used as a UTree engine.
+ */
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <functional>
+
+using std::string;
+
+class UNode;
+
+/* Node kinds, a node is replaced by the next size up when it runs out of child slots */
+enum ARTNodeType : uint8_t {ART_NODE4, ART_NODE16, ART_NODE48, ART_NODE256};
+
+/* Common header. prefix is the compressed path below the parent's edge byte, and value is set when
+ * a username ends exactly at this node. A node with no children is a leaf. */
+struct ARTNode {
+    ARTNodeType type;
+    uint16_t count;
+    string prefix;
+    UNode* value;
+
+    ARTNode(ARTNodeType nodeType): type(nodeType), count(0), value(nullptr) {}
+};
+
+/* Up to 4 children, edge bytes kept sorted */
+struct ARTNode4 : ARTNode {
+    uint8_t keys[4];
+    ARTNode* children[4];
+    ARTNode4(): ARTNode(ART_NODE4) {}
+};
+
+/* Up to 16 children, edge bytes kept sorted and searched 16 at a time */
+struct ARTNode16 : ARTNode {
+    uint8_t keys[16];
+    ARTNode* children[16];
+    ARTNode16(): ARTNode(ART_NODE16) {}
+};
+
+/* Up to 48 children, a byte indexed table holds slot + 1 (0 for no child), free slots are nullptr */
+struct ARTNode48 : ARTNode {
+    uint8_t index[256];
+    ARTNode* children[48];
+    ARTNode48(): ARTNode(ART_NODE48), index(), children() {}
+};
+
+/* One slot for every byte */
+struct ARTNode256 : ARTNode {
+    ARTNode* children[256];
+    ARTNode256(): ARTNode(ART_NODE256), children() {}
+};
+
+/* Position in an in-order walk: the path from the root, each node paired with the next edge byte
+ * to descend into, -1 while its own value is still ahead. The current username is the value of the
+ * last node, the cursor is empty past the last username. */
+typedef std::vector<std::pair<const ARTNode*, int>> ARTCursor;
+
+class ARTIndex {
+    friend class Grader;
+    friend class Tester;
+
+public:
+    ARTIndex(): _root(nullptr), _size(0) {}
+    ~ARTIndex() {clear();}
+
+    /* Basic operations */
+
+    bool insert(const string& username, UNode* node);
+    UNode* find(const string& username) const;
+    bool erase(const string& username);
+    void clear();
+    int size() const {return _size;}
+
+    /* Visits every UNode in username order */
+    void forEach(const std::function<void(UNode*)>& visit) const;
+
+    /* Up to limit UNodes whose username starts with prefix, in username order */
+    std::vector<UNode*> prefixSearch(const string& prefix, int limit) const;
+
+    /* Cursors for walks that cannot use a callback, they are invalidated by inserts and erases */
+    void first(ARTCursor& cursor) const;
+    void seek(ARTCursor& cursor, const string& key) const;
+    static void advance(ARTCursor& cursor);
+    static UNode* value(const ARTCursor& cursor) {return cursor.back().first->value;}
+
+private:
+    ARTNode* _root;
+    int _size;
+
+    // Recursive insert below the slot ref, depth bytes of the key are already matched
+    bool AssistInsert(ARTNode*& ref, const string& key, int depth, UNode* value);
+
+    // Recursive erase below the slot ref
+    bool AssistErase(ARTNode*& ref, const string& key, int depth);
+
+    // Recursive in-order walk, stops once visit returns false
+    bool AssistVisit(const ARTNode* node, const std::function<bool(UNode*)>& visit) const;
+
+    // Deletes a subtree
+    static void AssistClear(ARTNode* node);
+
+    // Creates a leaf holding value under the compressed path
+    static ARTNode* makeLeaf(const string& path, UNode* value);
+
+    // Finds the child slot for an edge byte, nullptr if there is none
+    static ARTNode** findChild(ARTNode* node, uint8_t byte);
+
+    // Stores a child in a node that has room for it
+    static void placeChild(ARTNode* node, uint8_t byte, ARTNode* child);
+
+    // Adds a child, replacing ref with a larger node when it is full
+    static void addChild(ARTNode*& ref, uint8_t byte, ARTNode* child);
+
+    // Removes a child, replacing ref with a smaller node when it is sparse
+    static void removeChild(ARTNode*& ref, uint8_t byte);
+
+    // Deletes a node that has no value and no children, or merges it into its only child
+    static void compact(ARTNode*& ref);
+
+    // Copies the header and children of a node into a node of another size
+    static void moveChildren(ARTNode* from, ARTNode* to);
+
+    // Finds the child with the smallest edge byte >= from, sets byte to its edge, nullptr if there is none
+    static const ARTNode* childFrom(const ARTNode* node, int from, int& byte);
+
+    // Calls visit on every child in edge byte order
+    static bool forEachChild(const ARTNode* node, const std::function<bool(uint8_t, ARTNode*)>& visit);
+
+    // Deletes a single node using its real type
+    static void destroy(ARTNode* node);
+};
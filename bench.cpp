@@ -0,0 +1,796 @@
+/**
+ * CMSC 341 - Spring 2021
+ * Project 2 - Binary Trees
+ * bench.cpp
+ * Benchmarks for the tree engines and layouts.
+ * Usage: ./bench [benchmark] [largest size]
+ */
+
+#include "utree.h"
+#include "snapshot.h"
+#include "exporter.h"
+#include "columns.h"
+#include "treestats.h"
+#include "reclaimer.h"
+#include <chrono>
+#include <random>
+#include <vector>
+#include <iomanip>
+#include <cmath>
+#include <cstdio>
+#include <algorithm>
+#include <unordered_set>
+
+using std::vector;
+
+std::mt19937 rng(10);
+
+/**
+ * Runs a function once and measures it.
+ * @param work function to time
+ * @return elapsed time in seconds
+ */
+template<class Work>
+double timeIt(Work work) {
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    work();
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+/**
+ * Generates distinct usernames that share long prefixes, like real username sets do.
+ * @param count number of usernames
+ * @param seed seed for the generator, different seeds give disjoint sets with high probability
+ * @return the usernames in random order
+ */
+vector<string> makeUsernames(int count, int seed) {
+    static const char* stems[] = {"gamer", "xX_shadow", "the_real_", "user", "Aqua", "nitro_fan"};
+    static const char alphabet[] = "abcdefghijklmnopqrstuvwxyz0123456789";
+    std::mt19937 gen(seed);
+    vector<string> names;
+    names.reserve(count);
+    for(int i = 0; i < count; i++){
+        string name = stems[gen() % 6];
+        int length = 4 + gen() % 6;
+        for(int c = 0; c < length; c++) name += alphabet[gen() % 36];
+        name += std::to_string(i);
+        names.push_back(name);
+    }
+    return names;
+}
+
+/**
+ * Prints one row of a result table.
+ * @param label row label
+ * @param size number of elements
+ * @param seconds measured time
+ * @param operations number of operations timed
+ */
+void report(const string& label, long size, double seconds, long operations) {
+    cout << std::left << std::setw(24) << label << std::right << std::setw(10) << size
+         << std::setw(14) << std::fixed << std::setprecision(1) << seconds * 1e9 / operations << " ns/op\n";
+}
+
+/**
+ * Compares the AVL, B-tree and ART username engines, and the AVL engine with a hash index, on
+ * inserts, hits and misses.
+ * @param maxSize largest number of usernames
+ */
+void benchEngines(int maxSize) {
+    cout << "Username engines: insert, retrieve hit, retrieve miss\n";
+    for(int size = 1000; size <= maxSize; size *= 10){
+        vector<string> names = makeUsernames(size, 1);
+        vector<string> misses = makeUsernames(size, 2);
+        UTreeEngine engines[] = {ENGINE_AVL, ENGINE_BTREE, ENGINE_ART, ENGINE_AVL};
+        const char* labels[] = {"avl", "btree", "art", "avl+hash"};
+        for(int e = 0; e < 4; e++){
+            UTree utree(engines[e]);
+            if(e == 3) utree.enableHashIndex(size);
+            double insert = timeIt([&]() {
+                for(const string& name : names) utree.insert(Account(name, 1, false, "", ""));
+            });
+            long found = 0;
+            double hit = timeIt([&]() {
+                for(const string& name : names) found += utree.retrieve(name) != nullptr;
+            });
+            double miss = timeIt([&]() {
+                for(const string& name : misses) found += utree.retrieve(name) != nullptr;
+            });
+            if(found != size) cout << "  (" << labels[e] << " lost usernames: " << found << ")\n";
+            report(string(labels[e]) + " insert", size, insert, size);
+            report(string(labels[e]) + " hit", size, hit, size);
+            report(string(labels[e]) + " miss", size, miss, size);
+        }
+    }
+}
+
+/**
+ * Measures username availability checks, nearly all misses, with and without the filter, and the
+ * filter's real false positive rate.
+ * @param maxSize largest number of usernames
+ */
+void benchFilter(int maxSize) {
+    cout << "Username filter: retrieve miss without and with the filter\n";
+    for(int size = 1000; size <= maxSize; size *= 10){
+        vector<string> names = makeUsernames(size, 1);
+        vector<string> misses = makeUsernames(size, 2);
+        UTree utree(ENGINE_BTREE);
+        for(const string& name : names) utree.insert(Account(name, 1, false, "", ""));
+
+        long found = 0;
+        double plain = timeIt([&]() {
+            for(const string& name : misses) found += utree.retrieve(name) != nullptr;
+        });
+        utree.enableFilter(size);
+        long passed = 0;
+        double filtered = timeIt([&]() {
+            for(const string& name : misses) passed += utree.getFilter()->mayContain(name);
+        });
+        double withTree = timeIt([&]() {
+            for(const string& name : misses) found += utree.retrieve(name) != nullptr;
+        });
+        report("btree miss", size, plain, size);
+        report("filter only", size, filtered, size);
+        report("filter+btree miss", size, withTree, size);
+        cout << "  false positive rate " << std::setprecision(4) << (double) passed / size << ", " << utree.getFilter()->memoryBytes()
+             << " bytes\n";
+    }
+}
+
+/**
+ * Measures retrieveUser on skewed traffic, where a few thousand accounts take most lookups, with
+ * and without the lookup cache.
+ * @param maxSize largest number of usernames
+ */
+void benchCache(int maxSize) {
+    cout << "Lookup cache: skewed retrieveUser without and with the cache\n";
+    const int accountsPerUser = 4;
+    const long lookups = 1000000;
+    for(int size = 1000; size <= maxSize; size *= 10){
+        vector<string> names = makeUsernames(size, 1);
+        UTree utree(ENGINE_BTREE);
+        for(const string& name : names){
+            for(int disc = 1; disc <= accountsPerUser; disc++) utree.insert(Account(name, disc, false, "", ""));
+        }
+
+        // Zipf-like ranks: rank r is drawn with probability proportional to 1 / r
+        std::mt19937 gen(3);
+        std::uniform_real_distribution<> unit(0.0, 1.0);
+        long accounts = (long) size * accountsPerUser;
+        vector<long> ranks(lookups);
+        for(long& rank : ranks) rank = (long) std::pow((double) accounts, unit(gen)) - 1;
+
+        long found = 0;
+        double plain = timeIt([&]() {
+            for(long rank : ranks) found += utree.retrieveUser(names[rank / accountsPerUser], rank % accountsPerUser + 1) != nullptr;
+        });
+        utree.enableLookupCache();
+        double cached = timeIt([&]() {
+            for(long rank : ranks) found += utree.retrieveUser(names[rank / accountsPerUser], rank % accountsPerUser + 1) != nullptr;
+        });
+        if(found != 2 * lookups) cout << "  (lost accounts: " << found << ")\n";
+        report("retrieveUser", size, plain, lookups);
+        report("retrieveUser+cache", size, cached, lookups);
+        cout << "  hit rate " << std::setprecision(4) << utree.getLookupCache()->hitRate() << ", "
+             << utree.getLookupCache()->memoryBytes() << " bytes\n";
+    }
+}
+
+/**
+ * Compares loadData, which copies every status into the arena, with loadMapped, which points
+ * statuses into the mapped file.
+ * @param maxSize largest number of rows
+ */
+void benchLoad(int maxSize) {
+    cout << "Loading: loadData and loadMapped of a .csv with long statuses\n";
+    const string path = "bench_load.csv";
+    for(int size = 1000; size <= maxSize; size *= 10){
+        vector<string> names = makeUsernames(size / 2, 1);
+        {
+            std::ofstream csv(path);
+            for(int row = 0; row < size; row++){
+                csv << names[row / 2] << ',' << row % 2 + 1 << ",1,Subscriber,Currently streaming ranked matches all night long "
+                    << row << '\n';
+            }
+        }
+        UTree copied(ENGINE_BTREE);
+        double plain = timeIt([&]() {copied.loadData(path);});
+        UTree mapped(ENGINE_BTREE);
+        double direct = timeIt([&]() {mapped.loadMapped(path);});
+        report("loadData", size, plain, size);
+        report("loadMapped", size, direct, size);
+        cout << "  status bytes copied: " << TreeProfiler().profile(copied).arenaBytes << " by loadData, "
+             << TreeProfiler().profile(mapped).arenaBytes << " by loadMapped\n";
+    }
+    std::remove(path.c_str());
+}
+
+/**
+ * Measures building, copying and clearing DTrees of random discriminators, the operations whose
+ * cost depends on how the nodes are stored.
+ * @param maxSize total number of accounts per size, spread over as many DTrees as needed
+ */
+void benchDTree(int maxSize) {
+    cout << "DTree storage: insert, copy and clear per account\n";
+    for(int size = 10; size <= MAX_DISC + 1; size *= 10){
+        int numTrees = std::max(1, maxSize / size);
+        vector<int> discs(MAX_DISC + 1);
+        for(int disc = 0; disc <= MAX_DISC; disc++) discs[disc] = disc;
+        vector<DTree> trees(numTrees);
+        double insert = timeIt([&]() {
+            for(DTree& dtree : trees){
+                for(int i = 0; i < size; i++){
+                    // Partial shuffle, only the first size discriminators are drawn
+                    std::swap(discs[i], discs[i + rng() % (discs.size() - i)]);
+                    dtree.insert(Account("bench", discs[i], false, "", ""));
+                }
+            }
+        });
+        vector<DTree> copies(numTrees);
+        double copy = timeIt([&]() {
+            for(int t = 0; t < numTrees; t++) copies[t] = trees[t];
+        });
+        double clear = timeIt([&]() {
+            for(DTree& dtree : trees) dtree.clear();
+        });
+        report("dtree insert", size, insert, (long) numTrees * size);
+        report("dtree copy", size, copy, (long) numTrees * size);
+        report("dtree clear", size, clear, (long) numTrees * size);
+    }
+}
+
+/**
+ * Measures taking a snapshot against exporting a copy of the tree, and what writes cost while a
+ * snapshot shares the tree.
+ * @param maxSize largest number of usernames
+ */
+void benchSnapshot(int maxSize) {
+    cout << "Snapshots: snapshot against a full export, removes without and with a snapshot\n";
+    for(int size = 1000; size <= maxSize; size *= 10){
+        vector<string> names = makeUsernames(size, 1);
+        UTree plain, versioned;
+        for(const string& name : names){
+            plain.insert(Account(name, 1, false, "", ""));
+            versioned.insert(Account(name, 1, false, "", ""));
+        }
+        const int snapshots = 1000;
+        double take = timeIt([&]() {
+            for(int i = 0; i < snapshots; i++) versioned.snapshot();
+        });
+        std::ostringstream copy;
+        double exported = timeIt([&]() {AccountExporter(copy).exportTree(versioned);});
+
+        DNode* removed;
+        double unshared = timeIt([&]() {
+            for(const string& name : names) plain.removeUser(name, 1, removed);
+        });
+        UTreeSnapshot snapshot = versioned.snapshot();
+        double shared = timeIt([&]() {
+            for(const string& name : names) versioned.removeUser(name, 1, removed);
+        });
+        long kept = 0;
+        snapshot.forEachNode([&](const UNode* node) {kept += node->getNumUsers();});
+        if(kept != size) cout << "  (snapshot lost accounts: " << kept << ")\n";
+        report("snapshot", size, take, snapshots);
+        report("export copy", size, exported, 1);
+        report("remove", size, unshared, size);
+        report("remove+snapshot", size, shared, size);
+    }
+}
+
+/**
+ * Measures diffs between snapshots a few writes apart, against a diff of two trees that share
+ * nothing.
+ * @param maxSize largest number of usernames
+ */
+void benchDiff(int maxSize) {
+    cout << "Snapshot diff: 16 removes apart, and unrelated copies\n";
+    const int writes = 16;
+    for(int size = 1000; size <= maxSize; size *= 10){
+        vector<string> names = makeUsernames(size, 1);
+        UTree utree, copy;
+        for(const string& name : names){
+            utree.insert(Account(name, 1, false, "", ""));
+            copy.insert(Account(name, 1, false, "", ""));
+        }
+        UTreeSnapshot before = utree.snapshot();
+        DNode* removed;
+        for(int i = 0; i < writes; i++) utree.removeUser(names[i * (size / writes)], 1, removed);
+        UTreeSnapshot after = utree.snapshot();
+        UTreeSnapshot unrelated = copy.snapshot();
+
+        const int repeats = 100;
+        long changes = 0;
+        double related = timeIt([&]() {
+            for(int i = 0; i < repeats; i++) changes += UTreeSnapshot::diff(before, after, [](ChangeType, const Account&) {});
+        });
+        double separate = timeIt([&]() {
+            changes += UTreeSnapshot::diff(after, unrelated, [](ChangeType, const Account&) {});
+        });
+        if(changes != (long) (repeats + 1) * writes) cout << "  (wrong number of changes: " << changes << ")\n";
+        report("diff 16 writes apart", size, related, repeats);
+        report("diff unrelated", size, separate, 1);
+    }
+}
+
+/**
+ * Measures a full walk of every account by iterator, and short username range scans that seek with
+ * lower_bound against ones that filter a full walk.
+ * @param maxSize largest number of usernames
+ */
+void benchScan(int maxSize) {
+    cout << "Scans: full account walk, 10 username ranges by seek and by filtering\n";
+    for(int size = 1000; size <= maxSize; size *= 10){
+        vector<string> names = makeUsernames(size, 1);
+        vector<string> sorted = names;
+        std::sort(sorted.begin(), sorted.end());
+        UTreeEngine engines[] = {ENGINE_AVL, ENGINE_BTREE, ENGINE_ART};
+        const char* labels[] = {"avl", "btree", "art"};
+        for(int e = 0; e < 3; e++){
+            UTree utree(engines[e]);
+            for(const string& name : names) utree.insert(Account(name, 1, false, "", ""));
+            long seen = 0;
+            double walked = timeIt([&]() {
+                for(const Account& acct : utree.accounts()) seen += acct.getDiscriminator();
+            });
+            const int ranges = 100;
+            const int width = 10;
+            double sought = timeIt([&]() {
+                for(int i = 0; i < ranges; i++){
+                    int first = i * ((size - width) / ranges);
+                    for(const UNode& node : utree.range(sorted[first], sorted[first + width])) seen += node.getNumUsers();
+                }
+            });
+            double filtered = timeIt([&]() {
+                for(int i = 0; i < ranges; i++){
+                    int first = i * ((size - width) / ranges);
+                    for(const UNode& node : utree){
+                        if(node.getUsername() >= sorted[first + width]) break;
+                        if(node.getUsername() >= sorted[first]) seen += node.getNumUsers();
+                    }
+                }
+            });
+            if(seen != size + 2L * ranges * width) cout << "  (" << labels[e] << " wrong count: " << seen << ")\n";
+            report(string(labels[e]) + " walk", size, walked, size);
+            report(string(labels[e]) + " range seek", size, sought, ranges);
+            report(string(labels[e]) + " range filter", size, filtered, ranges);
+        }
+    }
+}
+
+/**
+ * Measures the counting queries: global rank and top usernames answered from the AVL subtree
+ * aggregates, against the B-tree engine that has to walk every username.
+ * @param maxSize largest number of usernames
+ */
+void benchRank(int maxSize) {
+    cout << "Counting queries: rank of an account, 10 most crowded usernames\n";
+    for(int size = 1000; size <= maxSize; size *= 10){
+        vector<string> names = makeUsernames(size, 1);
+        UTreeEngine engines[] = {ENGINE_AVL, ENGINE_BTREE};
+        const char* labels[] = {"avl", "btree"};
+        for(int e = 0; e < 2; e++){
+            UTree utree(engines[e]);
+            for(int i = 0; i < size; i++){
+                // A few usernames get many accounts
+                for(int disc = 0; disc <= (i % 97 == 0 ? i / 97 % 60 : 0); disc++) utree.insert(Account(names[i], disc, false, "", ""));
+            }
+            const int queries = 1000;
+            long total = 0;
+            double ranked = timeIt([&]() {
+                for(int i = 0; i < queries; i++) total += utree.rank(names[(i * 7919) % size], 0);
+            });
+            double top = timeIt([&]() {
+                for(int i = 0; i < queries / 10; i++) total += utree.mostAccounts(10).size();
+            });
+            if(total < queries) cout << "  (" << labels[e] << " wrong answers)\n";
+            report(string(labels[e]) + " rank", size, ranked, queries);
+            report(string(labels[e]) + " top 10", size, top, queries / 10);
+        }
+    }
+}
+
+/**
+ * Measures filtered counts and scans on nitro and badge with and without the bitmap index.
+ * @param maxSize largest number of usernames
+ */
+void benchBitmap(int maxSize) {
+    cout << "Bitmap index: nitro count, nitro and badge count, nitro scan\n";
+    const char* badges[] = {"", "Subscriber", "HypeSquad Brilliance", "Server Booster"};
+    for(int size = 1000; size <= maxSize; size *= 10){
+        vector<string> names = makeUsernames(size, 1);
+        UTree utree(ENGINE_BTREE);
+        std::mt19937 gen(size);
+        for(int i = 0; i < size; i++){
+            for(int disc = 0; disc < 1 + i % 8; disc++) utree.insert(Account(names[i], disc, gen() % 4 == 0, badges[gen() % 4], ""));
+        }
+        for(int indexed = 0; indexed < 2; indexed++){
+            if(indexed) utree.enableBitmapIndex();
+            const int queries = indexed ? 1000 : 10;
+            long total = 0;
+            double nitro = timeIt([&]() {
+                for(int i = 0; i < queries; i++) total += utree.countNitro();
+            });
+            double both = timeIt([&]() {
+                for(int i = 0; i < queries; i++) total += utree.countBadge("Subscriber", true);
+            });
+            double scan = timeIt([&]() {
+                utree.forEachNitro([&](const Account& acct) {total += acct.getDiscriminator();});
+            });
+            string label = indexed ? "bitmap " : "walk ";
+            report(label + "nitro count", size, nitro, queries);
+            report(label + "nitro+badge count", size, both, queries);
+            report(label + "nitro scan", size, scan, 1);
+        }
+        const AccountBitmaps* bitmaps = utree.getBitmapIndex();
+        cout << "  index bytes per account: " << (double) bitmaps->memoryBytes() / utree.numAccounts() << "\n";
+    }
+}
+
+void benchColumns(int maxSize) {
+    cout << "Columns: build, nitro count, badge count, 100 bin histogram\n";
+    const char* badges[] = {"", "Subscriber", "HypeSquad Brilliance", "Server Booster"};
+    for(int size = 1000; size <= maxSize; size *= 10){
+        vector<string> names = makeUsernames(size, 1);
+        UTree utree(ENGINE_BTREE);
+        std::mt19937 gen(size);
+        for(int i = 0; i < size; i++){
+            for(int disc = 0; disc < 1 + i % 8; disc++){
+                utree.insert(Account(names[i], gen() % (MAX_DISC + 1), gen() % 4 == 0, badges[gen() % 4], "status"));
+            }
+        }
+        const int queries = 10;
+        long total = 0;
+        double walkNitro = timeIt([&]() {
+            for(int i = 0; i < queries; i++){
+                for(const Account& acct : utree.accounts()) total += acct.hasNitro();
+            }
+        });
+        double walkBadge = timeIt([&]() {
+            for(int i = 0; i < queries; i++){
+                for(const Account& acct : utree.accounts()) total += acct.getBadge() == "Subscriber";
+            }
+        });
+        double walkHistogram = timeIt([&]() {
+            for(int i = 0; i < queries; i++){
+                vector<long> histogram(100, 0);
+                for(const Account& acct : utree.accounts()) histogram[acct.getDiscriminator() / 100]++;
+                total += histogram[0];
+            }
+        });
+        AccountColumns* columns = nullptr;
+        double build = timeIt([&]() {columns = new AccountColumns(utree);});
+        size_t rows = columns->numRows();
+        double nitro = timeIt([&]() {
+            for(int i = 0; i < queries; i++) total += columns->countNitro(0, rows);
+        });
+        double badge = timeIt([&]() {
+            for(int i = 0; i < queries; i++) total += columns->countBadge("Subscriber", 0, rows);
+        });
+        double histogram = timeIt([&]() {
+            for(int i = 0; i < queries; i++) total += columns->discHistogram(100, 0, rows)[0];
+        });
+        report("walk nitro count", size, walkNitro, queries);
+        report("walk badge count", size, walkBadge, queries);
+        report("walk histogram", size, walkHistogram, queries);
+        report("column build", size, build, 1);
+        report("column nitro count", size, nitro, queries);
+        report("column badge count", size, badge, queries);
+        report("column histogram", size, histogram, queries);
+        cout << "  column bytes per account: " << (double) columns->memoryBytes() / rows << "\n";
+        delete columns;
+    }
+}
+
+/**
+ * Inserts discriminators in increasing order, the worst case for an unbalanced DTree, with
+ * rebuilding off (alpha 1) and at a few weight balance bounds.
+ * @param maxSize largest number of accounts, capped at one DTree's MAX_DISC + 1
+ */
+void benchSequential(int maxSize) {
+    cout << "DTree sequential inserts: insert, retrieve by alpha\n";
+    double alphas[] = {1, 0.85, DTREE_DEFAULT_ALPHA, 0.6};
+    for(int size = 10; size <= std::min(maxSize, MAX_DISC + 1); size *= 10){
+        int numTrees = std::max(1, 100000 / size);
+        for(double alpha : alphas){
+            vector<DTree> trees(numTrees);
+            double insert = timeIt([&]() {
+                for(DTree& dtree : trees){
+                    dtree.setAlpha(alpha);
+                    for(int disc = 0; disc < size; disc++) dtree.insert(Account("bench", disc, false, "", ""));
+                }
+            });
+            // Spread over the whole range, and too few reads per tree to freeze it
+            const int reads = std::min(size, FREEZE_AFTER_READS - 1);
+            long found = 0;
+            double retrieve = timeIt([&]() {
+                for(DTree& dtree : trees){
+                    for(int i = 0; i < reads; i++) found += dtree.retrieve((long) i * size / reads) != nullptr;
+                }
+            });
+            std::ostringstream label;
+            label << "alpha " << alpha;
+            report(label.str() + " insert", size, insert, (long) numTrees * size);
+            report(label.str() + " retrieve", size, retrieve, (long) numTrees * reads);
+        }
+    }
+}
+
+/**
+ * Measures AVL engine maintenance: new usernames in random and sorted order, a second account for
+ * existing usernames, and removal of usernames. Every cost should grow with the height only.
+ * @param maxSize largest number of usernames
+ */
+void benchAVL(int maxSize) {
+    cout << "UTree AVL maintenance: new, sorted, existing, remove\n";
+    for(int size = 1000; size <= maxSize; size *= 10){
+        vector<string> names = makeUsernames(size, 12);
+        UTree utree;
+        double insert = timeIt([&]() {
+            for(const string& name : names) utree.insert(Account(name, 1, false, "", ""));
+        });
+        double existing = timeIt([&]() {
+            for(const string& name : names) utree.insert(Account(name, 2, false, "", ""));
+        });
+        // Both accounts go, so every username leaves the tree
+        DNode* removed = nullptr;
+        double remove = timeIt([&]() {
+            for(const string& name : names){
+                utree.removeUser(name, 1, removed);
+                utree.removeUser(name, 2, removed);
+            }
+        });
+        std::sort(names.begin(), names.end());
+        UTree sorted;
+        double ordered = timeIt([&]() {
+            for(const string& name : names) sorted.insert(Account(name, 1, false, "", ""));
+        });
+        report("avl new", size, insert, size);
+        report("avl sorted", size, ordered, size);
+        report("avl existing", size, existing, size);
+        report("avl remove", size, remove, 2L * size);
+    }
+}
+
+/**
+ * Merges a batch holding as many accounts per username as the live tree, above the live
+ * discriminators and interleaved with them, against inserting the batch one account at a time.
+ * Building the batch tree stands for parsing it, which a file load pays either way.
+ * @param maxSize accounts in the live tree
+ */
+void benchMerge(int maxSize) {
+    cout << "UTree merge: batch inserted into the live tree, or built as a tree and merged\n";
+    for(int perUser : {100, 1000, 4000}){
+        int users = std::max(1, maxSize / perUser);
+        vector<string> names = makeUsernames(users, 13);
+        for(bool interleaved : {false, true}){
+            // Live discriminators and batch discriminators of the i-th account of a username
+            auto liveDisc = [&](int i) {return interleaved ? 2 * i : i;};
+            auto batchDisc = [&](int i) {return interleaved ? 2 * i + 1 : perUser + i;};
+            UTree inserted, merged;
+            for(const string& name : names){
+                for(int i = 0; i < perUser; i++){
+                    inserted.insert(Account(name, liveDisc(i), false, "", ""));
+                    merged.insert(Account(name, liveDisc(i), false, "", ""));
+                }
+            }
+            double insert = timeIt([&]() {
+                for(const string& name : names){
+                    for(int i = 0; i < perUser; i++) inserted.insert(Account(name, batchDisc(i), true, "", ""));
+                }
+            });
+            UTree batch;
+            double build = timeIt([&]() {
+                for(const string& name : names){
+                    for(int i = 0; i < perUser; i++) batch.insert(Account(name, batchDisc(i), true, "", ""));
+                }
+            });
+            double merge = timeIt([&]() {merged.merge(batch);});
+            if(merged.numAccounts() != inserted.numAccounts()) cout << "mismatch\n";
+            string label = (interleaved ? "interleaved/" : "appended/") + std::to_string(perUser) + " ";
+            report(label + "insert", (long) users * perUser, insert, (long) users * perUser);
+            report(label + "batch", (long) users * perUser, build, (long) users * perUser);
+            report(label + "merge", (long) users * perUser, merge, (long) users * perUser);
+        }
+    }
+}
+
+/**
+ * Removes every account without nitro, about half of them, through removeUser one account at a
+ * time and through removeIf with one or more threads.
+ * @param maxSize largest number of usernames, each with 1 to 8 accounts
+ */
+void benchRetention(int maxSize) {
+    cout << "Retention: remove accounts without nitro, per account in the tree\n";
+    for(int size = 1000; size <= maxSize; size *= 10){
+        vector<string> names = makeUsernames(size, 14);
+        auto build = [&](UTree& utree) {
+            for(int i = 0; i < size; i++){
+                for(int disc = 0; disc <= i % 8; disc++) utree.insert(Account(names[i], disc, (i + disc) % 2 == 0, "", ""));
+            }
+        };
+        auto noNitro = [](const Account& acct) {return !acct.hasNitro();};
+        UTree single;
+        build(single);
+        long accounts = single.numAccounts();
+        double removeUser = timeIt([&]() {
+            vector<std::pair<string, int>> matches;
+            for(const Account& acct : single.accounts()){
+                if(noNitro(acct)) matches.push_back({acct.getUsername(), acct.getDiscriminator()});
+            }
+            DNode* removed = nullptr;
+            for(auto& match : matches) single.removeUser(match.first, match.second, removed);
+        });
+        report("removeUser", size, removeUser, accounts);
+        for(int threads : {1, 2, 4}){
+            for(bool compact : {false, true}){
+                UTree bulk;
+                build(bulk);
+                double removeIf = timeIt([&]() {bulk.removeIf(noNitro, compact, threads);});
+                if(bulk.numAccounts() != single.numAccounts()) cout << "  (wrong count: " << bulk.numAccounts() << ")\n";
+                report("removeIf " + std::to_string(threads) + (compact ? "t compact" : "t"), size, removeIf, accounts);
+            }
+        }
+    }
+}
+
+/**
+ * Freezes every DTree through parallelForEachDTree with 1 to 64 threads. DTree sizes are skewed,
+ * the username of rank r holding about 1 / r of the accounts of the largest one.
+ * @param maxSize largest number of accounts
+ */
+void benchPool(int maxSize) {
+    cout << "Pool: freeze every DTree, per account, skewed DTree sizes\n";
+    for(int size = 1000; size <= maxSize; size *= 10){
+        vector<string> names = makeUsernames(size / 10, 15);
+        UTree utree;
+        for(size_t i = 0; i < names.size(); i++){
+            int accounts = std::min<long>(9000, std::max<long>(2, size / (4 * (i + 1))));
+            for(int disc = 0; disc < accounts; disc++) utree.insert(Account(names[i], disc, disc % 2 == 0, "", ""));
+        }
+        double serial = 0;
+        for(int threads : {1, 2, 4, 8, 16, 32, 64}){
+            TaskPool pool(threads);
+            double seconds = timeIt([&]() {utree.parallelForEachDTree([](DTree& dtree) {dtree.freeze();}, pool);});
+            if(threads == 1) serial = seconds;
+            report("freeze " + std::to_string(threads) + "t", utree.numAccounts(), seconds, utree.numAccounts());
+            cout << "  speedup " << std::setprecision(2) << serial / seconds << ", steals " << pool.steals() << "\n";
+        }
+    }
+}
+
+/**
+ * Measures how long clear blocks the caller, against the time the reclaimer takes to free the old
+ * nodes, and reloading a .csv over a full tree against loading it into an empty one.
+ * @param maxSize largest number of accounts
+ */
+void benchTeardown(int maxSize) {
+    cout << "Teardown: clear and reload, per account in the old tree\n";
+    const string path = "bench_teardown.csv";
+    Reclaimer& reclaimer = Reclaimer::global();
+    for(int size = 1000; size <= maxSize; size *= 10){
+        vector<string> names = makeUsernames(size / 4, 16);
+        {
+            std::ofstream csv(path);
+            for(int row = 0; row < size; row++) csv << names[row / 4] << ',' << row % 4 + 1 << ",0,Subscriber,Online\n";
+        }
+        for(UTreeEngine engine : {ENGINE_AVL, ENGINE_BTREE}){
+            string name = engine == ENGINE_AVL ? "avl " : "btree ";
+            UTree utree(engine);
+            utree.loadData(path);
+            double pause = timeIt([&]() {utree.clear();});
+            double freed = timeIt([&]() {reclaimer.drain();});
+            report(name + "clear", size, pause, size);
+            report(name + "reclaim", size, freed, size);
+
+            utree.loadData(path);
+            reclaimer.drain();
+            UTree empty(engine);
+            double load = timeIt([&]() {empty.loadData(path);});
+            double reload = timeIt([&]() {utree.loadData(path, false);});
+            reclaimer.drain();
+            report(name + "load empty", size, load, size);
+            report(name + "reload", size, reload, size);
+        }
+    }
+    std::remove(path.c_str());
+}
+
+/**
+ * Measures the updates both trees run through the shared TreeCore routines: DTree inserts, removals
+ * and refills of vacant nodes, UTree AVL inserts and unlinks of usernames, and dumping both trees.
+ * @param maxSize largest number of accounts
+ */
+void benchCore(int maxSize) {
+    cout << "Tree core: dtree insert, remove, refill, dump, avl insert, unlink, dump\n";
+    for(int size = 1000; size <= maxSize; size *= 10){
+        // Even discriminators only, so that each odd one fits the vacant node of the one below it.
+        // DTrees hold at most (MAX_DISC + 1) / 2 of them, larger sizes use more trees
+        int perTree = std::min(size, (MAX_DISC + 1) / 2);
+        vector<DTree> trees(size / perTree);
+        vector<int> discs(perTree);
+        for(int i = 0; i < perTree; i++) discs[i] = 2 * i;
+        std::shuffle(discs.begin(), discs.end(), rng);
+        double insert = timeIt([&]() {
+            for(DTree& dtree : trees){
+                for(int disc : discs) dtree.insert(Account("core", disc, false, "", ""));
+            }
+        });
+        DNode* removed = nullptr;
+        double remove = timeIt([&]() {
+            for(DTree& dtree : trees){
+                for(int disc : discs) dtree.remove(disc, removed);
+            }
+        });
+        // Every node is vacant. A removed discriminator is still in the tree and cannot come back,
+        // the odd one above it is new. Going down from the largest, each one finds a vacant node
+        // on its path that it fits, so no insert adds a node
+        std::unordered_set<const DNode*> vacant;
+        for(DTree& dtree : trees){
+            for(int disc : discs) vacant.insert(dtree.find(disc));
+        }
+        vector<int> descending(discs);
+        std::sort(descending.rbegin(), descending.rend());
+        long inserted = 0;
+        double refill = timeIt([&]() {
+            for(DTree& dtree : trees){
+                for(int disc : descending) inserted += dtree.insert(Account("core", disc + 1, false, "", ""));
+            }
+        });
+        long refilled = 0;
+        for(DTree& dtree : trees){
+            for(int disc : discs) refilled += vacant.count(dtree.find(disc + 1));
+        }
+        long total = (long) trees.size() * perTree;
+        if(inserted != total || refilled != total){
+            cout << "dtree refill: " << inserted << " of " << total << " inserted, " << refilled << " into a vacant node\n";
+        }
+        std::ostringstream sout;
+        double dtreeDump = timeIt([&]() {
+            for(DTree& dtree : trees) dtree.dump(sout);
+        });
+
+        vector<string> names = makeUsernames(size, 17);
+        UTree utree;
+        double avlInsert = timeIt([&]() {
+            for(const string& name : names) utree.insert(Account(name, 1, false, "", ""));
+        });
+        sout.str("");
+        double avlDump = timeIt([&]() {utree.dump(sout);});
+        double unlink = timeIt([&]() {
+            for(const string& name : names) utree.removeUser(name, 1, removed);
+        });
+        report("dtree insert", size, insert, total);
+        report("dtree remove", size, remove, total);
+        report("dtree refill", size, refill, total);
+        report("dtree dump", size, dtreeDump, total);
+        report("avl insert", size, avlInsert, size);
+        report("avl unlink", size, unlink, size);
+        report("avl dump", size, avlDump, size);
+    }
+}
+
+int main(int argc, char* argv[]) {
+    string benchmark = argc > 1 ? argv[1] : "all";
+    int maxSize = argc > 2 ? std::stoi(argv[2]) : 10000;
+
+    if(benchmark == "engines" || benchmark == "all") benchEngines(maxSize);
+    if(benchmark == "filter" || benchmark == "all") benchFilter(maxSize);
+    if(benchmark == "cache" || benchmark == "all") benchCache(maxSize);
+    if(benchmark == "load" || benchmark == "all") benchLoad(maxSize);
+    if(benchmark == "dtree" || benchmark == "all") benchDTree(maxSize);
+    if(benchmark == "sequential" || benchmark == "all") benchSequential(maxSize);
+    if(benchmark == "avl" || benchmark == "all") benchAVL(maxSize);
+    if(benchmark == "merge" || benchmark == "all") benchMerge(maxSize);
+    if(benchmark == "retention" || benchmark == "all") benchRetention(maxSize);
+    if(benchmark == "pool" || benchmark == "all") benchPool(maxSize);
+    if(benchmark == "teardown" || benchmark == "all") benchTeardown(maxSize);
+    if(benchmark == "snapshot" || benchmark == "all") benchSnapshot(maxSize);
+    if(benchmark == "diff" || benchmark == "all") benchDiff(maxSize);
+    if(benchmark == "scan" || benchmark == "all") benchScan(maxSize);
+    if(benchmark == "rank" || benchmark == "all") benchRank(maxSize);
+    if(benchmark == "bitmap" || benchmark == "all") benchBitmap(maxSize);
+    if(benchmark == "columns" || benchmark == "all") benchColumns(maxSize);
+    if(benchmark == "core" || benchmark == "all") benchCore(maxSize);
+    return 0;
+}
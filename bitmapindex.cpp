@@ -0,0 +1,257 @@
+/**
+ * CMSC 341 - Spring 2021
+ * Project 2 - Binary Trees
+ * BitmapIndex.cpp
+ * Implementation for the RoaringBitmap and AccountBitmaps classes.
+ */
+
+#include "bitmapindex.h"
+#include <algorithm>
+
+/**
+ * Adds a value. A container that grows past ROARING_ARRAY_MAX values becomes a bitset.
+ * @param value value to add
+ * @return true if the value was added, false if it was already there
+ */
+bool RoaringBitmap::add(uint64_t value) {
+    uint64_t high = value >> 16;
+    uint16_t low = value & 0xFFFF;
+    size_t i = lowerBound(high);
+    if(i == _containers.size() || _containers[i].high != high){
+        Container container;
+        container.high = high;
+        container.cardinality = 0;
+        _containers.insert(_containers.begin() + i, std::move(container));
+    }
+    Container& container = _containers[i];
+    if(container.isBitset()){
+        uint64_t& word = container.bits[low / 64];
+        uint64_t bit = 1ULL << (low % 64);
+        if(word & bit) return false;
+        word |= bit;
+    }else{
+        auto at = std::lower_bound(container.array.begin(), container.array.end(), low);
+        if(at != container.array.end() && *at == low) return false;
+        container.array.insert(at, low);
+    }
+    container.cardinality++;
+    _cardinality++;
+    if(!container.isBitset() && container.cardinality > ROARING_ARRAY_MAX) toBitset(container);
+    return true;
+}
+
+/**
+ * Removes a value. A bitset that falls back to ROARING_ARRAY_MAX values becomes an array again,
+ * and an empty container is dropped.
+ * @param value value to remove
+ * @return true if the value was removed, false if it was not there
+ */
+bool RoaringBitmap::remove(uint64_t value) {
+    uint64_t high = value >> 16;
+    uint16_t low = value & 0xFFFF;
+    size_t i = lowerBound(high);
+    if(i == _containers.size() || _containers[i].high != high){
+        return false;
+    }
+    Container& container = _containers[i];
+    if(container.isBitset()){
+        uint64_t& word = container.bits[low / 64];
+        uint64_t bit = 1ULL << (low % 64);
+        if(!(word & bit)) return false;
+        word &= ~bit;
+    }else{
+        auto at = std::lower_bound(container.array.begin(), container.array.end(), low);
+        if(at == container.array.end() || *at != low) return false;
+        container.array.erase(at);
+    }
+    container.cardinality--;
+    _cardinality--;
+    if(container.cardinality == 0){
+        _containers.erase(_containers.begin() + i);
+    }else if(container.isBitset() && container.cardinality <= ROARING_ARRAY_MAX){
+        toArray(container);
+    }
+    return true;
+}
+
+/**
+ * Checks for a value.
+ * @param value value to look for
+ * @return true if the bitmap holds the value
+ */
+bool RoaringBitmap::contains(uint64_t value) const {
+    size_t i = lowerBound(value >> 16);
+    return i < _containers.size() && _containers[i].high == value >> 16 && _containers[i].contains(value & 0xFFFF);
+}
+
+/**
+ * Removes every value.
+ */
+void RoaringBitmap::clear() {
+    _containers.clear();
+    _cardinality = 0;
+}
+
+/**
+ * Counts the values in both bitmaps. Containers are matched by their high halves, so containers
+ * only one side has cost nothing but the comparison.
+ * @param other bitmap to intersect with
+ * @return size of the intersection
+ */
+long RoaringBitmap::andCardinality(const RoaringBitmap& other) const {
+    long count = 0;
+    size_t i = 0, j = 0;
+    while(i < _containers.size() && j < other._containers.size()){
+        if(_containers[i].high < other._containers[j].high){
+            i++;
+        }else if(_containers[i].high > other._containers[j].high){
+            j++;
+        }else{
+            count += andContainers(_containers[i++], other._containers[j++]);
+        }
+    }
+    return count;
+}
+
+/**
+ * Returns the bytes held by the containers.
+ * @return bytes of the container list and of every array and bitset
+ */
+size_t RoaringBitmap::memoryBytes() const {
+    size_t bytes = _containers.capacity() * sizeof(Container);
+    for(const Container& container : _containers){
+        bytes += container.array.capacity() * sizeof(uint16_t) + container.bits.capacity() * sizeof(uint64_t);
+    }
+    return bytes;
+}
+
+// Helper Functions
+
+/**
+ * Checks a container for a low half.
+ * @param low low 16 bits of a value
+ * @return true if the container holds it
+ */
+bool RoaringBitmap::Container::contains(uint16_t low) const {
+    if(isBitset()){
+        return (bits[low / 64] >> (low % 64)) & 1;
+    }
+    return std::binary_search(array.begin(), array.end(), low);
+}
+
+/**
+ * Binary search over the containers.
+ * @param high high 48 bits of a value
+ * @return index of the first container whose high is >= high
+ */
+size_t RoaringBitmap::lowerBound(uint64_t high) const {
+    size_t first = 0, last = _containers.size();
+    while(first < last){
+        size_t middle = (first + last) / 2;
+        if(_containers[middle].high < high){
+            first = middle + 1;
+        }else{
+            last = middle;
+        }
+    }
+    return first;
+}
+
+/**
+ * Turns an array container into a bitset.
+ * @param container container to convert
+ */
+void RoaringBitmap::toBitset(Container& container) {
+    container.bits.assign(ROARING_BITSET_WORDS, 0);
+    for(uint16_t low : container.array) container.bits[low / 64] |= 1ULL << (low % 64);
+    std::vector<uint16_t>().swap(container.array);
+}
+
+/**
+ * Turns a bitset container back into an array.
+ * @param container container to convert
+ */
+void RoaringBitmap::toArray(Container& container) {
+    container.array.reserve(container.cardinality);
+    for(int word = 0; word < ROARING_BITSET_WORDS; word++){
+        for(uint64_t bits = container.bits[word]; bits != 0; bits &= bits - 1){
+            container.array.push_back(word * 64 + __builtin_ctzll(bits));
+        }
+    }
+    std::vector<uint64_t>().swap(container.bits);
+}
+
+/**
+ * Counts the low halves two containers share: a popcount of the anded words for two bitsets,
+ * probes for an array against a bitset, and a merge for two arrays.
+ * @param first container of one bitmap
+ * @param second container of the other bitmap with the same high half
+ * @return number of common values
+ */
+long RoaringBitmap::andContainers(const Container& first, const Container& second) {
+    long count = 0;
+    if(first.isBitset() && second.isBitset()){
+        for(int word = 0; word < ROARING_BITSET_WORDS; word++){
+            count += __builtin_popcountll(first.bits[word] & second.bits[word]);
+        }
+    }else if(first.isBitset() || second.isBitset()){
+        const Container& sparse = first.isBitset() ? second : first;
+        const Container& dense = first.isBitset() ? first : second;
+        for(uint16_t low : sparse.array) count += (dense.bits[low / 64] >> (low % 64)) & 1;
+    }else{
+        size_t i = 0, j = 0;
+        while(i < first.array.size() && j < second.array.size()){
+            if(first.array[i] < second.array[j]){
+                i++;
+            }else if(first.array[i] > second.array[j]){
+                j++;
+            }else{
+                count++;
+                i++;
+                j++;
+            }
+        }
+    }
+    return count;
+}
+
+/**
+ * Adds the key of an account to the nitro bitmap if it has nitro, and to the bitmap of its badge.
+ * @param key discriminator or account id
+ * @param nitro nitro flag of the account
+ * @param badge badge dictionary index of the account
+ */
+void AccountBitmaps::add(uint64_t key, bool nitro, uint8_t badge) {
+    if(nitro) _nitro.add(key);
+    if(badge >= _badges.size()) _badges.resize(badge + 1);
+    _badges[badge].add(key);
+}
+
+/**
+ * Drops the key of an account from the bitmaps add put it in.
+ * @param key discriminator or account id
+ * @param nitro nitro flag of the account
+ * @param badge badge dictionary index of the account
+ */
+void AccountBitmaps::remove(uint64_t key, bool nitro, uint8_t badge) {
+    if(nitro) _nitro.remove(key);
+    if(badge < _badges.size()) _badges[badge].remove(key);
+}
+
+/**
+ * Empties every bitmap.
+ */
+void AccountBitmaps::clear() {
+    _nitro.clear();
+    _badges.clear();
+}
+
+/**
+ * Returns the bytes held by the bitmaps.
+ * @return bytes of the nitro bitmap and of every badge bitmap
+ */
+size_t AccountBitmaps::memoryBytes() const {
+    size_t bytes = _nitro.memoryBytes();
+    for(const RoaringBitmap& bitmap : _badges) bytes += bitmap.memoryBytes();
+    return bytes;
+}
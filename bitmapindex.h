@@ -0,0 +1,154 @@
+/**
+ * CMSC 341 - Spring 2021
+ * Project 2 - Binary Trees
+ * BitmapIndex.h
+ * An interface for the RoaringBitmap and AccountBitmaps classes, compressed bitmaps used as
+ * secondary indexes on the nitro flag and the badge of accounts.
+ */
+
+#pragma once
+
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+#define ROARING_ARRAY_MAX 4096      // A container holding more values switches to a bitset
+#define ROARING_BITSET_WORDS 1024   // 65536 bits, one per low half
+
+/* Set of 64 bit values split into containers by their high 48 bits. A container keeps its low
+ * halves as a sorted array while it is sparse and as a bitset once it is dense, so a bitmap never
+ * costs much more than two bytes per value. */
+class RoaringBitmap {
+    friend class Grader;
+    friend class Tester;
+
+public:
+    RoaringBitmap(): _cardinality(0) {}
+
+    /* Basic operations, add and remove return false when nothing changed */
+
+    bool add(uint64_t value);
+    bool remove(uint64_t value);
+    bool contains(uint64_t value) const;
+    void clear();
+    long cardinality() const {return _cardinality;}
+
+    /* Number of values in both bitmaps, without building the intersection */
+    long andCardinality(const RoaringBitmap& other) const;
+
+    /* Calls visit on every value in increasing order */
+    template<class Visit>
+    void forEach(Visit visit) const;
+
+    /* Calls visit on every value also in other, in increasing order */
+    template<class Visit>
+    void forEachAnd(const RoaringBitmap& other, Visit visit) const;
+
+    /* Bytes used by the containers */
+    size_t memoryBytes() const;
+
+private:
+    struct Container {
+        uint64_t high;
+        int cardinality;
+        std::vector<uint16_t> array;    // Sorted low halves, empty once the container is a bitset
+        std::vector<uint64_t> bits;     // ROARING_BITSET_WORDS words, empty while it is an array
+
+        bool isBitset() const {return !bits.empty();}
+        bool contains(uint16_t low) const;
+    };
+
+    std::vector<Container> _containers;     // Sorted by high
+    long _cardinality;
+
+    // Index of the first container whose high is not less than high
+    size_t lowerBound(uint64_t high) const;
+
+    // Converts a container between its two forms
+    static void toBitset(Container& container);
+    static void toArray(Container& container);
+
+    // Number of low halves in both containers
+    static long andContainers(const Container& first, const Container& second);
+};
+
+/* Nitro and badge bitmaps over account keys. A DTree keys them by discriminator, a UTree by
+ * account id. */
+class AccountBitmaps {
+    friend class Grader;
+    friend class Tester;
+
+public:
+    /* Adds or drops the key of an account in the bitmaps its nitro flag and badge select */
+    void add(uint64_t key, bool nitro, uint8_t badge);
+    void remove(uint64_t key, bool nitro, uint8_t badge);
+    void clear();
+
+    const RoaringBitmap& nitro() const {return _nitro;}
+    const RoaringBitmap& badge(uint8_t badge) const {return badge < _badges.size() ? _badges[badge] : _empty;}
+
+    /* Bytes used by every bitmap */
+    size_t memoryBytes() const;
+
+private:
+    RoaringBitmap _nitro;
+    std::vector<RoaringBitmap> _badges;     // By badge dictionary index, grown on demand
+    RoaringBitmap _empty;                   // Answers badges no account has yet
+};
+
+/**
+ * Calls visit on every value in increasing order. Bitsets are walked a word at a time, skipping
+ * empty words.
+ * @param visit function called with each value
+ */
+template<class Visit>
+void RoaringBitmap::forEach(Visit visit) const {
+    for(const Container& container : _containers){
+        uint64_t base = container.high << 16;
+        if(!container.isBitset()){
+            for(uint16_t low : container.array) visit(base | low);
+            continue;
+        }
+        for(int word = 0; word < ROARING_BITSET_WORDS; word++){
+            for(uint64_t bits = container.bits[word]; bits != 0; bits &= bits - 1){
+                visit(base | (word * 64 + __builtin_ctzll(bits)));
+            }
+        }
+    }
+}
+
+/**
+ * Calls visit on every value in both bitmaps in increasing order, containers only one side has
+ * are skipped whole.
+ * @param other bitmap to intersect with
+ * @param visit function called with each common value
+ */
+template<class Visit>
+void RoaringBitmap::forEachAnd(const RoaringBitmap& other, Visit visit) const {
+    size_t i = 0, j = 0;
+    while(i < _containers.size() && j < other._containers.size()){
+        const Container& first = _containers[i];
+        const Container& second = other._containers[j];
+        if(first.high != second.high){
+            first.high < second.high ? i++ : j++;
+            continue;
+        }
+        uint64_t base = first.high << 16;
+        if(first.isBitset() && second.isBitset()){
+            for(int word = 0; word < ROARING_BITSET_WORDS; word++){
+                for(uint64_t bits = first.bits[word] & second.bits[word]; bits != 0; bits &= bits - 1){
+                    visit(base | (word * 64 + __builtin_ctzll(bits)));
+                }
+            }
+        }else{
+            // The array side drives, the other side is probed
+            const Container& sparse = first.isBitset() ? second : first;
+            const Container& probed = first.isBitset() ? first : second;
+            for(uint16_t low : sparse.array){
+                if(probed.contains(low)) visit(base | low);
+            }
+        }
+        i++;
+        j++;
+    }
+}
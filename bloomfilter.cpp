@@ -0,0 +1,115 @@
+/**
+ * CMSC 341 - Spring 2021
+ * Project 2 - Binary Trees
+ * BloomFilter.cpp
+ * Implementation for the CountingBloomFilter class.
+ */
+
+#include "bloomfilter.h"
+#include <cmath>
+#include <functional>
+#include <stdexcept>
+
+/**
+ * Sizes the filter for a number of items and a target false positive rate.
+ * @param expectedItems number of items the rate is computed for
+ * @param falsePositiveRate chance that mayContain is true for an item never added
+ */
+CountingBloomFilter::CountingBloomFilter(size_t expectedItems, double falsePositiveRate) {
+    if(falsePositiveRate <= 0 || falsePositiveRate >= 1){
+        throw std::invalid_argument("False positive rate must be between 0 and 1");
+    }
+    _expected = expectedItems > 0 ? expectedItems : 1;
+    _rate = falsePositiveRate;
+
+    // Optimal counters per item and number of hashes, rounded up to whole blocks. Keeping every
+    // counter of an item in one block loads some blocks more than others, so the size is computed
+    // for a rate BLOOM_BLOCK_PENALTY times lower to land on the requested one
+    double perItem = -std::log(falsePositiveRate / BLOOM_BLOCK_PENALTY) / (std::log(2.0) * std::log(2.0));
+    _hashes = (int) std::round(perItem * std::log(2.0));
+    if(_hashes < 1) _hashes = 1;
+    size_t countersPerBlock = BLOOM_BLOCK_WORDS * 64 / BLOOM_COUNTER_BITS;
+    _blocks = (size_t) std::ceil(perItem * _expected / countersPerBlock);
+    if(_blocks < 1) _blocks = 1;
+    _words = new uint64_t[_blocks * BLOOM_BLOCK_WORDS]();
+}
+
+/**
+ * Destructor, deletes the counters.
+ */
+CountingBloomFilter::~CountingBloomFilter() {
+    delete[] _words;
+}
+
+/**
+ * Adds an item, every one of its counters is incremented.
+ * @param item item to add
+ */
+void CountingBloomFilter::add(const string& item) {
+    forEachCounter(item, [](uint64_t& word, int shift) {
+        if(((word >> shift) & BLOOM_COUNTER_MAX) != BLOOM_COUNTER_MAX){
+            word += (uint64_t) 1 << shift;
+        }
+    });
+}
+
+/**
+ * Removes an item that was added before, every one of its counters is decremented.
+ * @param item item to remove
+ */
+void CountingBloomFilter::remove(const string& item) {
+    forEachCounter(item, [](uint64_t& word, int shift) {
+        uint64_t counter = (word >> shift) & BLOOM_COUNTER_MAX;
+        if(counter != 0 && counter != BLOOM_COUNTER_MAX){
+            word -= (uint64_t) 1 << shift;
+        }
+    });
+}
+
+/**
+ * Checks an item. A false answer is always right, a true answer is wrong at about the configured rate.
+ * @param item item to check
+ * @return false if the item was certainly never added
+ */
+bool CountingBloomFilter::mayContain(const string& item) const {
+    bool present = true;
+    forEachCounter(item, [&](uint64_t& word, int shift) {
+        if(((word >> shift) & BLOOM_COUNTER_MAX) == 0) present = false;
+    });
+    return present;
+}
+
+/**
+ * Resets every counter.
+ */
+void CountingBloomFilter::clear() {
+    for(size_t i = 0; i < _blocks * BLOOM_BLOCK_WORDS; i++){
+        _words[i] = 0;
+    }
+}
+
+// Helper Functions
+
+/**
+ * Finds the counters of an item. The high half of the hash picks a block, the counters inside it
+ * come from double hashing with the low half, so a check touches a single block.
+ * @param item item to hash
+ * @param visit function called with the word holding a counter and the counter's bit offset
+ */
+template<class Visit>
+void CountingBloomFilter::forEachCounter(const string& item, Visit visit) const {
+    uint64_t hash = std::hash<string>()(item);
+    // Mix so both halves depend on every input bit
+    hash ^= hash >> 33;
+    hash *= 0xff51afd7ed558ccdULL;
+    hash ^= hash >> 33;
+
+    uint64_t* block = _words + ((hash >> 32) % _blocks) * BLOOM_BLOCK_WORDS;
+    uint32_t first = (uint32_t) hash;
+    uint32_t step = (first >> 16) | 1;
+    const uint32_t counters = BLOOM_BLOCK_WORDS * 64 / BLOOM_COUNTER_BITS;
+    for(int i = 0; i < _hashes; i++){
+        uint32_t counter = (first + i * step) % counters;
+        visit(block[counter / 16], (int) (counter % 16) * BLOOM_COUNTER_BITS);
+    }
+}
@@ -0,0 +1,52 @@
+/**
+ * CMSC 341 - Spring 2021
+ * Project 2 - Binary Trees
+ * BloomFilter.h
+ * An interface for the CountingBloomFilter class, a filter that answers most username misses
+ * without touching the UTree.
+ */
+
+#pragma once
+
+#include <string>
+#include <cstdint>
+#include <cstddef>
+
+using std::string;
+
+#define BLOOM_DEFAULT_RATE 0.01
+#define BLOOM_BLOCK_WORDS 16        // Two 64 byte cache lines per block
+#define BLOOM_COUNTER_BITS 4
+#define BLOOM_COUNTER_MAX 15        // A saturated counter is never decremented again
+#define BLOOM_BLOCK_PENALTY 2.5     // Blocked filters miss their target rate by about this factor
+
+class CountingBloomFilter {
+    friend class Grader;
+    friend class Tester;
+
+public:
+    CountingBloomFilter(size_t expectedItems, double falsePositiveRate = BLOOM_DEFAULT_RATE);
+    ~CountingBloomFilter();
+
+    /* Basic operations */
+
+    void add(const string& item);
+    void remove(const string& item);
+    bool mayContain(const string& item) const;
+    void clear();
+
+    size_t expectedItems() const {return _expected;}
+    double falsePositiveRate() const {return _rate;}
+    size_t memoryBytes() const {return _blocks * BLOOM_BLOCK_WORDS * sizeof(uint64_t);}
+
+private:
+    uint64_t* _words;   // 4 bit counters, 16 per word, BLOOM_BLOCK_WORDS words per block
+    size_t _blocks;
+    int _hashes;        // Counters touched per item
+    size_t _expected;
+    double _rate;
+
+    // Calls visit with the word and shift of every counter of an item, all inside one block
+    template<class Visit>
+    void forEachCounter(const string& item, Visit visit) const;
+};
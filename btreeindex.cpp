@@ -0,0 +1,442 @@
+/**
+ * CMSC 341 - Spring 2021
+ * Project 2 - Binary Trees
+ * BTreeIndex.cpp
+ * Implementation for the BTreeIndex class.
+ */
+
+#include "btreeindex.h"
+
+/**
+ * Creates an empty index, the root is always an existing (possibly empty) leaf.
+ */
+BTreeIndex::BTreeIndex() {
+    _root = new BTreeNode(true);
+    _size = 0;
+    _height = 1;
+}
+
+/**
+ * Destructor, deletes every node. The UNodes are owned by the UTree and are not deleted.
+ */
+BTreeIndex::~BTreeIndex() {
+    AssistClear(_root);
+}
+
+/**
+ * Inserts a username that is not in the index yet.
+ * @param username key to insert
+ * @param node UNode stored for the username
+ * @return true if the username was inserted, false if it already existed
+ */
+bool BTreeIndex::insert(const string& username, UNode* node) {
+    BTreeNode* split = nullptr;
+    string separator;
+    if(!AssistInsert(_root, username, node, split, separator)){
+        return false;
+    }
+    // The root split, the tree grows by one level
+    if(split != nullptr){
+        BTreeNode* root = new BTreeNode(false);
+        fitPrefix(root, separator);
+        setKey(root, 0, separator);
+        root->count = 1;
+        root->children[0] = _root;
+        root->children[1] = split;
+        _root = root;
+        _height++;
+    }
+    _size++;
+    return true;
+}
+
+/**
+ * Finds the UNode stored for a username.
+ * @param username key to search for
+ * @return the UNode, nullptr if the username is not in the index
+ */
+UNode* BTreeIndex::find(const string& username) const {
+    BTreeNode* leaf = findLeaf(username);
+    int i = position(leaf, username, false);
+    if(equalKey(leaf, i, username)){
+        return leaf->values[i];
+    }
+    return nullptr;
+}
+
+/**
+ * Removes a username. Leaves are allowed to underflow, separators stay valid because every
+ * remaining key is still inside the range of its leaf.
+ * @param username key to remove
+ * @return true if the username was removed, false if it was not in the index
+ */
+bool BTreeIndex::erase(const string& username) {
+    BTreeNode* leaf = findLeaf(username);
+    int i = position(leaf, username, false);
+    if(!equalKey(leaf, i, username)){
+        return false;
+    }
+    for(int j = i; j < leaf->count - 1; j++){
+        leaf->heads[j] = leaf->heads[j + 1];
+        leaf->suffixes[j].swap(leaf->suffixes[j + 1]);
+        leaf->values[j] = leaf->values[j + 1];
+    }
+    leaf->count--;
+    leaf->suffixes[leaf->count].clear();
+    _size--;
+    return true;
+}
+
+/**
+ * Removes every key, the index is left with a single empty leaf.
+ */
+void BTreeIndex::clear() {
+    AssistClear(_root);
+    _root = new BTreeNode(true);
+    _size = 0;
+    _height = 1;
+}
+
+/**
+ * Visits every UNode in username order by following the leaf chain.
+ * @param visit function called once per UNode
+ */
+void BTreeIndex::forEach(const std::function<void(UNode*)>& visit) const {
+    BTreeNode* leaf = _root;
+    while(!leaf->leaf) leaf = leaf->children[0];
+    for(; leaf != nullptr; leaf = leaf->next){
+        for(int i = 0; i < leaf->count; i++){
+            visit(leaf->values[i]);
+        }
+    }
+}
+
+/**
+ * Visits UNodes in username order from the first username that is not less than key.
+ * @param key lower bound of the scan
+ * @param visit function called per UNode, returning false ends the scan
+ */
+void BTreeIndex::scanFrom(const string& key, const std::function<bool(UNode*)>& visit) const {
+    BTreeNode* leaf = findLeaf(key);
+    for(int i = position(leaf, key, false); leaf != nullptr; leaf = leaf->next, i = 0){
+        for(; i < leaf->count; i++){
+            if(!visit(leaf->values[i])) return;
+        }
+    }
+}
+
+/**
+ * Returns a cursor on the smallest username.
+ * @return cursor on the first entry, past the end if the index is empty
+ */
+BTreeCursor BTreeIndex::first() const {
+    const BTreeNode* node = _root;
+    while(!node->leaf) node = node->children[0];
+    BTreeCursor cursor = {node, 0};
+    settle(cursor);
+    return cursor;
+}
+
+/**
+ * Returns a cursor on the first username >= key in O(log n).
+ * @param key username to search for
+ * @return cursor on the first entry not less than key, past the end if there is none
+ */
+BTreeCursor BTreeIndex::seek(const string& key) const {
+    BTreeNode* leaf = findLeaf(key);
+    BTreeCursor cursor = {leaf, position(leaf, key, false)};
+    settle(cursor);
+    return cursor;
+}
+
+/**
+ * Moves a cursor to the next username.
+ * @param cursor cursor on an entry
+ */
+void BTreeIndex::advance(BTreeCursor& cursor) {
+    cursor.slot++;
+    settle(cursor);
+}
+
+// Helper Functions
+
+/**
+ * Moves a cursor past the end of a leaf to the first entry of the next non-empty leaf, erased
+ * entries can leave leaves empty.
+ * @param cursor cursor to fix, left alone if it is on an entry
+ */
+void BTreeIndex::settle(BTreeCursor& cursor) {
+    while(cursor.leaf != nullptr && cursor.slot >= cursor.leaf->count){
+        cursor.leaf = cursor.leaf->next;
+        cursor.slot = 0;
+    }
+}
+
+/**
+ * Recursive insert. A full node is split before the new entry is placed, the new right sibling
+ * and the separator to insert into the parent are passed back through split and separator.
+ * @param node root of the subtree
+ * @param key username to insert
+ * @param value UNode to store
+ * @param split set to the new right sibling when node split, nullptr otherwise
+ * @param separator set to the smallest key reachable through split
+ * @return true if the key was inserted, false if it already existed
+ */
+bool BTreeIndex::AssistInsert(BTreeNode* node, const string& key, UNode* value, BTreeNode*& split,
+                              string& separator) {
+    split = nullptr;
+    if(node->leaf){
+        int i = position(node, key, false);
+        if(equalKey(node, i, key)){
+            return false;
+        }
+
+        BTreeNode* target = node;
+        if(node->count == BTREE_FANOUT){
+            // Split the full leaf in half, the right half starts with the separator
+            int mid = BTREE_FANOUT / 2;
+            split = new BTreeNode(true);
+            separator = node->key(mid);
+            moveTail(node, split, mid);
+            split->next = node->next;
+            node->next = split;
+            recompress(node);
+            recompress(split);
+            if(i > mid){
+                target = split;
+                i -= mid;
+            }
+        }
+
+        fitPrefix(target, key);
+        for(int j = target->count; j > i; j--){
+            target->heads[j] = target->heads[j - 1];
+            target->suffixes[j].swap(target->suffixes[j - 1]);
+            target->values[j] = target->values[j - 1];
+        }
+        setKey(target, i, key);
+        target->values[i] = value;
+        target->count++;
+        return true;
+    }
+
+    // Internal node, keys equal to a separator live to its right
+    int i = position(node, key, true);
+    BTreeNode* childSplit;
+    string childSeparator;
+    if(!AssistInsert(node->children[i], key, value, childSplit, childSeparator)){
+        return false;
+    }
+    if(childSplit == nullptr){
+        return true;
+    }
+
+    BTreeNode* target = node;
+    if(node->count == BTREE_FANOUT){
+        // Split the full internal node, the middle key moves up to the parent
+        int mid = BTREE_FANOUT / 2;
+        split = new BTreeNode(false);
+        separator = node->key(mid);
+        moveTail(node, split, mid + 1);
+        node->count = mid;
+        node->suffixes[mid].clear();
+        recompress(node);
+        recompress(split);
+        if(i > mid){
+            target = split;
+            i -= mid + 1;
+        }
+    }
+
+    fitPrefix(target, childSeparator);
+    for(int j = target->count; j > i; j--){
+        target->heads[j] = target->heads[j - 1];
+        target->suffixes[j].swap(target->suffixes[j - 1]);
+        target->children[j + 1] = target->children[j];
+    }
+    setKey(target, i, childSeparator);
+    target->children[i + 1] = childSplit;
+    target->count++;
+    return true;
+}
+
+/**
+ * Deletes every node of a subtree.
+ * @param node root of the subtree
+ */
+void BTreeIndex::AssistClear(BTreeNode* node) {
+    if(!node->leaf){
+        for(int i = 0; i <= node->count; i++){
+            AssistClear(node->children[i]);
+        }
+    }
+    delete node;
+}
+
+/**
+ * Descends from the root to the leaf whose range contains key.
+ * @param key username to search for
+ * @return the leaf
+ */
+BTreeNode* BTreeIndex::findLeaf(const string& key) const {
+    BTreeNode* node = _root;
+    while(!node->leaf){
+        node = node->children[position(node, key, true)];
+    }
+    return node;
+}
+
+/**
+ * Counts the keys of a node that are less than key, or less than or equal to key when upper is set.
+ * A key that does not start with the node's prefix is ordered against every key at once.
+ * @param node node to search
+ * @param key username to place
+ * @param upper true to also count keys equal to key
+ * @return number of keys before key's position
+ */
+int BTreeIndex::position(const BTreeNode* node, const string& key, bool upper) {
+    size_t prefixLength = node->prefix.size();
+    int order = key.compare(0, prefixLength, node->prefix);
+    if(order != 0){
+        return order < 0 ? 0 : node->count;
+    }
+
+    uint32_t head = makeHead(key, prefixLength);
+    int i = 0;
+    while(i < node->count){
+        int result = compareKey(node, i, key, head);
+        if(result < 0 || (result == 0 && !upper)) break;
+        i++;
+    }
+    return i;
+}
+
+/**
+ * Compares key against key i of the node. The heads are compared first, the suffix strings only
+ * when the first four bytes match. The caller has checked that key starts with the node's prefix.
+ * @param node node holding the stored key
+ * @param i position of the stored key
+ * @param key username to compare
+ * @param head head of key at the node's prefix length
+ * @return negative if key is less, zero if equal, positive if greater
+ */
+int BTreeIndex::compareKey(const BTreeNode* node, int i, const string& key, uint32_t head) {
+    if(head != node->heads[i]){
+        return head < node->heads[i] ? -1 : 1;
+    }
+    return key.compare(node->prefix.size(), string::npos, node->suffixes[i]);
+}
+
+/**
+ * Checks whether key i of the node is exactly key.
+ * @param node node holding the stored key
+ * @param i position of the stored key, may be past the last key
+ * @param key username to compare
+ * @return true if the stored key equals key
+ */
+bool BTreeIndex::equalKey(const BTreeNode* node, int i, const string& key) {
+    size_t prefixLength = node->prefix.size();
+    return i < node->count && key.compare(0, prefixLength, node->prefix) == 0
+           && compareKey(node, i, key, makeHead(key, prefixLength)) == 0;
+}
+
+/**
+ * Packs up to four bytes of text into an unsigned int so that integer order matches string order.
+ * @param text source string
+ * @param offset first byte to pack
+ * @return the packed head, missing bytes are zero
+ */
+uint32_t BTreeIndex::makeHead(const string& text, size_t offset) {
+    uint32_t head = 0;
+    for(size_t i = 0; i < 4; i++){
+        head <<= 8;
+        if(offset + i < text.size()) head |= (unsigned char) text[offset + i];
+    }
+    return head;
+}
+
+/**
+ * Stores key at position i of the node.
+ * @param node node to write
+ * @param i position to write
+ * @param key full key, it must start with the node's prefix
+ */
+void BTreeIndex::setKey(BTreeNode* node, int i, const string& key) {
+    node->suffixes[i].assign(key, node->prefix.size(), string::npos);
+    node->heads[i] = makeHead(key, node->prefix.size());
+}
+
+/**
+ * Shrinks the node's prefix until key starts with it, the removed bytes move into every suffix.
+ * An empty node simply takes key as its prefix.
+ * @param node node to adjust
+ * @param key key about to be stored in the node
+ */
+void BTreeIndex::fitPrefix(BTreeNode* node, const string& key) {
+    if(node->count == 0){
+        node->prefix = key;
+        return;
+    }
+    size_t length = 0;
+    while(length < node->prefix.size() && length < key.size() && node->prefix[length] == key[length]){
+        length++;
+    }
+    if(length == node->prefix.size()) return;
+
+    string moved = node->prefix.substr(length);
+    node->prefix.resize(length);
+    for(int i = 0; i < node->count; i++){
+        node->suffixes[i].insert(0, moved);
+        node->heads[i] = makeHead(node->suffixes[i], 0);
+    }
+}
+
+/**
+ * Grows the node's prefix to the longest prefix shared by every key, used after a split.
+ * @param node node to adjust
+ */
+void BTreeIndex::recompress(BTreeNode* node) {
+    if(node->count == 0) return;
+    size_t length = node->suffixes[0].size();
+    for(int i = 1; i < node->count && length > 0; i++){
+        size_t common = 0;
+        const string& suffix = node->suffixes[i];
+        while(common < length && common < suffix.size() && suffix[common] == node->suffixes[0][common]){
+            common++;
+        }
+        length = common;
+    }
+    if(length == 0) return;
+
+    node->prefix += node->suffixes[0].substr(0, length);
+    for(int i = 0; i < node->count; i++){
+        node->suffixes[i].erase(0, length);
+        node->heads[i] = makeHead(node->suffixes[i], 0);
+    }
+}
+
+/**
+ * Moves the keys [from, count) of a node into an empty sibling. Leaves move their values, internal
+ * nodes move the children to the right of each moved key.
+ * @param node node losing its tail
+ * @param sibling empty node of the same kind
+ * @param from first position to move
+ */
+void BTreeIndex::moveTail(BTreeNode* node, BTreeNode* sibling, int from) {
+    sibling->prefix = node->prefix;
+    int count = 0;
+    if(!node->leaf){
+        sibling->children[0] = node->children[from];
+    }
+    for(int i = from; i < node->count; i++, count++){
+        sibling->heads[count] = node->heads[i];
+        sibling->suffixes[count].swap(node->suffixes[i]);
+        if(node->leaf){
+            sibling->values[count] = node->values[i];
+        }else{
+            sibling->children[count + 1] = node->children[i + 1];
+        }
+    }
+    sibling->count = count;
+    node->count = from;
+}
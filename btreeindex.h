@@ -0,0 +1,113 @@
+/**
+ * CMSC 341 - Spring 2021
+ * Project 2 - Binary Trees
+ * BTreeIndex.h
+ * An interface for the BTreeIndex class, a B+ tree from username to UNode used as a UTree engine.
+ */
+
+#pragma once
+
+#include <string>
+#include <cstdint>
+#include <functional>
+
+using std::string;
+
+#define BTREE_FANOUT 16     // Keys per node, the key heads of a node fill one 64 byte cache line
+
+class UNode;
+
+/* A B+ tree node. Every key is stored as the node's common prefix plus a suffix, and the first
+ * four suffix bytes are packed into heads so most comparisons never touch the strings. */
+struct BTreeNode {
+    bool leaf;
+    int count;
+    uint32_t heads[BTREE_FANOUT];
+    string prefix;
+    string suffixes[BTREE_FANOUT];
+    UNode* values[BTREE_FANOUT];            // Leaves only
+    BTreeNode* children[BTREE_FANOUT + 1];  // Internal nodes only, children[i] holds keys < key i
+    BTreeNode* next;                        // Leaves only, the next leaf in key order
+
+    BTreeNode(bool isLeaf): leaf(isLeaf), count(0), next(nullptr) {}
+    string key(int i) const {return prefix + suffixes[i];}
+};
+
+/* Position of one entry in the leaf chain, leaf is nullptr past the last username */
+struct BTreeCursor {
+    const BTreeNode* leaf;
+    int slot;
+
+    UNode* value() const {return leaf->values[slot];}
+    bool operator==(const BTreeCursor& other) const {return leaf == other.leaf && (leaf == nullptr || slot == other.slot);}
+};
+
+class BTreeIndex {
+    friend class Grader;
+    friend class Tester;
+
+public:
+    BTreeIndex();
+    ~BTreeIndex();
+
+    /* Basic operations */
+
+    bool insert(const string& username, UNode* node);
+    UNode* find(const string& username) const;
+    bool erase(const string& username);
+    void clear();
+    int size() const {return _size;}
+    int height() const {return _height;}
+
+    /* Visits every UNode in username order */
+    void forEach(const std::function<void(UNode*)>& visit) const;
+
+    /* Visits UNodes in username order starting at the first username >= key, until visit returns false */
+    void scanFrom(const string& key, const std::function<bool(UNode*)>& visit) const;
+
+    /* Cursors for walks that cannot use a callback, they are invalidated by inserts and erases */
+    BTreeCursor first() const;
+    BTreeCursor seek(const string& key) const;
+    static void advance(BTreeCursor& cursor);
+
+private:
+    BTreeNode* _root;
+    int _size;
+    int _height;
+
+    // Recursive insert, fills split/separator when the child had to split
+    bool AssistInsert(BTreeNode* node, const string& key, UNode* value, BTreeNode*& split, string& separator);
+
+    // Moves a cursor off the end of its leaf onto the next entry of the chain
+    static void settle(BTreeCursor& cursor);
+
+    // Recursive deletion of every node
+    void AssistClear(BTreeNode* node);
+
+    // Finds the leaf that could hold key
+    BTreeNode* findLeaf(const string& key) const;
+
+    // Number of keys in the node that are less than key (upper selects <= instead)
+    static int position(const BTreeNode* node, const string& key, bool upper);
+
+    // Compares key against key i of node, negative, zero or positive like string::compare
+    static int compareKey(const BTreeNode* node, int i, const string& key, uint32_t head);
+
+    // True if key i of node is exactly key
+    static bool equalKey(const BTreeNode* node, int i, const string& key);
+
+    // Packs up to four bytes starting at offset into a big-endian head
+    static uint32_t makeHead(const string& text, size_t offset);
+
+    // Stores key at position i, the prefix must already be a prefix of key
+    static void setKey(BTreeNode* node, int i, const string& key);
+
+    // Shrinks the node's prefix until it is a prefix of key
+    static void fitPrefix(BTreeNode* node, const string& key);
+
+    // Recomputes the longest prefix shared by every key in the node
+    static void recompress(BTreeNode* node);
+
+    // Moves entries [from, count) from one node to an empty sibling
+    static void moveTail(BTreeNode* node, BTreeNode* sibling, int from);
+};
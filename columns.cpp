@@ -0,0 +1,219 @@
+/**
+ * CMSC 341 - Spring 2021
+ * Project 2 - Binary Trees
+ * AccountColumns.cpp
+ * Implementation for the AccountColumns class.
+ */
+
+#include "columns.h"
+#include <algorithm>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+/**
+ * Copies a UTree into columns, whatever its engine.
+ * @param utree tree to copy, it must not change while it is copied
+ */
+AccountColumns::AccountColumns(const UTree& utree) : AccountColumns() {
+    for(const UNode& node : utree) append(node);
+    finish();
+}
+
+/**
+ * Copies a snapshot into columns, the tree it was taken from may keep changing meanwhile.
+ * @param snapshot version to copy
+ */
+AccountColumns::AccountColumns(const UTreeSnapshot& snapshot) : AccountColumns() {
+    snapshot.forEachNode([&](const UNode* node) {append(*node);});
+    finish();
+}
+
+/**
+ * Returns the status of a row.
+ * @param row row index
+ * @return view into the status column
+ */
+std::string_view AccountColumns::getStatus(size_t row) const {
+    return std::string_view(_statuses).substr(_statusOffsets[row], _statusOffsets[row + 1] - _statusOffsets[row]);
+}
+
+/**
+ * Returns a username.
+ * @param i username index, in username order
+ * @return view into the username column
+ */
+std::string_view AccountColumns::getUsername(size_t i) const {
+    return std::string_view(_usernames).substr(_usernameOffsets[i], _usernameOffsets[i + 1] - _usernameOffsets[i]);
+}
+
+/**
+ * Finds the rows of a username range.
+ * @param from smallest username included
+ * @param to first username excluded
+ * @return first and last (excluded) row of the range
+ */
+std::pair<size_t, size_t> AccountColumns::rowRange(const string& from, const string& to) const {
+    // Binary search for the first username >= key
+    auto position = [&](const string& key) {
+        size_t first = 0, last = numUsernames();
+        while(first < last){
+            size_t middle = (first + last) / 2;
+            if(getUsername(middle) < key){
+                first = middle + 1;
+            }else{
+                last = middle;
+            }
+        }
+        return first;
+    };
+    size_t first = _firstRows[position(from)];
+    return {first, std::max(first, (size_t) _firstRows[position(to)])};
+}
+
+/**
+ * Counts the rows with nitro, a popcount per 64 rows.
+ * @param first first row
+ * @param last row after the last one
+ * @return number of rows with nitro
+ */
+long AccountColumns::countNitro(size_t first, size_t last) const {
+    if(first >= last){
+        return 0;
+    }
+    size_t firstWord = first / 64, lastWord = (last - 1) / 64;
+    uint64_t headMask = ~0ULL << (first % 64);
+    uint64_t tailMask = ~0ULL >> (63 - (last - 1) % 64);
+    if(firstWord == lastWord){
+        return __builtin_popcountll(_nitro[firstWord] & headMask & tailMask);
+    }
+    long count = __builtin_popcountll(_nitro[firstWord] & headMask) + __builtin_popcountll(_nitro[lastWord] & tailMask);
+    for(size_t word = firstWord + 1; word < lastWord; word++){
+        count += __builtin_popcountll(_nitro[word]);
+    }
+    return count;
+}
+
+/**
+ * Counts the rows with a badge by comparing 16 badge indexes at a time.
+ * @param badge badge to match
+ * @param first first row
+ * @param last row after the last one
+ * @return number of rows with the badge
+ */
+long AccountColumns::countBadge(const string& badge, size_t first, size_t last) const {
+    int index = Account::findBadge(badge);
+    if(index < 0 || first >= last){
+        return 0;
+    }
+    const uint8_t* badges = _badges.data();
+    long count = 0;
+    size_t row = first;
+#ifdef __SSE2__
+    __m128i wanted = _mm_set1_epi8((char) index);
+    for(; row + 16 <= last; row += 16){
+        __m128i matches = _mm_cmpeq_epi8(wanted, _mm_loadu_si128((const __m128i*) (badges + row)));
+        count += __builtin_popcount(_mm_movemask_epi8(matches));
+    }
+#endif
+    for(; row < last; row++){
+        count += badges[row] == index;
+    }
+    return count;
+}
+
+/**
+ * Builds a histogram of the discriminators. Bins split [MIN_DISC, MAX_DISC] evenly and a bin is
+ * found with a multiply and a shift. Neighbouring rows land in COLUMN_HISTOGRAM_LANES separate
+ * partial histograms, so repeated discriminators do not wait on each other's increments.
+ * @param bins number of bins, 1 to MAX_DISC + 1
+ * @param first first row
+ * @param last row after the last one
+ * @return count of rows per bin
+ */
+std::vector<long> AccountColumns::discHistogram(int bins, size_t first, size_t last) const {
+    if(bins < 1 || bins > MAX_DISC + 1){
+        throw std::out_of_range("Histogram needs 1 to " + std::to_string(MAX_DISC + 1) + " bins");
+    }
+    // Rounded up so that (disc * scale) >> 32 equals disc * bins / (MAX_DISC + 1) for every disc
+    uint64_t scale = (((uint64_t) bins << 32) + MAX_DISC) / (MAX_DISC + 1);
+    std::vector<uint32_t> lanes((size_t) bins * COLUMN_HISTOGRAM_LANES, 0);
+    const uint16_t* discs = _discs.data();
+    size_t row = first;
+    for(; row + COLUMN_HISTOGRAM_LANES <= last; row += COLUMN_HISTOGRAM_LANES){
+        for(int lane = 0; lane < COLUMN_HISTOGRAM_LANES; lane++){
+            lanes[lane * bins + ((discs[row + lane] * scale) >> 32)]++;
+        }
+    }
+    for(; row < last; row++){
+        lanes[(discs[row] * scale) >> 32]++;
+    }
+    std::vector<long> histogram(bins, 0);
+    for(int lane = 0; lane < COLUMN_HISTOGRAM_LANES; lane++){
+        for(int bin = 0; bin < bins; bin++) histogram[bin] += lanes[lane * bins + bin];
+    }
+    return histogram;
+}
+
+/**
+ * Returns the nitro ratio of a username range.
+ * @param from smallest username included
+ * @param to first username excluded
+ * @return accounts with nitro over accounts, 0 for an empty range
+ */
+double AccountColumns::nitroRatio(const string& from, const string& to) const {
+    std::pair<size_t, size_t> rows = rowRange(from, to);
+    if(rows.first == rows.second){
+        return 0;
+    }
+    return (double) countNitro(rows.first, rows.second) / (rows.second - rows.first);
+}
+
+/**
+ * Returns the bytes held by the columns.
+ * @return bytes of every column and text buffer
+ */
+size_t AccountColumns::memoryBytes() const {
+    return _discs.capacity() * sizeof(uint16_t) + _nitro.capacity() * sizeof(uint64_t) + _badges.capacity()
+           + _statuses.capacity() + _statusOffsets.capacity() * sizeof(uint64_t) + _usernames.capacity()
+           + _usernameOffsets.capacity() * sizeof(uint32_t) + _firstRows.capacity() * sizeof(uint32_t);
+}
+
+// Helper Functions
+
+/**
+ * Appends one row per non-vacant account of a UNode.
+ * @param node UNode to copy
+ */
+void AccountColumns::append(const UNode& node) {
+    size_t rows = numRows();
+    for(const Account& acct : node){
+        size_t row = numRows();
+        if(row % 64 == 0) _nitro.push_back(0);
+        if(acct._nitro) _nitro[row / 64] |= 1ULL << (row % 64);
+        _discs.push_back(acct._disc);
+        _badges.push_back(acct._badge);
+        _statuses.append(acct.getStatusView());
+        _statusOffsets.push_back(_statuses.size());
+    }
+    if(numRows() == rows){
+        return;
+    }
+    _usernames.append(node.getUsername());
+    _usernameOffsets.push_back(_usernames.size());
+    _firstRows.push_back(numRows());
+}
+
+/**
+ * Drops the spare capacity of every column, they no longer grow.
+ */
+void AccountColumns::finish() {
+    _discs.shrink_to_fit();
+    _nitro.shrink_to_fit();
+    _badges.shrink_to_fit();
+    _statuses.shrink_to_fit();
+    _statusOffsets.shrink_to_fit();
+    _usernames.shrink_to_fit();
+    _usernameOffsets.shrink_to_fit();
+    _firstRows.shrink_to_fit();
+}
@@ -0,0 +1,74 @@
+/**
+ * CMSC 341 - Spring 2021
+ * Project 2 - Binary Trees
+ * AccountColumns.h
+ * An interface for the AccountColumns class, a column-per-field copy of every account for analytics.
+ */
+
+#pragma once
+
+#include "utree.h"
+#include "snapshot.h"
+#include <vector>
+#include <string_view>
+#include <utility>
+
+#define COLUMN_HISTOGRAM_LANES 4    // Partial histograms a kernel fills at once, summed at the end
+
+class AccountColumns {
+    friend class Grader;
+    friend class Tester;
+
+public:
+    AccountColumns(): _statusOffsets(1, 0), _usernameOffsets(1, 0), _firstRows(1, 0) {}
+
+    /* Copies every non-vacant account in (username, discriminator) order, one row per account */
+    explicit AccountColumns(const UTree& utree);
+    explicit AccountColumns(const UTreeSnapshot& snapshot);
+
+    size_t numRows() const {return _discs.size();}
+    size_t numUsernames() const {return _firstRows.size() - 1;}
+
+    /* Row fields */
+
+    int getDiscriminator(size_t row) const {return _discs[row];}
+    bool hasNitro(size_t row) const {return (_nitro[row / 64] >> (row % 64)) & 1;}
+    const string& getBadge(size_t row) const {return Account::decodeBadge(_badges[row]);}
+    std::string_view getStatus(size_t row) const;
+
+    /* Usernames, the rows of username i are [firstRow(i), firstRow(i + 1)) */
+
+    std::string_view getUsername(size_t i) const;
+    size_t firstRow(size_t i) const {return _firstRows[i];}
+
+    /* Rows of the usernames in [from, to), found by binary search */
+    std::pair<size_t, size_t> rowRange(const string& from, const string& to) const;
+
+    /* Aggregate kernels over the rows [first, last) */
+
+    long countNitro(size_t first, size_t last) const;
+    long countBadge(const string& badge, size_t first, size_t last) const;
+    std::vector<long> discHistogram(int bins, size_t first, size_t last) const;
+
+    /* Fraction of the accounts of the usernames in [from, to) that have nitro, 0 if there are none */
+    double nitroRatio(const string& from, const string& to) const;
+
+    /* Bytes held by the columns */
+    size_t memoryBytes() const;
+
+private:
+    std::vector<uint16_t> _discs;
+    std::vector<uint64_t> _nitro;           // One bit per row
+    std::vector<uint8_t> _badges;           // Badge dictionary indexes
+    string _statuses;                       // Every status back to back
+    std::vector<uint64_t> _statusOffsets;   // numRows() + 1 offsets into _statuses
+    string _usernames;                      // Every username back to back
+    std::vector<uint32_t> _usernameOffsets; // numUsernames() + 1 offsets into _usernames
+    std::vector<uint32_t> _firstRows;       // numUsernames() + 1 row indexes
+
+    // Appends the non-vacant accounts of a UNode, a UNode without any adds no username
+    void append(const UNode& node);
+
+    // Releases the spare capacity the columns grew with
+    void finish();
+};
@@ -1,5 +1,14 @@
 #include "utree.h"
+#include "treestats.h"
+#include "exporter.h"
+#include "snapshot.h"
+#include "columns.h"
+#include "reclaimer.h"
 #include <random>
+#include <algorithm>
+#include <cstdio>
+#include <functional>
+#include <set>
 
 #define NUMACCTS 20
 #define RANDDISC (distAcct(rng))
@@ -14,6 +23,58 @@ public:
     bool testBasicUTreeInsert(UTree& utree);
 
     bool testBasicDTreeRemove(DTree& dtree);
+
+    bool testDTreeFreeze(DTree& dtree);
+
+    bool testDTreeStorage();
+
+    bool testDTreeBalance();
+
+    bool testTreeCore();
+
+    bool testSplitJoin();
+
+    bool testTreeProfile(UTree& utree);
+
+    bool testExport(UTree& utree);
+
+    bool testBTreeEngine(UTree& utree);
+
+    bool testHashIndex(UTree& utree);
+
+    bool testARTEngine(UTree& utree);
+
+    bool testUsernameFilter();
+
+    bool testLookupCache();
+
+    bool testInlineAccounts();
+
+    bool testCompactAccount();
+
+    bool testStatusArena();
+
+    bool testSnapshot();
+
+    bool testSnapshotDiff();
+
+    bool testIterators();
+
+    bool testAggregates();
+
+    bool testBitmapIndex();
+
+    bool testColumns();
+
+    bool testAVLBalance();
+
+    bool testMerge();
+
+    bool testRemoveIf();
+
+    bool testTaskPool();
+
+    bool testReclaimer();
 };
 
 // TESTERS FOR DTREE
@@ -44,6 +105,237 @@ bool Tester::testBasicDTreeRemove(DTree& dtree){
 }
 
 
+bool Tester::testDTreeFreeze(DTree& dtree) {
+    // Lookups before the tree is frozen are the reference answers
+    DNode* expected[MAX_DISC + 1];
+    for(int disc = MIN_DISC; disc <= MAX_DISC; disc++) expected[disc] = dtree.AssistRetrieve(dtree.root(), disc);
+
+    // Enough reads in a row freeze the tree automatically
+    for(int i = 0; i < FREEZE_AFTER_READS; i++) dtree.retrieve(RANDDISC);
+    if(!dtree.isFrozen()) return false;
+    for(int disc = MIN_DISC; disc <= MAX_DISC; disc++){
+        if(dtree.retrieve(disc) != expected[disc]) return false;
+    }
+
+    // The first structural write returns to the linked layout
+    int disc = RANDDISC;
+    while(expected[disc] != nullptr) disc = RANDDISC;
+    dtree.insert(Account("", disc, 0, "", ""));
+    return !dtree.isFrozen() && dtree.retrieve(disc) != nullptr;
+}
+
+bool Tester::testDTreeStorage() {
+    if(sizeof(DNode) > 32) return false;
+
+    // Growing the node array moves every node, lookups must still find them all
+    DTree dtree;
+    for(int disc = 0; disc < 1000; disc++) dtree.insert(Account("storage", (disc * 7919) % 10000, false, "", ""));
+    if(dtree._nodes.size() != 1000 || dtree.getNumUsers() != 1000) return false;
+    for(int disc = 0; disc < 1000; disc++){
+        DNode* node = dtree.retrieve((disc * 7919) % 10000);
+        if(node == nullptr || node->getDiscriminator() != (disc * 7919) % 10000) return false;
+    }
+
+    // A copy is independent of the original
+    DTree copy;
+    copy = dtree;
+    DNode* removed = nullptr;
+    copy.remove(7919, removed);
+    if(dtree.retrieve(7919)->isVacant() || !copy.retrieve(7919)->isVacant()) return false;
+    if(copy.getNumUsers() != 999 || copy.retrieve(5838) == nullptr) return false;
+
+    // Clearing frees the nodes
+    dtree.clear();
+    return dtree.root() == nullptr && dtree._nodes.capacity() == 0 && copy.retrieve(0) != nullptr;
+}
+
+bool Tester::testDTreeBalance() {
+    // Height of a subtree, and whether every node in it is within the alpha bound
+    std::function<int(DTree&, DNode*, bool&)> height = [&](DTree& dtree, DNode* node, bool& balanced) {
+        if(node == nullptr) return 0;
+        if(dtree.checkImbalance(node)) balanced = false;
+        return 1 + std::max(height(dtree, node->left(), balanced), height(dtree, node->right(), balanced));
+    };
+
+    // Sequential and reverse sequential inserts are the worst case for an unbalanced tree
+    for(int direction : {1, -1}){
+        DTree dtree;
+        dtree.enableBitmaps();
+        for(int i = 0; i < 2000; i++) dtree.insert(Account("balance", direction > 0 ? i : MAX_DISC - i, i % 2, "", ""));
+        bool balanced = true;
+        if(height(dtree, dtree.root(), balanced) > 22 || !balanced || dtree._nodes.size() != 2000) return false;
+
+        // Vacant nodes survive rebuilds and keep their accounts
+        DNode* removed = nullptr;
+        for(int i = 0; i < 2000; i += 3) dtree.remove(direction > 0 ? i : MAX_DISC - i, removed);
+        for(int i = 2000; i < 3000; i++) dtree.insert(Account("balance", direction > 0 ? i : MAX_DISC - i, i % 2, "", ""));
+        balanced = true;
+        if(height(dtree, dtree.root(), balanced) > 24 || !balanced || dtree.getNumUsers() != 3000 - 667) return false;
+        if(dtree.root()->getNumVacant() != 667 || dtree.getBitmaps()->nitro().cardinality() != 1500 - 333) return false;
+        int previous = -1;
+        for(const Account& acct : dtree){
+            int i = direction > 0 ? acct.getDiscriminator() : MAX_DISC - acct.getDiscriminator();
+            if(acct.getDiscriminator() <= previous || (i % 3 == 0 && i < 2000) || acct.hasNitro() != (i % 2 == 1)) return false;
+            previous = acct.getDiscriminator();
+        }
+        if(dtree._nodes.size() != 3000 || dtree.retrieve(direction > 0 ? 3 : MAX_DISC - 3) == nullptr) return false;
+    }
+
+    // An alpha of 1 never rebuilds
+    DTree chain;
+    chain.setAlpha(1);
+    for(int disc = 0; disc < 100; disc++) chain.insert(Account("chain", disc, false, "", ""));
+    bool balanced = true;
+    if(height(chain, chain.root(), balanced) != 100) return false;
+    try {
+        chain.setAlpha(0.5);
+        return false;
+    } catch(const std::out_of_range&) {}
+    return chain.getAlpha() == 1;
+}
+
+bool Tester::testTreeCore() {
+    std::function<int(DNode*)> height = [&](DNode* node) {
+        return node == nullptr ? 0 : 1 + std::max(height(node->left()), height(node->right()));
+    };
+
+    // Building over a fresh node array gives a perfectly balanced tree that find can search
+    std::vector<DNode> storage(100);
+    std::vector<DNode*> slots;
+    std::vector<DNode> sorted;
+    for(int i = 0; i < 100; i++){
+        slots.push_back(&storage[i]);
+        sorted.push_back(DNode(Account("core", i * 10, false, "", "")));
+        if(i % 7 == 0) sorted.back().setVacant(true);
+    }
+    size_t next = 0;
+    DNode* root = TreeCore<DNodeTraits>::build(sorted, 0, 99, slots, next);
+    if(root != &storage[0] || next != 100 || height(root) != 7 || root->getSize() != 100 || root->getNumVacant() != 15) return false;
+    for(int i = 0; i < 100; i++){
+        DNode* found = TreeCore<DNodeTraits>::find(root, i * 10);
+        if(found == nullptr || found->getDiscriminator() != i * 10 || found->isVacant() != (i % 7 == 0)) return false;
+        if(TreeCore<DNodeTraits>::find(root, i * 10 + 5) != nullptr) return false;
+    }
+    std::vector<DNode*> walked;
+    TreeCore<DNodeTraits>::collect(root, walked);
+    for(int i = 0; i < 100; i++){
+        if(walked[i]->getDiscriminator() != i * 10) return false;
+    }
+
+    // A DTree kept within 0.7 passes the looser compile time bound everywhere
+    DTree dtree;
+    for(int i = 0; i < 3000; i++) dtree.insert(Account("core", (i * 7919) % 10000, false, "", ""));
+    WeightBalance<DNodeTraits, 3, 4> loose;
+    WeightBalance<DNodeTraits, 51, 100> tight;
+    bool anyTight = false;
+    for(DNode& node : dtree._nodes){
+        if(loose.unbalanced(&node)) return false;
+        anyTight = anyTight || tight.unbalanced(&node);
+    }
+    if(!anyTight || WeightBalance<DNodeTraits, 3, 4>::alpha != 0.75) return false;
+
+    // The AVL engine searches through the same core
+    UTree utree;
+    utree.loadData("accounts.csv");
+    for(const UNode& node : utree){
+        if(utree.AssistRetrieve(utree._root, node.getUsername()) != &node) return false;
+        if(UNodeTraits::compare(node.getUsername() + "~", &node) <= 0 || UNodeTraits::compare("", &node) >= 0) return false;
+    }
+    return utree.AssistRetrieve(utree._root, "no such user") == nullptr;
+}
+
+bool Tester::testSplitJoin() {
+    // Checks order, sizes and vacant counts below a node, returns the height
+    std::function<int(DNode*, int, int, bool&)> check = [&](DNode* node, int low, int high, bool& valid) {
+        if(node == nullptr) return 0;
+        int disc = node->getDiscriminator();
+        if(disc <= low || disc >= high) valid = false;
+        int left = check(node->left(), low, disc, valid);
+        int right = check(node->right(), disc, high, valid);
+        int size = 1, vacant = node->isVacant() ? 1 : 0;
+        for(DNode* child : {node->left(), node->right()}){
+            if(child == nullptr) continue;
+            size += child->getSize();
+            vacant += child->getNumVacant();
+        }
+        if(node->getSize() != size || node->getNumVacant() != vacant) valid = false;
+        return 1 + std::max(left, right);
+    };
+    // Every node of the array is in the tree, so nothing was left behind
+    auto valid = [&](DTree& dtree, int size) {
+        bool ordered = true;
+        int height = check(dtree.root(), INVALID_DISC, MAX_DISC + 1, ordered);
+        return ordered && height <= 26 && (int) dtree._nodes.size() == size && (size == 0 || dtree.root()->getSize() == size);
+    };
+    auto fill = [](DTree& dtree, int first, int last, int step) {
+        std::vector<int> discs;
+        for(int disc = first; disc < last; disc += step) discs.push_back(disc);
+        std::shuffle(discs.begin(), discs.end(), rng);
+        for(int disc : discs) dtree.insert(Account("join", disc, disc % 2 == 0, "", ""));
+    };
+
+    // Join a tree of larger discriminators, vacant nodes come along
+    DTree lower, upper;
+    lower.enableBitmaps();
+    fill(lower, 0, 2000, 1);
+    fill(upper, 2000, 4000, 1);
+    DNode* removed = nullptr;
+    upper.remove(2001, removed);
+    lower.join(std::move(upper));
+    if(!valid(lower, 4000) || !valid(upper, 0) || lower.getNumUsers() != 3999 || !lower.retrieve(2001)->isVacant()) return false;
+    if(lower.getBitmaps()->nitro().cardinality() != 2000 || lower.retrieve(3998)->getUsername() != "join") return false;
+
+    // Join a much smaller tree of smaller discriminators, the root changes
+    DTree small;
+    fill(small, 9000, 9010, 1);
+    DTree large;
+    fill(large, 0, 10, 1);
+    small.join(std::move(large));
+    if(!valid(small, 20) || small.rank(9000) != 10) return false;
+
+    // Interleaving trees are refused and left as they were
+    DTree evens;
+    fill(evens, 0, 100, 2);
+    try {
+        lower.join(std::move(evens));
+        return false;
+    } catch(std::invalid_argument&) {
+        if(!valid(lower, 4000) || !valid(evens, 50)) return false;
+    }
+
+    // Split at a discriminator, the bitmaps follow the accounts
+    DTree higher;
+    lower.split(1234, higher);
+    if(!valid(lower, 1234) || !valid(higher, 4000 - 1234)) return false;
+    if(lower.getNumUsers() != 1234 || higher.getNumUsers() != 4000 - 1234 - 1 || higher.retrieve(1234) == nullptr || lower.retrieve(1234) != nullptr) return false;
+    if(lower.getBitmaps()->nitro().cardinality() != 617 || higher.getBitmaps()->nitro().cardinality() != 1383) return false;
+    DTree none;
+    lower.split(MAX_DISC, none);
+    if(!valid(lower, 1234) || !valid(none, 0)) return false;
+    lower.split(0, none);
+    if(!valid(lower, 0) || !valid(none, 1234)) return false;
+
+    // Merge overlapping trees: existing accounts win, vacant accounts of the merged tree are dropped
+    DTree merged, batch;
+    fill(merged, 0, 4000, 2);
+    merged.remove(1000, removed);
+    fill(batch, 3000, 6000, 3);
+    batch.remove(3003, removed);
+    std::set<int> expected;
+    for(int disc = 0; disc < 4000; disc += 2) expected.insert(disc);
+    int fresh = 0;
+    for(int disc = 3000; disc < 6000; disc += 3){
+        if(disc != 3003 && expected.insert(disc).second) fresh++;
+    }
+    int visited = 0;
+    if(merged.merge(std::move(batch), [&](const Account&) {visited++;}) != fresh || visited != fresh) return false;
+    if(!valid(merged, (int) expected.size()) || !valid(batch, 0) || merged.getNumUsers() != (int) expected.size() - 1) return false;
+    std::vector<int> found;
+    for(const Account& acct : merged) found.push_back(acct.getDiscriminator());
+    expected.erase(1000);
+    return found == std::vector<int>(expected.begin(), expected.end()) && merged.retrieve(3000)->getAccount().hasNitro();
+}
+
 // TESTERS FOR UTREE
 
 bool Tester::testBasicUTreeInsert(UTree& utree) {
@@ -57,6 +349,971 @@ bool Tester::testBasicUTreeInsert(UTree& utree) {
     return true;
 }
 
+bool Tester::testTreeProfile(UTree& utree) {
+    TreeProfiler profiler;
+    TreeProfile profile = profiler.profile(utree);
+
+    // Every node must be counted exactly once in the depth histograms
+    long utreeNodes = 0, dtreeNodes = 0, dtrees = 0;
+    for(long count : profile.utree.depthHistogram) utreeNodes += count;
+    for(long count : profile.dtrees.depthHistogram) dtreeNodes += count;
+    for(long count : profile.vacancyHistogram) dtrees += count;
+    if(utreeNodes != profile.utree.nodes || dtreeNodes != profile.dtrees.nodes) return false;
+    if(dtrees != profile.utree.nodes) return false;
+    if(profile.numAccounts + profile.numVacant != profile.dtrees.nodes) return false;
+
+    // A retrieveUser path always passes through at least one UNode and one DNode
+    if(profile.dtrees.nodes > 0 && profile.averageUserPath() < 2) return false;
+    if((int) profile.worstDNodes.size() > PROFILE_WORST_COUNT) return false;
+    return profile.unodeBytes > 0 && profile.dnodeBytes > 0;
+}
+
+bool Tester::testExport(UTree& utree) {
+    // CSV export must load back into an identical tree
+    std::ostringstream csv;
+    long exported;
+    {
+        AccountExporter exporter(csv, EXPORT_CSV);
+        exported = exporter.exportTree(utree);
+    }
+    string exportFile = "export_test.csv";
+    std::ofstream(exportFile) << csv.str();
+    UTree copy;
+    copy.loadData(exportFile);
+    std::remove(exportFile.c_str());
+
+    std::ostringstream again;
+    {
+        AccountExporter exporter(again, EXPORT_CSV);
+        exporter.exportTree(copy);
+    }
+    if(csv.str() != again.str()) return false;
+
+    // Parallel formatting must produce the same bytes in the same order
+    std::ostringstream parallel;
+    {
+        AccountExporter exporter(parallel, EXPORT_CSV, 256);
+        if(exporter.exportTree(utree, 4) != exported) return false;
+    }
+    if(parallel.str() != csv.str()) return false;
+
+    // A failed write stops the formatting threads and reaches the caller, the destructor swallows it
+    bool thrown = false;
+    try {
+        AccountExporter exporter(-1, EXPORT_CSV, 256);
+        exporter.exportTree(utree, 4);
+    } catch(const std::runtime_error&) {
+        thrown = true;
+    }
+    if(!thrown) return false;
+
+    // JSON Lines writes one line per account
+    std::ostringstream jsonl;
+    {
+        AccountExporter exporter(jsonl, EXPORT_JSONL);
+        exporter.exportTree(utree);
+    }
+    string text = jsonl.str();
+    return exported == TreeProfiler().profile(utree).numAccounts
+           && std::count(text.begin(), text.end(), '\n') == exported;
+}
+
+bool Tester::testBTreeEngine(UTree& utree) {
+    UTree btree(ENGINE_BTREE);
+    btree.loadData("accounts.csv");
+
+    // Both engines must hold the same accounts in the same order
+    std::ostringstream expected, actual;
+    AccountExporter(expected).exportTree(utree);
+    AccountExporter(actual).exportTree(btree);
+    if(expected.str() != actual.str()) return false;
+
+    // Same answers through the UTree API
+    if(btree.numUsers("Brackle") != utree.numUsers("Brackle")) return false;
+    if(btree.retrieve("Nobody") != nullptr || btree.retrieveUser("Nobody", 1) != nullptr) return false;
+    DNode* removed = nullptr;
+    if(!btree.removeUser("Brackle", 9550, removed) || !removed->isVacant()) return false;
+    return btree.numUsers("Brackle") == utree.numUsers("Brackle") - 1;
+}
+
+bool Tester::testHashIndex(UTree& utree) {
+    UTree indexed;
+    indexed.loadData("accounts.csv");
+    indexed.enableHashIndex();
+    if(indexed.getHashIndex()->size() != (size_t) TreeProfiler().profile(utree).utree.nodes) return false;
+
+    // Every username resolves to the same UNode the engine finds
+    bool matched = true;
+    std::function<void(UNode*)> check = [&](UNode* node) {
+        if(node == nullptr) return;
+        check(node->_left);
+        if(indexed._hash->find(node->getUsername()) != node) matched = false;
+        check(node->_right);
+    };
+    check(indexed._root);
+    if(!matched || indexed.retrieve("Nobody") != nullptr) return false;
+
+    // New usernames are indexed on insert, clear empties the index
+    indexed.insert(Account("Newcomer", 1234, true, "", ""));
+    if(indexed.retrieveUser("Newcomer", 1234) == nullptr) return false;
+    indexed.clear();
+    return indexed.getHashIndex()->size() == 0 && indexed.retrieve("Newcomer") == nullptr;
+}
+
+bool Tester::testARTEngine(UTree& utree) {
+    UTree art(ENGINE_ART);
+    art.loadData("accounts.csv");
+
+    // Same accounts in the same order as the AVL engine
+    std::ostringstream expected, actual;
+    AccountExporter(expected).exportTree(utree);
+    AccountExporter(actual).exportTree(art);
+    if(expected.str() != actual.str()) return false;
+
+    // Prefix search agrees between engines and respects the limit
+    art.insert(Account("Pikachu", 25, false, "", ""));
+    art.insert(Account("Pikachu2", 26, false, "", ""));
+    std::vector<UNode*> matches = art.prefixSearch("Pik", 10);
+    if(matches.size() != 3 || matches[0]->getUsername() != "Pika" || matches[2]->getUsername() != "Pikachu2") return false;
+    if(art.prefixSearch("Pik", 2).size() != 2 || !art.prefixSearch("Zzz", 5).empty()) return false;
+    std::vector<UNode*> avlMatches = utree.prefixSearch("C", 10);
+    std::vector<UNode*> artMatches = art.prefixSearch("C", 10);
+    if(avlMatches.size() != artMatches.size()) return false;
+    for(unsigned int i = 0; i < avlMatches.size(); i++){
+        if(avlMatches[i]->getUsername() != artMatches[i]->getUsername()) return false;
+    }
+    return art.numUsers("Pikachu") == 1 && art.retrieve("Pik") == nullptr;
+}
+
+bool Tester::testUsernameFilter() {
+    UTree filtered;
+    filtered.enableFilter(4, 0.01);
+    filtered.loadData("accounts.csv");
+
+    // The load outgrew the filter, so it was rebuilt for the real number of users
+    if(filtered.getFilter()->expectedItems() != (size_t) filtered._numNodes) return false;
+
+    // No false negatives
+    bool allFound = true;
+    filtered.forEachNode([&](UNode* node) {
+        if(filtered.retrieve(node->getUsername()) != node) allFound = false;
+    });
+    if(!allFound) return false;
+
+    // Misses are rejected close to the configured rate
+    CountingBloomFilter filter(1000, 0.01);
+    for(int i = 0; i < 1000; i++) filter.add("user" + std::to_string(i));
+    int falsePositives = 0;
+    for(int i = 1000; i < 11000; i++) falsePositives += filter.mayContain("user" + std::to_string(i));
+    if(falsePositives > 300) return false;
+
+    // Counting lets an item be removed again
+    filter.remove("user1");
+    filter.remove("user2");
+    return !filter.mayContain("user1") || !filter.mayContain("user2");
+}
+
+bool Tester::testLookupCache() {
+    UTree utree;
+    utree.enableLookupCache(16);
+    utree.loadData("accounts.csv");
+    std::vector<DNode*> accounts;
+    utree.forEachNode([&](UNode* node) {
+        if(node->_dtree != nullptr) TreeCore<DNodeTraits>::collect(node->_dtree->root(), accounts);
+        for(int i = 0; i < node->_numInline; i++) accounts.push_back(&node->_inline[i]);
+    });
+
+    // Cached answers match the trees, and the cache never grows past its capacity
+    for(int round = 0; round < 2; round++){
+        for(DNode* account : accounts){
+            if(utree.retrieveUser(account->getUsername(), account->getDiscriminator()) != account) return false;
+        }
+    }
+    if(utree.getLookupCache()->capacity() != 16) return false;
+    // Only the first of repeated lookups misses
+    long hits = utree.getLookupCache()->hits();
+    for(int i = 0; i < 8; i++) utree.retrieveUser(accounts[0]->getUsername(), accounts[0]->getDiscriminator());
+    if(utree.getLookupCache()->hits() - hits < 7) return false;
+
+    // A DTree rebalance frees the cached node, the next lookup must find the new one
+    string username = "cache_user";
+    int disc = 42;
+    for(int neighbor : {disc, disc - 1, disc + 1}) utree.insert(Account(username, neighbor, false, "", ""));
+    DTree* dtree = utree.retrieve(username)->_dtree;
+    utree.retrieveUser(username, disc);
+    dtree->rebalance(dtree->root());
+    if(utree.retrieveUser(username, disc) != dtree->AssistRetrieve(dtree->root(), disc)) return false;
+
+    // Removing the account drops its entry, clearing the tree drops everything
+    DNode* removed = nullptr;
+    if(!utree.removeUser(username, disc, removed) || utree._cache->find(username, disc) != nullptr) return false;
+    string firstName = accounts[0]->getUsername();
+    int firstDisc = accounts[0]->getDiscriminator();
+    utree.clear();
+    if(utree.retrieveUser(firstName, firstDisc) != nullptr) return false;
+
+    // An entry left by removeIf must not outlive the UNode it points into: dropping u retires it,
+    // dropping v frees it, and the lookup of u/10 must not read it
+    UTree bulk;
+    bulk.enableLookupCache();
+    bulk.insert(Account("u", 10, false, "", ""));
+    bulk.insert(Account("u", 20, false, "", ""));
+    bulk.retrieveUser("u", 10);
+    if(bulk.removeIf([](const Account& acct) {return acct.getDiscriminator() == 10;}, true) != 1) return false;
+    if(!bulk.removeUser("u", 20, removed)) return false;
+    bulk.insert(Account("v", 1, false, "", ""));
+    if(!bulk.removeUser("v", 1, removed)) return false;
+    if(bulk.retrieveUser("u", 10) != nullptr) return false;
+
+    // eraseUsername drops every discriminator of one username and nothing else
+    LookupCache cache(64);
+    DTree owner;
+    owner.insert(Account("w", 1, false, "", ""));
+    owner.insert(Account("w", 2, false, "", ""));
+    cache.insert("w", 1, owner.getGeneration(), owner.retrieve(1));
+    cache.insert("w", 2, owner.getGeneration(), owner.retrieve(2));
+    DTree other;
+    other.insert(Account("x", 1, false, "", ""));
+    cache.insert("x", 1, other.getGeneration(), other.retrieve(1));
+    cache.eraseUsername("w");
+    return cache.find("w", 1) == nullptr && cache.find("w", 2) == nullptr && cache.find("x", 1) == other.retrieve(1);
+}
+
+bool Tester::testInlineAccounts() {
+    UTree utree;
+    utree.enableLookupCache();
+    utree.insert(Account("solo", 5, false, "", ""));
+    UNode* node = utree.retrieve("solo");
+    if(!node->isInline() || utree.retrieveUser("solo", 5) != &node->_inline[0]) return false;
+
+    // Removing the last account drops the UNode, the username starts over inline
+    DNode* removed = nullptr;
+    if(!utree.removeUser("solo", 5, removed) || utree.numUsers("solo") != 0 || utree.retrieve("solo") != nullptr) return false;
+    if(!removed->isVacant() || removed->getDiscriminator() != 5) return false;
+    utree.insert(Account("solo", 7, false, "", ""));
+    node = utree.retrieve("solo");
+    if(!node->isInline() || utree.numUsers("solo") != 1 || utree.retrieveUser("solo", 5) != nullptr) return false;
+
+    // Outgrowing the inline slots moves every account into a DTree, cached DNodes included
+    utree.retrieveUser("solo", 7);
+    for(int disc = 8; disc < 8 + UNODE_INLINE_ACCOUNTS; disc++) utree.insert(Account("solo", disc, false, "", ""));
+    if(node->isInline() || utree.numUsers("solo") != 1 + UNODE_INLINE_ACCOUNTS) return false;
+    if(utree.retrieveUser("solo", 7) != node->getDTree()->retrieve(7)) return false;
+
+    // Inline accounts are printed and exported like any other
+    utree.insert(Account("another", 1, true, "Subscriber", "inline"));
+    std::ostringstream csv;
+    AccountExporter exporter(csv, EXPORT_CSV);
+    if(exporter.exportTree(utree) != 2 + UNODE_INLINE_ACCOUNTS) return false;
+    exporter.flush();
+    return csv.str().find("another,1,1,Subscriber,inline") != string::npos;
+}
+
+bool Tester::testCompactAccount() {
+    // Fields round trip through the compact representation
+    Account acct("compact", MAX_DISC, true, "Subscriber", "status");
+    if(acct.getUsername() != "compact" || acct.getDiscriminator() != MAX_DISC || !acct.hasNitro()
+       || acct.getBadge() != "Subscriber" || acct.getStatus() != "status") return false;
+    if(Account().getDiscriminator() != INVALID_DISC || Account().getBadge() != DEFAULT_BADGE) return false;
+
+    // A copy keeps the username after the original is gone
+    Account* original = new Account("temporary", 1, false, "", "");
+    Account copy = *original;
+    delete original;
+    if(copy.getUsername() != "temporary") return false;
+
+    // Every account of a username shares one copy of its text, inline or in a DTree
+    UTree utree;
+    for(int disc = 1; disc <= 3; disc++) utree.insert(Account("shared", disc, false, "", ""));
+    const SharedString& username = utree.retrieveUser("shared", 1)->_account._username;
+    for(int disc = 2; disc <= 3; disc++){
+        if(!utree.retrieveUser("shared", disc)->_account._username.sharesWith(username)) return false;
+    }
+    return sizeof(Account) < sizeof(string) * 3;
+}
+
+bool Tester::testStatusArena() {
+    // Copies of an Account share the stored status
+    Account acct("arena", 1, false, "", "a status stored once");
+    Account copy = acct;
+    if(copy.getStatusView().data() != acct.getStatusView().data() || copy.getStatus() != "a status stored once") return false;
+
+    // A mapped load copies no status text and points into the file
+    UTree mapped;
+    mapped.loadMapped("accounts.csv");
+    if(mapped._arenas.size() != 1 || mapped._arenas[0]->bytes() != 0 || mapped._arenas[0]->_mappings.size() != 1) return false;
+    std::pair<void*, size_t> mapping = mapped._arenas[0]->_mappings[0];
+    const char* start = (const char*) mapping.first;
+    std::string_view status = mapped.retrieveUser("Brackle", 9550)->getAccount().getStatusView();
+    if(status != "This is a status" || status.data() < start || status.data() >= start + mapping.second) return false;
+
+    // Both loaders build the same tree
+    UTree loaded;
+    loaded.loadData("accounts.csv");
+    std::ostringstream first, second;
+    AccountExporter(first).exportTree(mapped);
+    AccountExporter(second).exportTree(loaded);
+    if(first.str() != second.str() || first.str().empty()) return false;
+
+    // Reloading releases the text of the previous load, unless a snapshot still reads it
+    std::weak_ptr<StringArena> previous = loaded._arenas[0];
+    loaded.loadData("accounts.csv", false);
+    if(!previous.expired() || loaded._arenas.size() != 1) return false;
+    previous = loaded._arenas[0];
+    UTreeSnapshot before = loaded.snapshot();
+    loaded.loadData("accounts.csv", false);
+    if(previous.expired() || before.retrieveUser("Brackle", 9550)->getAccount().getStatusView() != "This is a status") return false;
+    before = UTreeSnapshot();
+    return previous.expired();
+}
+
+bool Tester::testSnapshot() {
+    UTree utree;
+    utree.loadData("accounts.csv");
+    std::vector<int> ids(500);
+    for(int i = 0; i < 500; i++) ids[i] = i;
+    std::shuffle(ids.begin(), ids.end(), rng);
+    for(int id : ids) utree.insert(Account("snapshot_" + std::to_string(id), 1, false, "", ""));
+    utree.enableHashIndex();
+    utree.enableLookupCache();
+    std::ostringstream before;
+    AccountExporter(before).exportTree(utree);
+
+    // The lookup cache holds an account the snapshot will keep
+    string username = utree._root->getUsername();
+    int disc = utree._root->begin()->getDiscriminator();
+    utree.retrieveUser(username, disc);
+    int numUsers = utree.numUsers(username);
+
+    UTreeSnapshot snapshot = utree.snapshot();
+    if(snapshot._root != utree._root) return false;
+
+    // Writes after the snapshot copy what they touch
+    DNode* removed = nullptr;
+    int freeDisc = 0;
+    while(utree.retrieveUser(username, freeDisc) != nullptr) freeDisc++;
+    utree.insert(Account(username, freeDisc, false, "", ""));
+    if(!utree.removeUser(username, disc, removed)) return false;
+    utree.insert(Account("snapshot_user", 1, false, "", ""));
+    utree.insert(Account("snapshot_7", 2, false, "", ""));
+    if(!utree.retrieveUser(username, disc)->isVacant() || snapshot.retrieveUser(username, disc)->isVacant()) return false;
+    if(utree.retrieveUser(username, freeDisc) == nullptr || snapshot.retrieveUser(username, freeDisc) != nullptr) return false;
+    if(utree.retrieve("snapshot_user") == nullptr || snapshot.retrieve("snapshot_user") != nullptr) return false;
+    if(utree.numUsers("snapshot_7") != 2 || snapshot.numUsers("snapshot_7") != 1 || !snapshot.retrieve("snapshot_7")->isInline()) return false;
+    if(utree._hash->find(username) != utree.AssistRetrieve(utree._root, username)) return false;
+
+    // Only the written paths were copied
+    std::vector<UNode*> live;
+    utree.forEachNode([&](UNode* node) {live.push_back(node);});
+    std::sort(live.begin(), live.end());
+    int total = 0, shared = 0;
+    snapshot.forEachNode([&](const UNode* node) {
+        total++;
+        if(std::binary_search(live.begin(), live.end(), node)) shared++;
+    });
+    if(total != (int) live.size() - 1 || shared < total / 2) return false;
+
+    // A copy of the snapshot outlives the tree, its export and save match the tree it was taken from
+    UTreeSnapshot copy = snapshot;
+    snapshot = UTreeSnapshot();
+    utree.clear();
+    std::ostringstream after;
+    AccountExporter(after).exportTree(copy);
+    if(after.str() != before.str() || copy.numUsers(username) != numUsers) return false;
+    copy.save("snapshot_test.csv");
+    UTree saved;
+    saved.loadData("snapshot_test.csv");
+    std::remove("snapshot_test.csv");
+    std::ostringstream reloaded;
+    AccountExporter(reloaded).exportTree(saved);
+    if(reloaded.str() != before.str()) return false;
+
+    // The other engines do not link their UNodes
+    try {
+        UTree(ENGINE_BTREE).snapshot();
+        return false;
+    } catch(const std::logic_error&) {
+        return true;
+    }
+}
+
+bool Tester::testSnapshotDiff() {
+    UTree utree;
+    utree.loadData("accounts.csv");
+    std::vector<int> ids(300);
+    for(int i = 0; i < 300; i++) ids[i] = i;
+    std::shuffle(ids.begin(), ids.end(), rng);
+    for(int id : ids) utree.insert(Account("diff_" + std::to_string(id), 1, false, "", ""));
+    UTreeSnapshot before = utree.snapshot();
+    if(UTreeSnapshot::diff(before, before, [](ChangeType, const Account&) {}) != 0) return false;
+
+    // One change of each kind a UTree can make
+    DNode* removed = nullptr;
+    utree.removeUser("diff_17", 1, removed);
+    utree.insert(Account("diff_42", 2, true, "", "added"));
+    utree.insert(Account("diff_new", 7, false, "", ""));
+    UTreeSnapshot after = utree.snapshot();
+
+    std::vector<std::pair<ChangeType, string>> changes;
+    auto record = [&](ChangeType type, const Account& acct) {
+        changes.push_back({type, acct.getUsername() + "#" + std::to_string(acct.getDiscriminator())});
+    };
+    UTreeSnapshot::diff(before, after, record);
+    std::vector<std::pair<ChangeType, string>> expected = {
+        {CHANGE_REMOVED, "diff_17#1"}, {CHANGE_INSERTED, "diff_42#2"}, {CHANGE_INSERTED, "diff_new#7"}};
+    if(changes != expected) return false;
+
+    // The reverse diff undoes the changes
+    changes.clear();
+    UTreeSnapshot::diff(after, before, record);
+    expected = {{CHANGE_INSERTED, "diff_17#1"}, {CHANGE_REMOVED, "diff_42#2"}, {CHANGE_REMOVED, "diff_new#7"}};
+    if(changes != expected) return false;
+
+    // Change stream lines
+    std::ostringstream stream;
+    AccountExporter(stream).exportDiff(before, after);
+    if(stream.str() != "-,diff_17,1\n+,diff_42,2,1,,added\n+,diff_new,7,0,,\n") return false;
+
+    // Versions that share nothing are compared account by account
+    UTree first, second;
+    first.loadData("accounts.csv");
+    second.loadData("accounts.csv");
+    string username = second._root->getUsername();
+    int disc = second._root->_dtree->root()->getDiscriminator();
+    second.retrieveUser(username, disc)->_account.setStatus("changed");
+    changes.clear();
+    UTreeSnapshot::diff(first.snapshot(), second.snapshot(), record);
+    expected = {{CHANGE_MODIFIED, username + "#" + std::to_string(disc)}};
+    return changes == expected;
+}
+
+bool Tester::testIterators() {
+    // DTree: in order, vacant accounts skipped, both directions
+    DTree dtree;
+    std::vector<int> discs(200);
+    for(int i = 0; i < 200; i++) discs[i] = i * 3;
+    std::shuffle(discs.begin(), discs.end(), rng);
+    for(int disc : discs) dtree.insert(Account("iter", disc, false, "", ""));
+    DNode* removed = nullptr;
+    for(int disc = 0; disc < 600; disc += 30) dtree.remove(disc, removed);
+    // A removed slot is only refilled when the new discriminator keeps the order
+    dtree.insert(Account("iter", 301, false, "", ""));
+    std::vector<int> expected;
+    for(int disc = 0; disc < 600; disc += 3){
+        if(disc % 30 != 0) expected.push_back(disc);
+        if(disc == 300) expected.push_back(301);
+    }
+    std::vector<int> found;
+    for(const Account& acct : dtree) found.push_back(acct.getDiscriminator());
+    if(found != expected) return false;
+    found.clear();
+    for(DTree::const_iterator it = dtree.end(); it != dtree.begin();) found.push_back((--it)->getDiscriminator());
+    if(!std::equal(found.rbegin(), found.rend(), expected.begin(), expected.end())) return false;
+    if(dtree.lower_bound(30)->getDiscriminator() != 33 || dtree.upper_bound(33)->getDiscriminator() != 36
+       || dtree.lower_bound(599) != dtree.end()) return false;
+    found.clear();
+    for(const Account& acct : dtree.range(298, 310)) found.push_back(acct.getDiscriminator());
+    if(found != std::vector<int>({301, 303, 306, 309})) return false;
+
+    // UTree: every engine walks the same usernames and accounts as forEachNode
+    for(UTreeEngine engine : {ENGINE_AVL, ENGINE_BTREE, ENGINE_ART}){
+        UTree utree(engine);
+        utree.loadData("accounts.csv");
+        utree.insert(Account("iter", 5, false, "", ""));
+        utree.insert(Account("iter", 2, false, "", ""));
+        utree.insert(Account("iterate", 1, false, "", ""));
+        utree.removeUser("iter", 5, removed);
+        utree.removeUser("iterate", 1, removed);
+        std::vector<string> usernames;
+        std::vector<string> accounts;
+        utree.forEachNode([&](UNode* node) {
+            usernames.push_back(node->getUsername());
+            std::vector<const DNode*> nodes;
+            node->collectAccounts(nodes);
+            for(const DNode* acct : nodes){
+                if(!acct->isVacant()) accounts.push_back(acct->getUsername() + "#" + std::to_string(acct->getDiscriminator()));
+            }
+        });
+        std::vector<string> walked;
+        for(const UNode& node : utree) walked.push_back(node.getUsername());
+        if(walked != usernames) return false;
+        walked.clear();
+        for(const Account& acct : utree.accounts()) walked.push_back(acct.getUsername() + "#" + std::to_string(acct.getDiscriminator()));
+        if(walked != accounts) return false;
+
+        // Bounds against a linear search, for present, missing and out of range keys
+        for(string key : {string(""), string("a"), string("iter"), string("itera"), string("iterate"), usernames[usernames.size() / 2],
+                          usernames.back(), usernames.back() + "!", string("\xff")}){
+            auto first = std::lower_bound(usernames.begin(), usernames.end(), key);
+            UTree::const_iterator it = utree.lower_bound(key);
+            if(first == usernames.end() ? it != utree.end() : it == utree.end() || it->getUsername() != *first) return false;
+            auto after = std::upper_bound(usernames.begin(), usernames.end(), key);
+            it = utree.upper_bound(key);
+            if(after == usernames.end() ? it != utree.end() : it == utree.end() || it->getUsername() != *after) return false;
+        }
+        walked.clear();
+        for(const UNode& node : utree.range("iter", "iterate~")) walked.push_back(node.getUsername());
+        // "iterate" lost its only account, which drops the username
+        if(walked != std::vector<string>({"iter"})) return false;
+        walked.clear();
+        for(const Account& acct : utree.accounts("iter", "iterate~")) walked.push_back(acct.getUsername() + "#" + std::to_string(acct.getDiscriminator()));
+        if(walked != std::vector<string>({"iter#2"})) return false;
+    }
+    return true;
+}
+
+bool Tester::testAggregates() {
+    for(UTreeEngine engine : {ENGINE_AVL, ENGINE_BTREE}){
+        UTree utree(engine);
+        utree.loadData("accounts.csv");
+        for(int i = 0; i < 40; i++) utree.insert(Account("crowd_" + std::to_string(i % 4), i, false, "", ""));
+        DNode* removed = nullptr;
+        utree.removeUser("crowd_3", 3, removed);
+        utree.removeUser("crowd_3", 7, removed);
+        if(utree.insert(Account("crowd_0", 0, false, "", ""))) return false;
+        UTreeSnapshot before = engine == ENGINE_AVL ? utree.snapshot() : UTreeSnapshot();
+        long beforeCount = utree.numAccounts();
+        utree.insert(Account("crowd_1", 500, false, "", ""));
+        utree.removeUser("crowd_2", 2, removed);
+
+        // Counts and ranks against a walk of every account
+        std::vector<std::pair<string, int>> accounts;
+        for(const Account& acct : utree.accounts()) accounts.push_back({acct.getUsername(), acct.getDiscriminator()});
+        if(utree.numAccounts() != (long) accounts.size()) return false;
+        if(engine == ENGINE_AVL && utree._root->getSubtreeAccounts() != (long) accounts.size()) return false;
+        for(size_t i = 0; i < accounts.size(); i += 7){
+            if(utree.rank(accounts[i].first, accounts[i].second) != (long) i) return false;
+        }
+        if(utree.rank("crowd_3", 8) != std::lower_bound(accounts.begin(), accounts.end(), std::make_pair(string("crowd_3"), 8)) - accounts.begin()
+           || utree.rank("~", 0) != (long) accounts.size() || utree.rank("", 0) != 0) return false;
+
+        // Top usernames against sorting every username
+        std::vector<std::pair<int, string>> crowded;
+        for(const UNode& node : utree) crowded.push_back({-node.getNumUsers(), node.getUsername()});
+        std::sort(crowded.begin(), crowded.end());
+        std::vector<UNode*> top = utree.mostAccounts(6);
+        if(top.size() != 6) return false;
+        for(size_t i = 0; i < top.size(); i++){
+            if(top[i]->getUsername() != crowded[i].second || top[i]->getNumUsers() != -crowded[i].first) return false;
+        }
+
+        // Writes after a snapshot leave the counts the snapshot shares alone
+        if(engine == ENGINE_AVL && before._root->getSubtreeAccounts() != beforeCount) return false;
+        utree.clear();
+        if(utree.numAccounts() != 0 || !utree.mostAccounts(3).empty()) return false;
+    }
+    return true;
+}
+
+bool Tester::testBitmapIndex() {
+    // Containers switch between arrays and bitsets as they fill and empty
+    RoaringBitmap evens, thirds;
+    for(uint64_t value = 0; value < 20000; value += 2) evens.add(value);
+    for(uint64_t value = 0; value < 200000; value += 3) thirds.add(value);
+    if(evens._containers.size() != 1 || !evens._containers[0].isBitset() || thirds._containers.size() != 4) return false;
+    if(evens.add(4) || !evens.contains(19998) || evens.contains(19999) || evens.andCardinality(thirds) != 3334) return false;
+    for(uint64_t value = 0; value < 20000; value += 4) evens.remove(value);
+    if(evens.cardinality() != 5000 || !evens._containers[0].isBitset() || evens.andCardinality(thirds) != 1667) return false;
+    for(uint64_t value = 12002; value < 20000; value += 4) evens.remove(value);
+    if(evens.cardinality() != 3000 || evens._containers[0].isBitset() || evens.andCardinality(thirds) != 1000) return false;
+    long common = 0;
+    evens.forEachAnd(thirds, [&](uint64_t value) {common += value % 12 == 6;});
+    if(common != 1000) return false;
+
+    for(UTreeEngine engine : {ENGINE_AVL, ENGINE_BTREE}){
+        UTree utree(engine);
+        utree.loadData("accounts.csv");
+        for(int i = 0; i < 60; i++) utree.insert(Account("bitmap", i, i % 3 == 0, i % 2 ? "Subscriber" : "", ""));
+        long nitro = utree.countNitro();
+        long subscribers = utree.countBadge("Subscriber");
+        long nitroSubscribers = utree.countBadge("Subscriber", true);
+        utree.enableBitmapIndex();
+        if(utree.countNitro() != nitro || utree.countBadge("Subscriber") != subscribers
+           || utree.countBadge("Subscriber", true) != nitroSubscribers || utree.countBadge("No such badge") != 0) return false;
+
+        // Writes after a snapshot copy UNodes, the index follows the copies
+        UTreeSnapshot before = engine == ENGINE_AVL ? utree.snapshot() : UTreeSnapshot();
+        DNode* removed = nullptr;
+        utree.removeUser("bitmap", 3, removed);
+        utree.removeUser("bitmap", 3, removed);
+        utree.removeUser("bitmap", 5, removed);
+        utree.insert(Account("bitmap", 100, true, "Subscriber", ""));
+        utree.insert(Account("bitmap_new", 1, true, "Server Booster", ""));
+        nitro += 1;
+        subscribers -= 1;
+        if(utree.countNitro() != nitro || utree.countBadge("Subscriber") != subscribers
+           || utree.countBadge("Subscriber", true) != nitroSubscribers) return false;
+
+        std::multiset<string> scanned, walked;
+        utree.forEachNitro([&](const Account& acct) {scanned.insert(acct.getUsername() + "#" + std::to_string(acct.getDiscriminator()));});
+        for(const Account& acct : utree.accounts()){
+            if(acct.hasNitro()) walked.insert(acct.getUsername() + "#" + std::to_string(acct.getDiscriminator()));
+        }
+        if(scanned != walked || scanned.count("bitmap#3") != 0 || scanned.count("bitmap_new#1") != 1) return false;
+        long boosters = 0;
+        utree.forEachBadge("Server Booster", [&](const Account& acct) {boosters += acct.getBadge() == "Server Booster";});
+        if(boosters != 9) return false;
+
+        // Per username counts come from the DTree bitmaps
+        UNode* node = utree.retrieve("bitmap");
+        if(node->_dtree->getBitmaps() == nullptr || node->countNitro() != 20 || node->countBadge("Subscriber") != 29
+           || node->countBadge("Subscriber", true) != 10) return false;
+        int discs = 0;
+        node->forEachNitro([&](const Account& acct) {discs += acct.getDiscriminator();});
+        if(discs != 570 - 3 + 100) return false;
+
+        utree.disableBitmapIndex();
+        if(node->_dtree->getBitmaps() != nullptr || utree.countNitro() != nitro || node->countNitro() != 20) return false;
+    }
+
+    // Enabling the index after a snapshot copies the nodes, the snapshot's DTrees stay unindexed
+    UTree versioned;
+    for(int disc = 0; disc < 40; disc++) versioned.insert(Account("shared", disc, disc % 2 == 0, "", ""));
+    versioned.insert(Account("alone", 1, true, "", ""));
+    UTreeSnapshot before = versioned.snapshot();
+    versioned.enableBitmapIndex();
+    const UNode* old = before.retrieve("shared");
+    if(old == versioned.retrieve("shared") || old->_dtree->getBitmaps() != nullptr || old->_id != 0) return false;
+    if(versioned.countNitro() != 21 || versioned.retrieve("shared")->countNitro() != 20) return false;
+    UTreeSnapshot indexed = versioned.snapshot();
+    versioned.disableBitmapIndex();
+    return indexed.retrieve("shared")->_dtree->getBitmaps() != nullptr && versioned.retrieve("shared")->_dtree->getBitmaps() == nullptr;
+}
+
+bool Tester::testColumns() {
+    for(UTreeEngine engine : {ENGINE_AVL, ENGINE_BTREE}){
+        UTree utree(engine);
+        utree.loadData("accounts.csv");
+        for(int i = 0; i < 70; i++) utree.insert(Account("columns", i * 97, i % 4 == 0, i % 3 ? "Subscriber" : "", "row " + std::to_string(i)));
+        DNode* removed = nullptr;
+        utree.removeUser("columns", 97, removed);
+        utree.insert(Account("columns_gone", 5, true, "", ""));
+        utree.removeUser("columns_gone", 5, removed);
+
+        UTreeSnapshot snapshot = engine == ENGINE_AVL ? utree.snapshot() : UTreeSnapshot();
+        AccountColumns columns(utree);
+        if((long) columns.numRows() != utree.numAccounts() || columns.firstRow(columns.numUsernames()) != columns.numRows()) return false;
+
+        // Rows follow the account walk, a username whose accounts are all vacant has no entry
+        size_t row = 0, username = 0;
+        long nitro = 0, subscribers = 0;
+        std::vector<long> histogram(10, 0);
+        for(const Account& acct : utree.accounts()){
+            if(row == columns.firstRow(username + 1)) username++;
+            if(columns.getUsername(username) != acct.getUsername() || columns.getDiscriminator(row) != acct.getDiscriminator()
+               || columns.hasNitro(row) != acct.hasNitro() || columns.getBadge(row) != acct.getBadge()
+               || columns.getStatus(row) != acct.getStatusView()) return false;
+            nitro += acct.hasNitro();
+            subscribers += acct.getBadge() == "Subscriber";
+            histogram[acct.getDiscriminator() / 1000]++;
+            row++;
+        }
+        if(row != columns.numRows() || username + 1 != columns.numUsernames()) return false;
+        if(columns.countNitro(0, row) != nitro || columns.countBadge("Subscriber", 0, row) != subscribers
+           || columns.countBadge("No such badge", 0, row) != 0 || columns.discHistogram(10, 0, row) != histogram) return false;
+
+        // Ranges that start and end inside a word or a vector of badges
+        for(size_t first : {(size_t) 0, (size_t) 3, (size_t) 64, (size_t) 70}){
+            for(size_t last : {first, first + 1, first + 63, first + 130, row - 5}){
+                if(last < first) continue;
+                long rowNitro = 0, rowSubscribers = 0;
+                for(size_t i = first; i < last; i++){
+                    rowNitro += columns.hasNitro(i);
+                    rowSubscribers += columns.getBadge(i) == "Subscriber";
+                }
+                if(columns.countNitro(first, last) != rowNitro || columns.countBadge("Subscriber", first, last) != rowSubscribers) return false;
+            }
+        }
+        std::vector<long> fine = columns.discHistogram(MAX_DISC + 1, 5, row);
+        long sum = 0;
+        for(long count : fine) sum += count;
+        if(sum != (long) row - 5 || fine[97 * 2] != 1 || fine[97] != 0) return false;
+
+        // Username ranges
+        std::pair<size_t, size_t> rows = columns.rowRange("columns", "columns_gone");
+        if(rows.second - rows.first != 69 || columns.getDiscriminator(rows.first) != 0 || columns.nitroRatio("columns", "columns_gone") != 18.0 / 69) return false;
+        rows = columns.rowRange("columns_gone", "columns_gonf");
+        if(rows.first != rows.second || columns.nitroRatio("z", "a") != 0 || columns.rowRange("", "~").second != row) return false;
+
+        if(engine == ENGINE_AVL){
+            utree.insert(Account("columns", 9999, true, "", ""));
+            AccountColumns copy(snapshot);
+            if(copy.numRows() != columns.numRows() || copy.countNitro(0, row) != nitro || copy._statuses != columns._statuses
+               || copy._usernames != columns._usernames) return false;
+        }
+    }
+    return true;
+}
+
+bool Tester::testAVLBalance() {
+    // Checks heights, balance, order and counts of a subtree, returns its height
+    bool valid = true;
+    std::function<int(UNode*, const string&, const string&)> check = [&](UNode* node, const string& low, const string& high) {
+        if(node == nullptr) return DEFAULT_HEIGHT - 1;
+        if(node->getUsername() <= low || (!high.empty() && node->getUsername() >= high)) valid = false;
+        int left = check(node->_left, low, node->getUsername());
+        int right = check(node->_right, node->getUsername(), high);
+        int accounts = node->getNumUsers() + (node->_left ? node->_left->_subtreeAccounts : 0) + (node->_right ? node->_right->_subtreeAccounts : 0);
+        if(node->getHeight() != 1 + std::max(left, right) || std::abs(left - right) > 1 || node->_subtreeAccounts != accounts) valid = false;
+        return node->getHeight();
+    };
+
+    // Usernames in increasing order are the worst case without rotations
+    UTree utree;
+    utree.enableHashIndex();
+    utree.enableFilter(4096);
+    utree.enableLookupCache();
+    utree.enableBitmapIndex();
+    std::vector<string> names;
+    for(int i = 0; i < 4000; i++){
+        char name[16];
+        snprintf(name, sizeof(name), "avl_%05d", i);
+        names.push_back(name);
+        utree.insert(Account(name, 1, i % 2 == 0, "", ""));
+        if(i % 4 == 0) utree.insert(Account(name, 2, false, "", ""));
+    }
+    if(check(utree._root, "", "") > 17 || !valid || utree._numNodes != 4000) return false;
+
+    // Dropping the last account of a username drops its UNode from the tree and every index
+    UTreeSnapshot before = utree.snapshot();
+    DNode* removed = nullptr;
+    for(int i = 0; i < 4000; i += 3){
+        utree.retrieveUser(names[i], 1);
+        // removed is only valid until the next write, even when its UNode was dropped, so it is read at once
+        if(!utree.removeUser(names[i], 1, removed) || !removed->isVacant() || removed->getUsername() != names[i]) return false;
+    }
+    check(utree._root, "", "");
+    if(!valid || utree._numNodes != 4000 - 1334 + 334 || utree.numAccounts() != 4000 + 1000 - 1334) return false;
+    for(int i = 0; i < 4000; i++){
+        bool kept = i % 3 != 0 || i % 4 == 0;
+        DNode* acct = utree.retrieveUser(names[i], 1);
+        if((utree.retrieve(names[i]) != nullptr) != kept || (acct != nullptr && !acct->isVacant()) != (i % 3 != 0)) return false;
+    }
+    long nitro = 0;
+    utree.forEachNitro([&](const Account& acct) {nitro += acct.getDiscriminator() == 1;});
+    if(nitro != utree.countNitro() || nitro != 2000 - 667) return false;
+
+    // The snapshot still holds every username, and sees exactly the removals
+    if(before.retrieve(names[0]) == nullptr || before.numUsers(names[3]) != 1) return false;
+    if(UTreeSnapshot::diff(before, utree.snapshot(), [](ChangeType type, const Account&) {}) != 1334) return false;
+
+    // Emptied usernames leave the other engines as well
+    UTree btree(ENGINE_BTREE);
+    btree.insert(Account("gone", 1, false, "", ""));
+    btree.insert(Account("kept", 1, false, "", ""));
+    btree.removeUser("gone", 1, removed);
+    int usernames = 0;
+    for(const UNode& node : btree) usernames += node.getUsername() == "kept" ? 1 : 100;
+    return usernames == 1 && btree.retrieve("gone") == nullptr;
+}
+
+bool Tester::testMerge() {
+    // The live tree has accounts below and inside the range of the batch, and a snapshot
+    UTree live;
+    live.enableHashIndex();
+    live.enableLookupCache();
+    live.enableBitmapIndex();
+    for(int disc = 0; disc < 300; disc += 2) live.insert(Account("shared", disc, disc % 4 == 0, "", ""));
+    live.insert(Account("solo", 1, false, "", ""));
+    live.retrieveUser("shared", 100);
+    UTreeSnapshot before = live.snapshot();
+
+    UTree batch;
+    for(int disc = 200; disc < 500; disc += 5) batch.insert(Account("shared", disc, true, "", ""));
+    batch.insert(Account("solo", 2, true, "", ""));
+    batch.insert(Account("newcomer", 7, false, "", ""));
+    batch.insert(Account("newcomer", 3, true, "", ""));
+    batch.insert(Account("single", 9, false, "", ""));
+    // Ten of the discriminators are already taken
+    if(live.merge(batch) != 60 - 10 + 1 + 2 + 1 || batch.numAccounts() != 0 || batch.retrieve("shared") != nullptr) return false;
+    if(live.numAccounts() != 150 + 1 + 54 || live.numUsers("shared") != 200 || live.numUsers("newcomer") != 2) return false;
+    if(live.retrieveUser("shared", 210)->getAccount().hasNitro() || !live.retrieveUser("shared", 205)->getAccount().hasNitro()) return false;
+    // The cached account moved with the merge, the cache must not hand out the old node
+    if(live.retrieveUser("shared", 100) != live.retrieve("shared")->getDTree()->find(100)) return false;
+
+    // Aggregates, bitmaps and the snapshot all agree
+    if(live._root->_subtreeAccounts != live.numAccounts() || before.numUsers("shared") != 150 || before.retrieve("newcomer") != nullptr) return false;
+    long nitro = 0;
+    for(const Account& acct : live.accounts()) nitro += acct.hasNitro();
+    return nitro == live.countNitro() && nitro == 75 + 50 + 1 + 1;
+}
+
+bool Tester::testRemoveIf() {
+    // DTree: one pass marks the matches vacant, compaction drops every vacant node
+    DTree dtree;
+    dtree.enableBitmaps();
+    for(int disc = 0; disc < 1000; disc++) dtree.insert(Account("retention", disc, disc % 3 == 0, "", disc % 5 == 0 ? "" : "status"));
+    DNode* removed = nullptr;
+    dtree.remove(1, removed);
+    int visited = 0;
+    auto noStatus = [](const Account& acct) {return acct.getStatusView().empty();};
+    if(dtree.removeIf(noStatus, false, [&](const Account&) {visited++;}) != 200 || visited != 200) return false;
+    if(dtree.getNumUsers() != 799 || dtree.root()->getNumVacant() != 201 || dtree._nodes.size() != 1000) return false;
+    if(!dtree.retrieve(995)->isVacant() || dtree.getBitmaps()->nitro().cardinality() != 334 - 67) return false;
+    if(dtree.removeIf([](const Account& acct) {return acct.getDiscriminator() >= 900;}, true) != 80) return false;
+    if(dtree._nodes.size() != 719 || dtree.root()->getNumVacant() != 0 || dtree.retrieve(995) != nullptr || dtree.retrieve(2)->isVacant()) return false;
+
+    // UTree: the same removals as removeUser, in parallel, with every index kept up to date
+    for(UTreeEngine engine : {ENGINE_AVL, ENGINE_BTREE}){
+        UTree bulk(engine), single(engine);
+        for(UTree* utree : {&bulk, &single}){
+            utree->enableHashIndex();
+            utree->enableFilter(512);
+            utree->enableBitmapIndex();
+            utree->enableLookupCache();
+            for(int user = 0; user < 300; user++){
+                for(int disc = 0; disc < user % 7 + 1; disc++){
+                    utree->insert(Account("keep_" + std::to_string(user), disc, (user + disc) % 2 == 0, "", "status"));
+                }
+                utree->insert(Account("drop_" + std::to_string(user), 1, false, "", ""));
+            }
+            utree->retrieveUser("keep_5", 2);
+        }
+        UTreeSnapshot before;
+        if(engine == ENGINE_AVL) before = bulk.snapshot();
+        auto retention = [](const Account& acct) {return acct.getStatusView().empty() || !acct.hasNitro();};
+        std::vector<std::pair<string, int>> matches;
+        for(const Account& acct : single.accounts()){
+            if(retention(acct)) matches.push_back({acct.getUsername(), acct.getDiscriminator()});
+        }
+        for(auto& match : matches) single.removeUser(match.first, match.second, removed);
+
+        if(bulk.removeIf(retention, engine == ENGINE_AVL, 4) != (long) matches.size()) return false;
+        std::ostringstream left, right;
+        AccountExporter(left).exportTree(bulk);
+        AccountExporter(right).exportTree(single);
+        if(left.str() != right.str() || bulk.numAccounts() != single.numAccounts() || bulk._numNodes != single._numNodes) return false;
+        if(bulk.retrieve("drop_7") != nullptr || bulk.getHashIndex()->find("drop_7") != nullptr || bulk.countNitro() != single.countNitro()) return false;
+        if(bulk.retrieveUser("keep_5", 2) != nullptr && !bulk.retrieveUser("keep_5", 2)->isVacant()) return false;
+        if(engine == ENGINE_AVL){
+            if(bulk._root->_subtreeAccounts != bulk.numAccounts() || before.retrieve("drop_7") == nullptr || before.numUsers("keep_6") != 7) return false;
+        }
+    }
+    return true;
+}
+
+bool Tester::testTaskPool() {
+    // Tasks submitted from outside and from inside the pool all run before wait returns
+    TaskPool pool(4);
+    std::atomic<int> done(0);
+    for(int i = 0; i < 100; i++){
+        pool.submit([&]() {
+            done++;
+            pool.submit([&]() {done++;});
+        });
+    }
+    pool.wait();
+    if(pool.size() != 4 || done != 200) return false;
+
+    // The first exception reaches wait once every other task is done, and is only thrown once
+    done = 0;
+    for(int i = 0; i < 50; i++){
+        pool.submit([&, i]() {
+            if(i == 10) throw std::runtime_error("task");
+            done++;
+        });
+    }
+    bool thrown = false;
+    try {
+        pool.wait();
+    } catch(const std::runtime_error&) {
+        thrown = true;
+    }
+    pool.wait();
+    if(!thrown || done != 49) return false;
+
+    // parallelFor covers every position once, even when a few positions hold most of the cost
+    for(int threads : {1, 3}){
+        TaskPool sized(threads);
+        std::vector<long> cost;
+        long total = 0;
+        for(int i = 0; i < 1000; i++){
+            total += i % 100 == 0 ? 10000 : 1;
+            cost.push_back(total);
+        }
+        std::vector<int> visits(1000, 0);
+        std::atomic<int> runs(0);
+        sized.parallelFor(visits.size(), [&](size_t first, size_t last) {
+            runs++;
+            for(size_t i = first; i < last; i++) visits[i]++;
+        }, cost);
+        if(std::count(visits.begin(), visits.end(), 1) != 1000 || runs < 10) return false;
+        sized.parallelFor(0, [&](size_t, size_t) {runs = -1;});
+        if(runs < 0) return false;
+    }
+
+    // Compacting every DTree in parallel leaves the accounts alone and the snapshot untouched
+    UTree utree;
+    utree.enableLookupCache();
+    for(int user = 0; user < 40; user++){
+        for(int disc = 0; disc < (user % 8 == 0 ? 2000 : user + 1); disc++){
+            utree.insert(Account("pool_" + std::to_string(user), disc, false, "", "status"));
+        }
+    }
+    DNode* removed = nullptr;
+    for(int disc = 0; disc < 2000; disc += 3) utree.removeUser("pool_8", disc, removed);
+    utree.retrieveUser("pool_8", 4);
+    UTreeSnapshot before = utree.snapshot();
+    std::ostringstream expected, actual;
+    AccountExporter(expected).exportTree(utree);
+    std::atomic<int> dtrees(0);
+    utree.parallelForEachDTree([&](DTree& dtree) {
+        dtree.compact();
+        dtrees++;
+    }, pool);
+    AccountExporter(actual).exportTree(utree);
+    if(expected.str() != actual.str() || dtrees != 40) return false;
+    if(utree.retrieve("pool_8")->_dtree->root()->getNumVacant() != 0 || utree.retrieveUser("pool_8", 4) == nullptr) return false;
+    if(utree.retrieveUser("pool_8", 3) != nullptr || before.retrieve("pool_8")->_dtree->root()->getNumVacant() != 667) return false;
+    return true;
+}
+
+bool Tester::testReclaimer() {
+    // Reloading hands the old nodes to the reclaimer, the reloaded tree matches a fresh load
+    Reclaimer& reclaimer = Reclaimer::global();
+    for(UTreeEngine engine : {ENGINE_AVL, ENGINE_BTREE, ENGINE_ART}){
+        UTree fresh(engine), reloaded(engine);
+        fresh.loadData("accounts.csv");
+        reloaded.loadData("accounts.csv");
+        reloaded.insert(Account("reclaimed", 1, false, "", ""));
+        reclaimer.drain();
+        long before = reclaimer.reclaimed();
+        reloaded.loadData("accounts.csv", false);
+        std::ostringstream expected, actual;
+        AccountExporter(expected).exportTree(fresh);
+        AccountExporter(actual).exportTree(reloaded);
+        if(expected.str() != actual.str() || reloaded.retrieve("reclaimed") != nullptr) return false;
+        reclaimer.drain();
+        if(reclaimer.reclaimed() - before != reloaded._numNodes + 1) return false;
+    }
+
+    // A snapshot keeps the nodes it shares until it is released, the rest go right away
+    UTree utree;
+    for(int user = 0; user < 2000; user++){
+        for(int disc = 0; disc < user % 4 + 1; disc++) utree.insert(Account("gone_" + std::to_string(user), disc, false, "", ""));
+    }
+    UTreeSnapshot snapshot = utree.snapshot();
+    utree.insert(Account("gone_0", 9, false, "", ""));
+    reclaimer.drain();
+    long before = reclaimer.reclaimed();
+    utree.clear();
+    if(utree.numAccounts() != 0 || utree.retrieve("gone_5") != nullptr || !utree.insert(Account("gone_5", 1, false, "", ""))) return false;
+    reclaimer.drain();
+    // Only the copied path of gone_0 belonged to the tree alone
+    long copied = reclaimer.reclaimed() - before;
+    if(copied < 1 || copied > 20 || snapshot.numUsers("gone_7") != 4 || snapshot.numUsers("gone_0") != 1) return false;
+
+    // Destroying a tree frees its nodes at once, a static UTree may outlive the reclaimer
+    {
+        UTree temporary;
+        for(int user = 0; user < 500; user++) temporary.insert(Account("temp_" + std::to_string(user), 1, false, "", ""));
+        reclaimer.drain();
+        before = reclaimer.reclaimed();
+    }
+    reclaimer.drain();
+    return reclaimer.reclaimed() == before;
+}
+
 int main() {
     Tester tester;
 
@@ -84,6 +1341,41 @@ int main() {
     dtree.dump();
     cout << endl;
 
+    cout << "Testing DTree freeze...";
+    if(tester.testDTreeFreeze(dtree)){
+        cout << "test passed" << endl;
+    }else{
+        cout << "test failed" << endl;
+    }
+
+    cout << "Testing DTree storage...";
+    if(tester.testDTreeStorage()){
+        cout << "test passed" << endl;
+    }else{
+        cout << "test failed" << endl;
+    }
+
+    cout << "Testing DTree balance...";
+    if(tester.testDTreeBalance()){
+        cout << "test passed" << endl;
+    }else{
+        cout << "test failed" << endl;
+    }
+
+    cout << "Testing tree core...";
+    if(tester.testTreeCore()){
+        cout << "test passed" << endl;
+    }else{
+        cout << "test failed" << endl;
+    }
+
+    cout << "Testing DTree split and join...";
+    if(tester.testSplitJoin()){
+        cout << "test passed" << endl;
+    }else{
+        cout << "test failed" << endl;
+    }
+
     /* Basic UTree tests */
     UTree utree;
 
@@ -98,5 +1390,152 @@ int main() {
     utree.dump();
     cout << endl;
 
+    cout << "Testing UTree export...";
+    if(tester.testExport(utree)) {
+        cout << "test passed" << endl;
+    } else {
+        cout << "test failed" << endl;
+    }
+
+    cout << "Testing UTree B-tree engine...";
+    if(tester.testBTreeEngine(utree)) {
+        cout << "test passed" << endl;
+    } else {
+        cout << "test failed" << endl;
+    }
+
+    cout << "Testing UTree hash index...";
+    if(tester.testHashIndex(utree)) {
+        cout << "test passed" << endl;
+    } else {
+        cout << "test failed" << endl;
+    }
+
+    cout << "Testing UTree ART engine...";
+    if(tester.testARTEngine(utree)) {
+        cout << "test passed" << endl;
+    } else {
+        cout << "test failed" << endl;
+    }
+
+    cout << "Testing UTree username filter...";
+    if(tester.testUsernameFilter()) {
+        cout << "test passed" << endl;
+    } else {
+        cout << "test failed" << endl;
+    }
+
+    cout << "Testing UTree lookup cache...";
+    if(tester.testLookupCache()) {
+        cout << "test passed" << endl;
+    } else {
+        cout << "test failed" << endl;
+    }
+
+    cout << "Testing UTree inline accounts...";
+    if(tester.testInlineAccounts()) {
+        cout << "test passed" << endl;
+    } else {
+        cout << "test failed" << endl;
+    }
+
+    cout << "Testing compact accounts...";
+    if(tester.testCompactAccount()) {
+        cout << "test passed" << endl;
+    } else {
+        cout << "test failed" << endl;
+    }
+
+    cout << "Testing status arena...";
+    if(tester.testStatusArena()) {
+        cout << "test passed" << endl;
+    } else {
+        cout << "test failed" << endl;
+    }
+
+    cout << "Testing UTree snapshot...";
+    if(tester.testSnapshot()) {
+        cout << "test passed" << endl;
+    } else {
+        cout << "test failed" << endl;
+    }
+
+    cout << "Testing UTree snapshot diff...";
+    if(tester.testSnapshotDiff()) {
+        cout << "test passed" << endl;
+    } else {
+        cout << "test failed" << endl;
+    }
+
+    cout << "Testing UTree iterators...";
+    if(tester.testIterators()) {
+        cout << "test passed" << endl;
+    } else {
+        cout << "test failed" << endl;
+    }
+
+    cout << "Testing UTree aggregates...";
+    if(tester.testAggregates()) {
+        cout << "test passed" << endl;
+    } else {
+        cout << "test failed" << endl;
+    }
+
+    cout << "Testing UTree bitmap index...";
+    if(tester.testBitmapIndex()) {
+        cout << "test passed" << endl;
+    } else {
+        cout << "test failed" << endl;
+    }
+
+    cout << "Testing UTree columns...";
+    if(tester.testColumns()) {
+        cout << "test passed" << endl;
+    } else {
+        cout << "test failed" << endl;
+    }
+
+    cout << "Testing UTree AVL balance...";
+    if(tester.testAVLBalance()) {
+        cout << "test passed" << endl;
+    } else {
+        cout << "test failed" << endl;
+    }
+
+    cout << "Testing UTree merge...";
+    if(tester.testMerge()) {
+        cout << "test passed" << endl;
+    } else {
+        cout << "test failed" << endl;
+    }
+
+    cout << "Testing UTree removeIf...";
+    if(tester.testRemoveIf()) {
+        cout << "test passed" << endl;
+    } else {
+        cout << "test failed" << endl;
+    }
+
+    cout << "Testing TaskPool...";
+    if(tester.testTaskPool()) {
+        cout << "test passed" << endl;
+    } else {
+        cout << "test failed" << endl;
+    }
+
+    cout << "Testing Reclaimer...";
+    if(tester.testReclaimer()) {
+        cout << "test passed" << endl;
+    } else {
+        cout << "test failed" << endl;
+    }
+
+    cout << "Testing UTree profile...";
+    if(tester.testTreeProfile(utree)) {
+        cout << "test passed" << endl;
+    } else {
+        cout << "test failed" << endl;
+    }
+
     return 0;
 }
\ No newline at end of file
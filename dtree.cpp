@@ -6,12 +6,56 @@
  */
 
 #include "dtree.h"
+#include "bitmapindex.h"
+#include <algorithm>
+#include <mutex>
+
+/* Hooks of the core insert. A vacant node on the path takes the account if it fits, otherwise a
+ * new leaf is allocated. Nodes are checked on the way back up, so the last unbalanced one found is
+ * the highest. */
+struct DTree::InsertHooks : TreeCore<DNodeTraits>::InPlace {
+    DTree& tree;
+    const Account& newAcct;
+    DNode* scapegoat;   // Highest node on the path that checkImbalance rejects, nullptr if there is none
+
+    InsertHooks(DTree& tree, const Account& newAcct): tree(tree), newAcct(newAcct), scapegoat(nullptr) {}
+
+    bool absorb(DNode* node) {
+        if(!node->isVacant() || !fitsVacant(node, newAcct._disc)) return false;
+        // Reuses the vacant node
+        node->_account = newAcct;
+        node->setVacant(false);
+        tree._generation++;
+        return true;
+    }
+
+    DNode* create() {return tree.allocate(newAcct);}
+
+    DNode* leave(DNode* node) {
+        if(tree.checkImbalance(node)) scapegoat = node;
+        return node;
+    }
+};
+
+/* Hooks of the core erase. The node found is only marked vacant, the vacant counts are
+ * recomputed on the way back up. */
+struct DTree::RemoveHooks : TreeCore<DNodeTraits>::InPlace {
+    DNode* removed = nullptr;   // Node of the removed account
+
+    DNode* erase(DNode* node) {
+        removed = node;
+        node->setVacant(true);
+        DNodeTraits::augment(node);
+        return node;
+    }
+};
 
 /**
  * Destructor, deletes all dynamic memory.
  */
 DTree::~DTree() {
     clear();
+    delete _bitmaps;
 }
 
 /**
@@ -20,7 +64,14 @@ DTree::~DTree() {
  * @return Deep copy of rhs
  */
 DTree& DTree::operator=(const DTree& rhs) {
-    AssistCopy(_root, this->_root);
+    if(this != &rhs){
+        clear();
+        // Child links are relative, so copying the node array copies the tree
+        _nodes = rhs._nodes;
+        _balance = rhs._balance;
+        delete _bitmaps;
+        _bitmaps = rhs._bitmaps == nullptr ? nullptr : new AccountBitmaps(*rhs._bitmaps);
+    }
     // Returns a pointer to a DTree object
     return* this;
 }
@@ -34,15 +85,24 @@ DTree& DTree::operator=(const DTree& rhs) {
  */
 bool DTree::insert(Account newAcct) {
     // If statement to determine that a node of that discriminator doesn't exist
-    if(_root == nullptr){
+    if(_nodes.empty()){
         // This code should run only for the creation of a new tree
-        _root = new DNode(newAcct);
+        reserveNode();
+        allocate(newAcct);
+        if(_bitmaps != nullptr) _bitmaps->add(newAcct._disc, newAcct._nitro, newAcct._badge);
         return true;
-    }else if(retrieve(newAcct._disc) == nullptr){
-        // This function is recursive, and will navigate to the next open node
-
-            // Evaluates the AssistInsert to determine whether a new node or old node was used
-            AssistInsert(_root, newAcct);
+    }else if(AssistRetrieve(root(), newAcct._disc) == nullptr){
+        newAcct.shareUsername(root()->_account);
+        // The node layout is about to change
+        thaw();
+        // The array must not move while the descent holds pointers into it
+        reserveNode();
+        // The core insert is recursive, and will navigate to the next open node
+        InsertHooks hooks(*this, newAcct);
+        Core::insert(root(), newAcct._disc, hooks);
+        // Only the highest unbalanced subtree is rebuilt, which also balances everything below it
+        if(hooks.scapegoat != nullptr) rebalance(hooks.scapegoat);
+        if(_bitmaps != nullptr) _bitmaps->add(newAcct._disc, newAcct._nitro, newAcct._badge);
         // Return True at function completion
         return true;
     }else{
@@ -58,52 +118,288 @@ bool DTree::insert(Account newAcct) {
  * @return true if an account was removed, false otherwise
  */
 bool DTree::remove(int disc, DNode*& removed) {
+    // Removal only marks a node vacant, so a frozen layout stays valid
     if(retrieve(disc) == nullptr){
         // Check for the existence of the node, and then delete.
         return false;
     }else{
-        AssistRemove(_root, disc, removed);
+        RemoveHooks hooks;
+        Core::erase(root(), disc, hooks);
+        removed = hooks.removed;
+        if(_bitmaps != nullptr) _bitmaps->remove(disc, removed->_account._nitro, removed->_account._badge);
         return true;
     }
 }
 
+/**
+ * Removes every account matching a predicate in one traversal. Matching nodes are marked vacant
+ * like remove does, so a frozen layout stays valid. Compacting afterwards rebuilds the tree
+ * without any vacant node, which moves the accounts to other nodes.
+ * @param predicate true for an account to remove
+ * @param compact true to drop the vacant nodes afterwards
+ * @param visit function called with every removed account, may be empty
+ * @return number of accounts removed
+ */
+int DTree::removeIf(const std::function<bool(const Account&)>& predicate, bool compact,
+                    const std::function<void(const Account&)>& visit) {
+    if(_nodes.empty()){
+        return 0;
+    }
+    int removed = AssistRemoveIf(root(), predicate, visit);
+    if(compact) this->compact();
+    return removed;
+}
+
+/**
+ * Rebuilds the tree, perfectly balanced, without its vacant nodes. Accounts move to other nodes,
+ * so DNode pointers into the tree become invalid. A tree without accounts ends up empty.
+ */
+void DTree::compact() {
+    if(_nodes.empty() || root()->_numVacant == 0){
+        return;
+    }
+    std::vector<DNode> kept;
+    kept.reserve(getNumUsers());
+    for(const Account& acct : *this) kept.emplace_back(acct);
+    fill(kept);
+}
+
 /**
  * Retrieves the specified Account within a DNode.
  * @param disc discriminator int to search for
  * @return DNode with a matching discriminator, nullptr otherwise
  */
 DNode* DTree::retrieve(int disc) {
+    if(isFrozen()){
+        return FrozenRetrieve(disc);
+    }
+    if(_nodes.empty()){
+        return nullptr;
+    }
+    // Trees that keep being read without writes switch to the frozen layout
+    if(++_readsSinceWrite >= FREEZE_AFTER_READS && _nodes.size() >= FREEZE_MIN_SIZE){
+        freeze();
+        return FrozenRetrieve(disc);
+    }
     // Uses the retrieve helper to allow for the retrieve to be done recursively
-    return AssistRetrieve(_root, disc);
+    return AssistRetrieve(root(), disc);
+}
+
+/**
+ * Finds the DNode of a discriminator, vacant or not, without freezing the tree or counting the
+ * read. Nothing is written, so a DTree shared with snapshots can be searched from any thread.
+ * @param disc discriminator int to search for
+ * @return DNode with a matching discriminator, nullptr otherwise
+ */
+const DNode* DTree::find(int disc) const {
+    const DNode* node = root();
+    while(node != nullptr && node->_account._disc != disc){
+        node = node->_account._disc > disc ? node->left() : node->right();
+    }
+    return node;
+}
+
+/**
+ * Counts the accounts ordered before a discriminator in O(height), using the subtree sizes and
+ * vacant counts every node keeps.
+ * @param disc discriminator to rank, it need not exist
+ * @return number of non-vacant accounts with a smaller discriminator
+ */
+int DTree::rank(int disc) const {
+    int below = 0;
+    const DNode* node = root();
+    while(node != nullptr){
+        if(node->_account._disc < disc){
+            const DNode* left = node->left();
+            if(left != nullptr) below += left->getSize() - left->_numVacant;
+            if(!node->isVacant()) below++;
+            node = node->right();
+        }else{
+            node = node->left();
+        }
+    }
+    return below;
+}
+
+/**
+ * Returns an iterator to the account with the smallest discriminator.
+ * @return iterator to the first non-vacant account, end() if there is none
+ */
+DTree::const_iterator DTree::begin() const {
+    const_iterator it(this);
+    for(const DNode* node = root(); node != nullptr; node = node->left()){
+        it._path.push_back(node);
+    }
+    if(!it._path.empty() && it._path.back()->isVacant()) ++it;
+    return it;
+}
+
+/**
+ * Finds the first account whose discriminator is not less than disc in O(height).
+ * @param disc discriminator to search for
+ * @return iterator to the first non-vacant account with a discriminator >= disc, end() if there is none
+ */
+DTree::const_iterator DTree::lower_bound(int disc) const {
+    const_iterator it(this);
+    size_t found = 0;   // Length of the path to the best candidate so far
+    const DNode* node = root();
+    while(node != nullptr){
+        it._path.push_back(node);
+        if(node->_account._disc == disc){
+            found = it._path.size();
+            break;
+        }
+        if(node->_account._disc > disc){
+            found = it._path.size();
+            node = node->left();
+        }else{
+            node = node->right();
+        }
+    }
+    it._path.resize(found);
+    if(!it._path.empty() && it._path.back()->isVacant()) ++it;
+    return it;
+}
+
+/**
+ * Moves to the next non-vacant account.
+ * @return this iterator
+ */
+DTree::const_iterator& DTree::const_iterator::operator++() {
+    do {
+        step(true);
+    } while(!_path.empty() && _path.back()->isVacant());
+    return *this;
+}
+
+/**
+ * Moves to the previous non-vacant account, end() moves to the last account.
+ * @return this iterator
+ */
+DTree::const_iterator& DTree::const_iterator::operator--() {
+    do {
+        step(false);
+    } while(!_path.empty() && _path.back()->isVacant());
+    return *this;
+}
+
+/**
+ * Moves to the in-order successor or predecessor using the path from the root. Stepping past
+ * either end gives end(), stepping back from end() gives the last node.
+ * @param forward true for the successor, false for the predecessor
+ */
+void DTree::const_iterator::step(bool forward) {
+    if(_path.empty()){
+        if(forward) return;
+        for(const DNode* node = _tree->root(); node != nullptr; node = node->right()){
+            _path.push_back(node);
+        }
+        return;
+    }
+    const DNode* node = forward ? _path.back()->right() : _path.back()->left();
+    if(node != nullptr){
+        // The neighbour is the nearest node of the subtree on that side
+        while(node != nullptr){
+            _path.push_back(node);
+            node = forward ? node->left() : node->right();
+        }
+        return;
+    }
+    // Otherwise the first ancestor reached from its other side
+    const DNode* child;
+    do {
+        child = _path.back();
+        _path.pop_back();
+    } while(!_path.empty() && (forward ? _path.back()->right() : _path.back()->left()) == child);
 }
 
 /**
  * Helper for the destructor to clear dynamic memory.
  */
 void DTree::clear() {
-    // Recursive Deletion of the tree starting at the _root
-    AssistClear(_root);
-    _root = nullptr;
+    thaw();
+    // Cached DNode pointers must not outlive the nodes
+    _generation++;
+    // Frees the node array rather than only emptying it
+    std::vector<DNode>().swap(_nodes);
+    if(_bitmaps != nullptr) _bitmaps->clear();
+}
+
+/**
+ * Builds the nitro and badge bitmaps from the non-vacant accounts, insert and remove keep them
+ * up to date from then on.
+ */
+void DTree::enableBitmaps() {
+    if(_bitmaps != nullptr){
+        return;
+    }
+    _bitmaps = new AccountBitmaps();
+    for(const Account& acct : *this) _bitmaps->add(acct._disc, acct._nitro, acct._badge);
+}
+
+/**
+ * Drops the nitro and badge bitmaps.
+ */
+void DTree::disableBitmaps() {
+    delete _bitmaps;
+    _bitmaps = nullptr;
+}
+
+/**
+ * Builds the read optimized layout: every discriminator in Eytzinger (BFS) order in one contiguous
+ * array, with the nodes in a parallel array so retrieve still returns the same DNode pointers.
+ * The linked nodes are kept, the layout is dropped again by the next structural write.
+ */
+void DTree::freeze() {
+    thaw();
+    if(_nodes.empty()) return;
+
+    std::vector<DNode*> sorted;
+    sorted.reserve(_nodes.size());
+    TreeCore<DNodeTraits>::collect(root(), sorted);
+    // A vacant node refilled by insert can sit out of order, so the order is not assumed
+    std::sort(sorted.begin(), sorted.end(), [](DNode* first, DNode* second) {
+        return first->_account._disc < second->_account._disc;
+    });
+
+    // Index 0 is unused so the children of index k are 2k and 2k + 1
+    _frozenDiscs.resize(sorted.size() + 1);
+    _frozenNodes.resize(sorted.size() + 1);
+    _frozenDiscs[0] = INVALID_DISC;
+    _frozenNodes[0] = nullptr;
+    AssistFreeze(sorted, 0, 1);
+}
+
+/**
+ * Drops the read optimized layout, called before every structural write.
+ */
+void DTree::thaw() {
+    _readsSinceWrite = 0;
+    if(isFrozen()){
+        std::vector<int>().swap(_frozenDiscs);
+        std::vector<DNode*>().swap(_frozenNodes);
+    }
 }
 
 /**
  * Prints all accounts' details within the DTree.
+ * @param sout stream to print to, flushed once at the end
  */
-void DTree::printAccounts() const {
+void DTree::printAccounts(ostream& sout) const {
     // Inorder Traversal Function
-    AssistPrint(_root, 0);
+    if(!_nodes.empty()) AssistPrint(root(), sout, 0);
+    sout.flush();
 }
 
 /**
  * Dump the DTree in the '()' notation.
+ * @param node root of the subtree to dump
+ * @param sout stream to dump to
  */
-void DTree::dump(DNode* node) const {
-    if(node == nullptr) return;
-    cout << "(";
-    dump(node->_left);
-    cout << node->getAccount().getDiscriminator() << ":" << node->getSize() << ":" << node->getNumVacant();
-    dump(node->_right);
-    cout << ")";
+void DTree::dump(DNode* node, ostream& sout) const {
+    Core::dump(node, sout, [&](DNode* label) {
+        sout << label->_account._disc << ":" << label->getSize() << ":" << label->_numVacant;
+    });
 }
 
 /**
@@ -112,7 +408,7 @@ void DTree::dump(DNode* node) const {
  */
 int DTree::getNumUsers() const {
     // Return the number of non vacant nodes
-    return _root->_size - _root->_numVacant;
+    return root()->getSize() - root()->_numVacant;
 }
 
 /**
@@ -121,18 +417,18 @@ int DTree::getNumUsers() const {
  */
 void DTree::updateSize(DNode* node) {
     // Combines the value of Right and Left node _size for the new value
-    if(node->_right == nullptr){
-        if(node->_left == nullptr){
-            node->_size = DEFAULT_SIZE;
+    if(node->right() == nullptr){
+        if(node->left() == nullptr){
+            node->setSize(DEFAULT_SIZE);
         }else{
-            node->_size = node->_left->_size + DEFAULT_SIZE;
+            node->setSize(node->left()->getSize() + DEFAULT_SIZE);
         }
 
-    }else if(node->_left == nullptr){
-        node->_size = node->_right->_size + DEFAULT_SIZE;
+    }else if(node->left() == nullptr){
+        node->setSize(node->right()->getSize() + DEFAULT_SIZE);
 
     }else{
-        node->_size = node->_right->_size + node->_left->_size + DEFAULT_SIZE;
+        node->setSize(node->right()->getSize() + node->left()->getSize() + DEFAULT_SIZE);
     }
 }
 
@@ -141,63 +437,24 @@ void DTree::updateSize(DNode* node) {
  * @param node DNode object in which the number of vacant nodes in the subtree will be updated
  */
 void DTree::updateNumVacant(DNode* node) {
-    if(node->_right == nullptr && node->_left == nullptr){
-        if(node->isVacant()){
-            node->_numVacant = 1;
-        }else{
-            node->_numVacant = 0;
-        }
+    // The node itself counts as well as both of its subtrees
+    node->_numVacant = node->isVacant() ? 1 : 0;
+    if(node->left() != nullptr){
+        node->_numVacant += node->left()->_numVacant;
     }
-    else if(node->_right == nullptr){
-        // Handles only Left when Right doesn't exist
-        node->_numVacant = node->_left->_numVacant;
-    }else if(node->_left == nullptr){
-        // Handles only Right when Left doesn't exist
-        node->_numVacant = node->_right->_numVacant;
-    }else{
-        // Handles the existence of a left and right node
-        node->_numVacant = node->_left->_numVacant + node->_right->_numVacant;
+    if(node->right() != nullptr){
+        node->_numVacant += node->right()->_numVacant;
     }
 }
 
 /**
- * Checks for an imbalance, defined by 'Discord' rules, at the specified node.
- * @param checkImbalance DNode object to inspect for an imbalance
- * @return (can change) returns true if an imbalance occured, false otherwise
+ * Checks for an imbalance at the specified node: a child holding more than alpha of the nodes of
+ * the subtree, vacant nodes included.
+ * @param node DNode object to inspect for an imbalance
+ * @return true if an imbalance occured, false otherwise
  */
 bool DTree::checkImbalance(DNode* node) {
-    int leftVal = 1;
-    int rightVal = 1;
-
-    if(node->_left != nullptr){
-        leftVal = node->_left->_size;
-    }
-    if(node->_right != nullptr){
-        rightVal = node->_right->_size;
-    }
-
-    if(rightVal > leftVal){
-        // If the right value is more than 50% greater than the left value
-        if(rightVal > (leftVal * 2)-leftVal){
-            // Right Imbalance Exists
-            return true;
-        }else{
-            // No Imbalance Exists
-            return false;
-        }
-    }else if(leftVal > rightVal){
-        // If the left value is more than 50% greater than the right value
-        if(leftVal > (rightVal * 2)-rightVal){
-            // Left Imbalance Exists
-            return true;
-        }else{
-            // No Imbalance Exists
-            return false;
-        }
-    }else{
-        // Left and Right are the same size
-        return false;
-    }
+    return _balance.unbalanced(node);
 }
 
 //----------------
@@ -212,53 +469,198 @@ bool DTree::checkImbalance(DNode* node) {
 // -- OR --
 
 /**
- * Begins and manages the rebalancing process for a 'Discord' tree (returns a pointer).
+ * Rebuilds a subtree into a perfectly balanced one. The subtree keeps its nodes and its root node,
+ * only the accounts move between them, so the link from the parent stays valid. A subtree of s
+ * nodes costs O(s) and is only rebuilt after Omega(s) inserts below it, so inserts stay O(log n)
+ * amortized.
  * @param node DNode root of the subtree to balance
- * @return DNode root of the balanced subtree
+ * @return DNode root of the balanced subtree, node itself
  */
 DNode* DTree::rebalance(DNode* node) {
-    DNode* tempRoot = _root; // A Node to act as the new _root
-    if(!checkImbalance(node)){
-        int ArrayMid; // Value to hold
-        //int ArraySize = node->_size; // This holds the potential size of the array
-        int ArraySize = node->_size;
-
-        // Creates an account array to
-        Account* AccArray;
-        AccArray = new Account [ArraySize];
+    thaw();
+    std::vector<DNode*> slots;
+    TreeCore<DNodeTraits>::collect(node, slots);
+    std::vector<DNode> sorted;
+    sorted.reserve(slots.size());
+    for(DNode* slot : slots) sorted.push_back(*slot);
 
-        // Moves the members of the tree to an array of accounts to assist in sorting
-        AssistRebalance(node, 0, AccArray);
+    // Slots are handed out in pre-order, so the first one becomes the subtree root
+    std::swap(*std::find(slots.begin(), slots.end(), node), slots[0]);
+    size_t next = 0;
+    TreeCore<DNodeTraits>::build(sorted, 0, sorted.size() - 1, slots, next);
+    // Nodes now hold other accounts
+    _generation++;
+    return node;
+}
+//----------------
 
-        // Sorts the Array of accounts based on the discriminator
-        AssistSort(AccArray,0,ArraySize-1);
+/**
+ * Sets the weight balance bound. A tidier bound gives shorter paths for more rebuilding.
+ * @param alpha largest share of a subtree one child may hold, in (0.5, 1]
+ */
+void DTree::setAlpha(double alpha) {
+    if(!(alpha > 0.5 && alpha <= 1)){
+        throw std::out_of_range("DTree alpha must be in (0.5, 1]");
+    }
+    _balance.alpha = alpha;
+}
 
-        // Determine the middle value of the
-        if(ArraySize % 2 == 1){
-            ArrayMid = (ArraySize - 1)/ 2;
-        }else{
-            ArrayMid = ArraySize / 2;
+/**
+ * Moves every account of other into this tree. All of other's discriminators must be smaller, or
+ * all larger, than this tree's. The edge node of other next to this tree becomes the parent of
+ * both, and is linked on the spine of the heavier tree where the lighter one fits under alpha, so
+ * only that spine is relinked. Other's nodes are appended to the node array as one block, their
+ * relative links stay valid. other is left empty.
+ * @param other tree to take the accounts of
+ */
+void DTree::join(DTree&& other) {
+    if(&other == this || other._nodes.empty()){
+        return;
+    }
+    bool above = true;
+    if(!_nodes.empty()){
+        above = edge(other.root(), true)->_account._disc > edge(root(), false)->_account._disc;
+        if(!above && edge(other.root(), false)->_account._disc >= edge(root(), true)->_account._disc){
+            throw std::invalid_argument("Joined DTrees must not have interleaving discriminators");
         }
+    }
+    thaw();
+    if(_bitmaps != nullptr){
+        for(const Account& acct : other) _bitmaps->add(acct._disc, acct._nitro, acct._badge);
+    }
+    _generation++;
+    if(_nodes.empty()){
+        _nodes.swap(other._nodes);
+        other.clear();
+        return;
+    }
 
-        // Clear existing tree after creation of the new tree
-        clear();
+    size_t base = _nodes.size();
+    _nodes.reserve(base + other._nodes.size());
+    _nodes.insert(_nodes.end(), other._nodes.begin(), other._nodes.end());
+    other.clear();
+    for(size_t i = base; i < _nodes.size(); i++) _nodes[i]._account.shareUsername(_nodes[0]._account);
+    DNode* block = &_nodes[base];
+    DNode* pivot = detachEdge(block, above);
+    moveToFront(above ? AssistJoin(root(), pivot, block) : AssistJoin(block, pivot, root()));
+}
 
-        // Sets the root to be
-        insert(AccArray[ArrayMid]);
-        tempRoot = _root;
+/**
+ * Moves every account with a discriminator of at least disc into upper. The search path for disc
+ * is cut in two and each side keeps the subtrees hanging off it, then the highest node of either
+ * side breaking the balance rule is rebuilt. Both sides are copied into node arrays of their own.
+ * @param disc smallest discriminator that moves
+ * @param upper empty tree taking the larger discriminators
+ */
+void DTree::split(int disc, DTree& upper) {
+    if(&upper == this || !upper._nodes.empty()){
+        throw std::invalid_argument("DTree split needs an empty tree for the larger discriminators");
+    }
+    thaw();
+    upper._balance = _balance;
+    if(_nodes.empty()){
+        return;
+    }
+
+    // Path nodes smaller than disc chain through their right links, the others through their left links
+    std::vector<DNode*> lower, higher;
+    for(DNode* node = root(); node != nullptr;){
+        if(node->_account._disc < disc){
+            if(!lower.empty()) lower.back()->setRight(node);
+            lower.push_back(node);
+            node = node->right();
+        }else{
+            if(!higher.empty()) higher.back()->setLeft(node);
+            higher.push_back(node);
+            node = node->left();
+        }
+    }
+    if(!lower.empty()) lower.back()->setRight(nullptr);
+    if(!higher.empty()) higher.back()->setLeft(nullptr);
+    for(std::vector<DNode*>* path : {&lower, &higher}){
+        DNode* scapegoat = nullptr;
+        for(auto it = path->rbegin(); it != path->rend(); ++it){
+            DNodeTraits::augment(*it);
+            if(checkImbalance(*it)) scapegoat = *it;
+        }
+        if(scapegoat != nullptr) rebalance(scapegoat);
+    }
 
-        // First Half of the insert
-        Recreate(AccArray, tempRoot, 0, ArrayMid-1);
+    if(!higher.empty()){
+        upper._nodes.reserve(higher[0]->getSize());
+        AssistCopy(higher[0], upper._nodes);
+        upper._generation++;
+        if(_bitmaps != nullptr || upper._bitmaps != nullptr){
+            if(upper._bitmaps == nullptr) upper._bitmaps = new AccountBitmaps();
+            for(const Account& acct : upper){
+                upper._bitmaps->add(acct._disc, acct._nitro, acct._badge);
+                if(_bitmaps != nullptr) _bitmaps->remove(acct._disc, acct._nitro, acct._badge);
+            }
+        }
+    }
+    std::vector<DNode> kept;
+    if(!lower.empty()){
+        kept.reserve(lower[0]->getSize());
+        AssistCopy(lower[0], kept);
+    }
+    _nodes.swap(kept);
+    _generation++;
+}
 
-        // Second Half of the insert
-        Recreate(AccArray, tempRoot, ArrayMid+1, ArraySize-1);
+/**
+ * Adds every account of other whose discriminator this tree does not hold yet. Trees covering
+ * separate ranges are joined. Otherwise this tree is split around the range other covers, that
+ * range is merged in one ordered pass and rebuilt balanced, and the three parts are joined back.
+ * Vacant accounts of other are dropped by the ordered pass, a joined tree keeps them vacant.
+ * other is left empty.
+ * @param other tree to take the accounts of
+ * @param visit function called with every account added, may be empty
+ * @return number of accounts added
+ */
+int DTree::merge(DTree&& other, const std::function<void(const Account&)>& visit) {
+    if(&other == this || other._nodes.empty()){
+        return 0;
+    }
+    int first = edge(other.root(), true)->_account._disc;
+    int last = edge(other.root(), false)->_account._disc;
+    int added = 0;
+    if(_nodes.empty() || last < edge(root(), true)->_account._disc || first > edge(root(), false)->_account._disc){
+        for(const Account& acct : other){
+            added++;
+            if(visit) visit(acct);
+        }
+        join(std::move(other));
+        return added;
+    }
 
-        // Deletes the array of accounts
-        delete[] AccArray;
+    DTree middle, higher;
+    split(first, middle);
+    middle.split(last + 1, higher);
+    std::vector<DNode*> mine, theirs;
+    TreeCore<DNodeTraits>::collect(middle.root(), mine);
+    TreeCore<DNodeTraits>::collect(other.root(), theirs);
+    std::vector<DNode> sorted;
+    sorted.reserve(mine.size() + theirs.size());
+    size_t i = 0, j = 0;
+    while(i < mine.size() || j < theirs.size()){
+        if(j == theirs.size() || (i < mine.size() && mine[i]->_account._disc <= theirs[j]->_account._disc)){
+            // A discriminator held by both keeps the account already here
+            if(j < theirs.size() && mine[i]->_account._disc == theirs[j]->_account._disc) j++;
+            sorted.push_back(*mine[i++]);
+        }else if(!theirs[j]->isVacant()){
+            added++;
+            if(visit) visit(theirs[j]->_account);
+            sorted.push_back(*theirs[j++]);
+        }else{
+            j++;
+        }
     }
-    return tempRoot;
+    other.clear();
+    middle.fill(sorted);
+    join(std::move(middle));
+    join(std::move(higher));
+    return added;
 }
-//----------------
 
 /**
  * Overloaded << operator for an Account to print out the account details
@@ -275,270 +677,413 @@ ostream& operator<<(ostream& sout, const Account& acct) {
     return sout;
 }
 
-// Helper Functions
-
 /**
- * A Function to assist with the insert, it allows recursive traversal
- * @param a pointer to a DNode, used to navigate the tree
- * @param takes the account to be inserted through newAcct
+ * Creates a string holding its own copy of text, the empty string needs no allocation.
+ * @param text characters to hold
  */
-bool DTree::AssistInsert(DNode *node, Account newAcct) {
-    bool Insert; // Used to handle the exit recursion for the tree
-    if(node->isVacant()){
-        // <- INSERT FILL HERE
-        node->_account = newAcct;
-        node->_vacant = false;
-        Insert = true;
-    }else{
-    // HANDLES RIGHT NAVIGATION
-        if(node->_account._disc < newAcct._disc){
-            // Statement for right navigation
-            if(node->_right == nullptr){
-                // Insert of a new node
-                node->_right = new DNode(newAcct);
-                node->_right->_size = 1;
-                Insert = false;
-                // HANDLE OTHER
-            }else{
-                Insert = AssistInsert(node->_right, newAcct);
-            }
-    // HANDLES LEFT NAVIGATION
-        }else if(node->_account._disc > newAcct._disc){
-            // Statement for left navigation
-            if(node->_left == nullptr){
-                // Insert of a new node
-                node->_left = new DNode(newAcct);
-                Insert = false;
-                // HANDLE OTHER
-            }else{
-                // Moving to next node
-                Insert = AssistInsert(node->_left, newAcct);
-            }
-        }
-    }
-    updateSize(node);
-    updateNumVacant(node);
-    if(checkImbalance(node)){
-        rebalance(node);
+SharedString::SharedString(const string& text) {
+    _rep = nullptr;
+    if(!text.empty()){
+        _rep = new Rep();
+        _rep->refs = 1;
+        _rep->text = text;
     }
+}
 
-    return Insert; // TEMPORARY STATEMENT
+/**
+ * Copy constructor, shares the text of other.
+ * @param other string to share
+ */
+SharedString::SharedString(const SharedString& other) {
+    _rep = other._rep;
+    if(_rep != nullptr) _rep->refs.fetch_add(1, std::memory_order_relaxed);
 }
 
 /**
- * A Function to recursively navigate the tree to find the node we need to delete and return it
- * @param node a pointer to the starting node, will almost always be _root
- * @param disc used to hold the discriminator of the node to be removed
- * @param removed the node to be removed, will be used to store the node.
+ * Assignment operator, drops the current text and shares the text of other.
+ * @param other string to share
+ * @return this string
  */
-void DTree::AssistRemove(DNode *node, int disc, DNode*& removed) {
-    // Removes to the Right
-    if(node->_account._disc < disc){
-        AssistRemove(node->_right, disc, removed);
-    // Removes to the Left
-    }else if(node->_account._disc > disc){
-        AssistRemove(node->_left, disc, removed);
-    // Removes from Here
-    }else if(node->_account._disc == disc){
-        removed = node;
-        node->_vacant = true;
-        node->_numVacant++;
+SharedString& SharedString::operator=(const SharedString& other) {
+    if(_rep != other._rep){
+        if(other._rep != nullptr) other._rep->refs.fetch_add(1, std::memory_order_relaxed);
+        release();
+        _rep = other._rep;
     }
-    updateNumVacant(node);
+    return *this;
 }
+
 /**
- * A Function that assists in the printing and navigation of the DTree
- * This is done through inorder traversal of the discord tree
- * @param node is used to navigate the tree recursively, passing the next node
- * @param height Track
+ * Destructor, the last string sharing the text frees it.
  */
-void DTree::AssistPrint(DNode *node, int height) const {
+SharedString::~SharedString() {
+    release();
+}
 
-    // Print Left Subtree first
-    if(node->_left != nullptr){
-        // Recursive Implementation
-        AssistPrint(node->_left, height+1);
-    }
+/**
+ * Returns the text.
+ * @return the shared text
+ */
+const string& SharedString::str() const {
+    static const string empty;
+    return _rep == nullptr ? empty : _rep->text;
+}
 
-    // Print Root Node Second
-    if(!node->isVacant()){
-        cout << "(HEIGHT: " << height << " )" <<endl;
-        cout << node->_account << endl;
-    }else{
-        cout << endl << "Vacant Node" << endl << endl;
-    }
+/**
+ * Estimates the heap bytes of the shared copy.
+ * @return bytes of the shared text and its count, 0 for the empty string
+ */
+size_t SharedString::heapBytes() const {
+    if(_rep == nullptr) return 0;
+    // Short strings are stored inside the string object itself
+    size_t capacity = _rep->text.capacity();
+    return sizeof(Rep) + (capacity > 15 ? capacity + 1 : 0);
+}
 
-    // Print Right Subtree last
-    if(node->_right != nullptr){
-        // Recursive Implementation
-        AssistPrint(node->_right, height+1);
+/**
+ * Drops this reference to the text.
+ */
+void SharedString::release() {
+    if(_rep != nullptr && _rep->refs.fetch_sub(1, std::memory_order_acq_rel) == 1){
+        delete _rep;
     }
+    _rep = nullptr;
+}
 
+/* Process wide badge dictionary. Entries are never removed, so an index stays valid for the life of
+ * the process and can be read without the lock once it has been handed out. */
+struct BadgeDictionary {
+    std::mutex lock;
+    string texts[MAX_BADGES];
+    std::atomic<int> size;
+
+    BadgeDictionary(): size(1) {texts[0] = DEFAULT_BADGE;}
+};
+
+static BadgeDictionary& badgeDictionary() {
+    static BadgeDictionary dictionary;
+    return dictionary;
 }
 
 /**
- * This function assists in the creation of a deep copy of the DTree, as it iterates through the O_nodes to create a new
- * tree from them.
- * @param O_node The original node, representing the copied tree
- * @param N_node The New Deep Copy Node, representing the new tree being created for the deep copy
+ * Finds the dictionary index of a badge, adding the badge if it is new.
+ * @param badge badge text
+ * @return index of the badge
  */
-void DTree::AssistCopy(DNode* O_node, DNode* N_node){
-    // Creates a deep copy of the node
-    N_node = new DNode(N_node->_account);
-    N_node->_vacant = O_node->_vacant;
-    N_node->_size = O_node->_size;
-
-    N_node->_left = nullptr;
-    N_node->_right = nullptr;
+uint8_t Account::encodeBadge(const string& badge) {
+    BadgeDictionary& dictionary = badgeDictionary();
+    int size = dictionary.size.load(std::memory_order_acquire);
+    for(int i = 0; i < size; i++){
+        if(dictionary.texts[i] == badge) return i;
+    }
 
-    // Navigate To the Right, fills Right First
-    if(O_node->_right != nullptr){
-        AssistCopy(O_node->_right, N_node->_right);
+    std::lock_guard<std::mutex> guard(dictionary.lock);
+    size = dictionary.size.load(std::memory_order_relaxed);
+    for(int i = 0; i < size; i++){
+        if(dictionary.texts[i] == badge) return i;
     }
+    if(size == MAX_BADGES){
+        throw std::out_of_range("More than " + std::to_string(MAX_BADGES) + " distinct badges");
+    }
+    dictionary.texts[size] = badge;
+    dictionary.size.store(size + 1, std::memory_order_release);
+    return size;
+}
 
-    // Navigate to the Left, fills Left Second
-    if(O_node->_left != nullptr){
-        AssistCopy(O_node->_left, N_node->_left);
+/**
+ * Looks a badge up without adding it to the dictionary.
+ * @param badge badge text
+ * @return dictionary index of the badge, -1 if it is not in the dictionary
+ */
+int Account::findBadge(const string& badge) {
+    BadgeDictionary& dictionary = badgeDictionary();
+    int size = dictionary.size.load(std::memory_order_acquire);
+    for(int i = 0; i < size; i++){
+        if(dictionary.texts[i] == badge) return i;
     }
+    return -1;
+}
 
+/**
+ * Returns the text of a dictionary index.
+ * @param index index returned by encodeBadge
+ * @return the badge text
+ */
+const string& Account::decodeBadge(uint8_t index) {
+    return badgeDictionary().texts[index];
 }
 
 /**
- * A Function to assist in the rebalance of the DTree. This function will pull from the DTree and place nodes into the
- * array, which is passed by pointer.
- * @param node The starting point for the Rebalance, it will never pass the initial node value for the rebalance
- * @param pos postion in the array being filled by the
- * @param TempArray An array to pass the nodes into to be sorted and rebalanced into the tree
- * @return The integer inserted at which an account was inserted, used to assist recursion
+ * Points this account's username at the text of owner when both name the same user, so a
+ * username is held once however many accounts it has.
+ * @param owner account whose username text is shared
  */
-int DTree::AssistRebalance(DNode* node, int pos, Account TempArray[]){
-    // Handles Self First as the Array will need to be sorted anyway
-    if(!node->isVacant()){
-        TempArray[pos] = node->_account;
+void Account::shareUsername(const Account& owner) {
+    if(!_username.sharesWith(owner._username) && _username.str() == owner._username.str()){
+        _username = owner._username;
     }
+}
 
-    // Handles Right
-    if(node->_right != nullptr){
-        pos = AssistRebalance(node->_right, pos+1, TempArray);
+// Helper Functions
+
+/**
+ * Checks that a vacant node can take a discriminator without breaking the search order. The path
+ * to node already bounds disc, so only the nearest keys inside its own subtrees are compared.
+ * @param node vacant node
+ * @param disc discriminator to store
+ * @return true if every key on the left is smaller than disc and every key on the right larger
+ */
+bool DTree::fitsVacant(const DNode* node, int disc) {
+    const DNode* left = node->left();
+    if(left != nullptr){
+        while(left->right() != nullptr) left = left->right();
+        if(left->_account._disc >= disc) return false;
+    }
+    const DNode* right = node->right();
+    if(right != nullptr){
+        while(right->left() != nullptr) right = right->left();
+        if(right->_account._disc <= disc) return false;
     }
+    return true;
+}
 
-    // Handles Left
-    if(node->_left != nullptr){
-        pos = AssistRebalance(node->_left, pos+1, TempArray);
+/**
+ * In-order walk marking matching accounts vacant, the vacant counts are recomputed on the way back up.
+ * @param node root of the subtree, may be nullptr
+ * @param predicate true for an account to remove
+ * @param visit function called with every removed account, may be empty
+ * @return number of accounts removed below node
+ */
+int DTree::AssistRemoveIf(DNode* node, const std::function<bool(const Account&)>& predicate,
+                          const std::function<void(const Account&)>& visit) {
+    if(node == nullptr){
+        return 0;
+    }
+    int removed = AssistRemoveIf(node->left(), predicate, visit);
+    if(!node->isVacant() && predicate(node->_account)){
+        node->setVacant(true);
+        if(_bitmaps != nullptr) _bitmaps->remove(node->_account._disc, node->_account._nitro, node->_account._badge);
+        if(visit) visit(node->_account);
+        removed++;
     }
-    return pos;
+    removed += AssistRemoveIf(node->right(), predicate, visit);
+    updateNumVacant(node);
+    return removed;
 }
 
 /**
- * Quicksort algorithm for an array of Account objects, the array will be sorted based on the size of the discriminator
- * @param TempArray the array to be sorted and used to recreate the DTree
- * @param large holds the position of the largest discriminator in the array
- * @param small holds the position of the smallest discriminator in the array
+ * A Function that assists in the printing and navigation of the DTree
+ * This is done through inorder traversal of the discord tree
+ * @param node is used to navigate the tree recursively, passing the next node
+ * @param sout stream to print to, lines end in '\n' so nothing is flushed per account
+ * @param height Track
  */
-void DTree::AssistSort(Account TempArray[], int small, int large) {
-    if(small < large){
-        // Creates an index for partition
-        int partition = divide(TempArray, small, large);
+void DTree::AssistPrint(DNode *node, ostream& sout, int height) {
+    Core::inOrder(node, height, [&](DNode* visited, int depth) {
+        if(!visited->isVacant()){
+            sout << "(HEIGHT: " << depth << " )\n";
+            sout << visited->_account << '\n';
+        }else{
+            sout << "\nVacant Node\n\n";
+        }
+    });
+}
 
-        AssistSort(TempArray, small, partition-1);
-        AssistSort(TempArray, partition+1, large);
+/**
+ * Makes room for one more node. The array grows geometrically, a move invalidates every DNode
+ * pointer into it so it counts as a new generation for caches.
+ */
+void DTree::reserveNode() {
+    if(_nodes.size() == _nodes.capacity()){
+        _nodes.reserve(std::max<size_t>(DTREE_MIN_CAPACITY, 2 * _nodes.capacity()));
+        _generation++;
     }
 }
 
 /**
- * A recursive function to implement quicksort and perform the partition
- * @param TempArray the array containing all of the Accounts
- * @param small the smallest value in the partition
- * @param large the largest value in the partition
+ * Appends a node to the node array, reserveNode must have made room for it.
+ * @param newAcct account held by the new node
+ * @return the new node, it has no children
  */
-int DTree::divide(Account TempArray[], int small, int large){
-    int p_point =  TempArray[large]._disc;
-    int x = (small-1);
+DNode* DTree::allocate(const Account& newAcct) {
+    _nodes.emplace_back(newAcct);
+    return &_nodes.back();
+}
 
-    for(int i = small; i <= large - 1; i++){
-        if(TempArray[i]._disc <= p_point){
-            x++;
-            swap(&TempArray[i], &TempArray[x]);
-        }
+/**
+ * Searches the frozen layout. The descent has no data dependent branches: each level picks the
+ * child with a comparison result, and the match is recovered from the path afterwards.
+ * @param disc the discriminator to search for
+ * @return A pointer to the node with the discriminator, nullptr otherwise
+ */
+DNode* DTree::FrozenRetrieve(int disc) const {
+    const int* discs = _frozenDiscs.data();
+    size_t count = _frozenDiscs.size() - 1;
+    size_t index = 1;
+    while(index <= count){
+        index = 2 * index + (discs[index] < disc);
+    }
+    // Undo the right turns taken after the last left turn, that node is the lower bound
+    index >>= __builtin_ffsll(~index);
+    if(index != 0 && discs[index] == disc){
+        return _frozenNodes[index];
     }
-    swap(&TempArray[x+1], &TempArray[large]);
-    return(x+1);
+    return nullptr;
 }
 
 /**
- * A function to swap two account objects
- * @param first is a pointer to an account and will be used to swap the account
- * @param second is a pointer to the second, will be swapped with the first
+ * Places sorted nodes into the Eytzinger arrays using an in-order walk of the implicit tree.
+ * @param sorted nodes sorted by discriminator
+ * @param pos next position of sorted to place
+ * @param index position in the implicit tree, children at 2 * index and 2 * index + 1
+ * @return the next position of sorted to place
  */
-void DTree::swap(Account* first, Account* second){
-    Account temp = *first;
-    *first = *second;
-    *second = temp;
+int DTree::AssistFreeze(const std::vector<DNode*>& sorted, int pos, int index) {
+    if(index >= (int) _frozenDiscs.size()) return pos;
+    pos = AssistFreeze(sorted, pos, 2 * index);
+    _frozenDiscs[index] = sorted[pos]->_account._disc;
+    _frozenNodes[index] = sorted[pos];
+    return AssistFreeze(sorted, pos + 1, 2 * index + 1);
 }
 
 /**
- * This function is called to recreate the DTree from an Array of Accounts, it assumes that the tree doesn't exist.
- * The function operates under the assumption that the _root of the new tree has already been established, and that the
- * root will be passed as node at the start of recursion.
- * @param AccArr an array of account objects to be inserted into the new tree
- * @param node the root node to be passed to the
- * @param start
- * @param end
+ * Finds the node at one end of a subtree.
+ * @param node root of the subtree, not nullptr
+ * @param smallest true for the smallest discriminator, false for the largest
+ * @return the node with the smallest or largest discriminator, vacant or not
  */
-void DTree::Recreate(Account AccArr[], DNode* node, int start, int end){
-    // Insert the node in it's place int the Tree
-    insert(AccArr[start]);
-    // Recursion for the function
-    if(start != end){
-        Recreate(AccArr, node, start+1, end);
+const DNode* DTree::edge(const DNode* node, bool smallest) {
+    for(const DNode* next = node; next != nullptr; next = smallest ? next->left() : next->right()){
+        node = next;
     }
+    return node;
+}
 
+/**
+ * Unlinks the node at one end of a subtree, sizes are updated on the way back up.
+ * @param node root of the subtree, replaced by the new root
+ * @param smallest true for the smallest discriminator, false for the largest
+ * @return the unlinked node, without children
+ */
+DNode* DTree::detachEdge(DNode*& node, bool smallest) {
+    Core::InPlace hooks;
+    DNode* found;
+    node = Core::detachEdge(node, smallest, hooks, found);
+    return found;
 }
 
 /**
- * Allows for the DTree to be cleared recursively. Operate regardless of vacancy
- * @param node used in recursion deleted after all children
+ * Links two subtrees below a pivot. The spine of the heavier subtree facing the lighter one is
+ * descended until the lighter subtree plus the pivot is no lighter than 1 - alpha of what it
+ * meets, the pivot takes that place. Sizes grow along the spine, so the highest node on it that
+ * breaks the balance rule is rebuilt, as insert does.
+ * @param lower subtree of smaller keys, may be nullptr
+ * @param pivot node without children, keyed between both subtrees
+ * @param upper subtree of larger keys, may be nullptr
+ * @return root of the joined subtree
  */
-void DTree::AssistClear(DNode* node){
-    // Clear Left First
-    if(node->_left != nullptr){
-        AssistClear(node->_left);
+DNode* DTree::AssistJoin(DNode* lower, DNode* pivot, DNode* upper) {
+    bool lowerHeavier = DNodeTraits::weight(lower) >= DNodeTraits::weight(upper);
+    int light = DNodeTraits::weight(lowerHeavier ? upper : lower) + 1;
+    std::vector<DNode*> spine;
+    DNode* node = lowerHeavier ? lower : upper;
+    while(node != nullptr && (1 - _balance.alpha) * node->getSize() > _balance.alpha * light){
+        spine.push_back(node);
+        node = lowerHeavier ? node->right() : node->left();
     }
-    // Clear Right Second
-    if(node->_right != nullptr){
-        AssistClear(node->_right);
+    pivot->setLeft(lowerHeavier ? node : lower);
+    pivot->setRight(lowerHeavier ? upper : node);
+    DNodeTraits::augment(pivot);
+    if(!spine.empty()){
+        if(lowerHeavier){
+            spine.back()->setRight(pivot);
+        }else{
+            spine.back()->setLeft(pivot);
+        }
     }
-    // Clear Self Last
-    delete node;
+
+    DNode* scapegoat = checkImbalance(pivot) ? pivot : nullptr;
+    for(auto it = spine.rbegin(); it != spine.rend(); ++it){
+        DNodeTraits::augment(*it);
+        if(checkImbalance(*it)) scapegoat = *it;
+    }
+    if(scapegoat != nullptr) rebalance(scapegoat);
+    return spine.empty() ? pivot : spine[0];
 }
 
 /**
- * Helper function for the retrieve function, should operate recursively
- * @param node used to allow recursion, should start at _root
- * @param disc the discriminator used to check for the existence of a node with the same discriminator
- * @return A pointer to the node being retrieved
+ * Makes a node the first node of the array, where the root must live. The contents of the node
+ * and the current first node are swapped and the links to and from both slots are fixed, which
+ * needs the parent of the first node, found by searching its discriminator.
+ * @param node root of the tree
  */
-DNode* DTree::AssistRetrieve(DNode* node, int disc){
-    // Halt recursion when a match is found
-    if(node->getDiscriminator() == disc){
-        return node;
+void DTree::moveToFront(DNode* node) {
+    DNode* first = &_nodes[0];
+    if(node == first){
+        return;
     }
-    // Checks for left existence
-    if(node->_left != nullptr){
-        // Checks for appropriate discriminators
-        if(node->getAccount().getDiscriminator() > disc ) {
-            // Recursive to the right
-            return AssistRetrieve(node->_left, disc);
+    DNode* parent = node;
+    for(DNode* child = node; child != first;){
+        parent = child;
+        child = first->_account._disc < child->_account._disc ? child->left() : child->right();
+    }
+    bool leftOfParent = parent->left() == first;
+    DNode* links[] = {first->left(), first->right(), node->left(), node->right()};
+    for(DNode*& link : links){
+        if(link == first){
+            link = node;
+        }else if(link == node){
+            link = first;
         }
     }
-    // Checks for right existence
-    if(node->_right != nullptr){
-        // Checks for appropriate discriminators
-        if(node->getAccount().getDiscriminator() < disc ){
-            // Recursive to the right
-            return AssistRetrieve(node->_right, disc);
+    std::swap(*first, *node);
+    first->setLeft(links[2]);
+    first->setRight(links[3]);
+    node->setLeft(links[0]);
+    node->setRight(links[1]);
+    // A parent other than node kept its slot, its link still points at the old slot of first
+    if(parent != node){
+        if(leftOfParent){
+            parent->setLeft(node);
+        }else{
+            parent->setRight(node);
         }
     }
-    // Base case to return nullptr
-    return nullptr;
-}
\ No newline at end of file
+    _generation++;
+}
+
+/**
+ * Copies a subtree in pre-order, links are rewritten for the new positions.
+ * @param node root of the subtree, may be nullptr
+ * @param nodes node array the copies are appended to, its capacity must fit the subtree
+ * @return the copy of node, nullptr for nullptr
+ */
+DNode* DTree::AssistCopy(const DNode* node, std::vector<DNode>& nodes) {
+    if(node == nullptr){
+        return nullptr;
+    }
+    nodes.push_back(*node);
+    DNode* copy = &nodes.back();
+    copy->setLeft(AssistCopy(node->left(), nodes));
+    copy->setRight(AssistCopy(node->right(), nodes));
+    return copy;
+}
+
+/**
+ * Replaces the whole tree with a perfectly balanced one holding sorted nodes, vacant ones stay vacant.
+ * @param sorted nodes in discriminator order
+ */
+void DTree::fill(const std::vector<DNode>& sorted) {
+    thaw();
+    std::vector<DNode>(sorted.size()).swap(_nodes);
+    std::vector<DNode*> slots;
+    slots.reserve(_nodes.size());
+    for(DNode& node : _nodes) slots.push_back(&node);
+    size_t next = 0;
+    TreeCore<DNodeTraits>::build(sorted, 0, (int) sorted.size() - 1, slots, next);
+    _generation++;
+    if(_bitmaps != nullptr){
+        _bitmaps->clear();
+        for(const Account& acct : *this) _bitmaps->add(acct._disc, acct._nitro, acct._badge);
+    }
+}
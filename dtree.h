@@ -10,6 +10,15 @@
 #include <iostream>
 #include <string>
 #include <exception>
+#include <vector>
+#include <atomic>
+#include <cstdint>
+#include <string_view>
+#include <iterator>
+#include <cstddef>
+#include <functional>
+#include "stringarena.h"
+#include "treecore.h"
 
 using std::cout;
 using std::endl;
@@ -22,12 +31,52 @@ using std::ostream;
 #define MAX_DISC 9999
 #define DEFAULT_BADGE ""
 #define DEFAULT_STATUS ""
+#define ACCOUNT_NO_DISC 0xFFFF  // Stored discriminator of an Account without one
+#define MAX_BADGES 256          // Distinct badges the dictionary can encode
 
 #define DEFAULT_SIZE 1
 #define DEFAULT_NUM_VACANT 0
+#define DNODE_NO_CHILD 0        // Child offset of a missing child, a node is never its own child
+#define DNODE_VACANT 0x8000     // Vacant flag in the top bit of DNode::_size
+#define DTREE_MIN_CAPACITY 4     // Nodes reserved by the first insert, the array then doubles
+#define DTREE_ALPHA_NUMERATOR 7      // Default largest share of a subtree one child may hold before
+#define DTREE_ALPHA_DENOMINATOR 10   // it is rebuilt, 7 / 10
+#define DTREE_DEFAULT_ALPHA ((double) DTREE_ALPHA_NUMERATOR / DTREE_ALPHA_DENOMINATOR)
+
+#define FREEZE_AFTER_READS 64   // Consecutive retrieves without a write before a DTree is frozen
+#define FREEZE_MIN_SIZE 16      // Smaller DTrees are never frozen automatically
 
 class Grader;   /* For grading purposes */
 class Tester;   /* Forward declaration for testing class */
+class AccountBitmaps;
+
+/* Immutable reference counted string. Copies share one heap copy of the text, so every account
+ * of a username can point at the same bytes. */
+class SharedString {
+public:
+    SharedString(): _rep(nullptr) {}
+    SharedString(const string& text);
+    SharedString(const SharedString& other);
+    SharedString(SharedString&& other) noexcept: _rep(other._rep) {other._rep = nullptr;}
+    SharedString& operator=(const SharedString& other);
+    ~SharedString();
+
+    const string& str() const;
+    bool sharesWith(const SharedString& other) const {return _rep == other._rep;}
+
+    /* Bytes of the shared copy, counted once however many strings share it */
+    size_t heapBytes() const;
+
+private:
+    struct Rep {
+        std::atomic<int> refs;
+        string text;
+    };
+    Rep* _rep;      // nullptr for the empty string
+
+    // Drops this reference, the last one frees the text
+    void release();
+};
 
 class Account {
 public:
@@ -35,12 +84,18 @@ public:
     friend class Tester;
     friend class DNode;
     friend class DTree;
+    friend class UNode;
+    friend class TreeProfiler;
+    friend class AccountExporter;
+    friend class LookupCache;
+    friend class UTree;
+    friend class AccountColumns;
+    friend struct DNodeTraits;
     Account() {
-        _username = DEFAULT_USERNAME;
-        _disc = INVALID_DISC;
+        _disc = ACCOUNT_NO_DISC;
         _nitro = false;
-        _badge = DEFAULT_BADGE;
-        _status = DEFAULT_STATUS;
+        _badge = encodeBadge(DEFAULT_BADGE);
+        setStatus(DEFAULT_STATUS);
     }
 
     Account(string username, int disc, bool nitro, string badge, string status) {
@@ -48,26 +103,43 @@ public:
             throw std::out_of_range("Discriminator out of valid range (" + std::to_string(MIN_DISC)
                                     + "-" + std::to_string(MAX_DISC) + ")");
         }
-        _username = username;
+        _username = SharedString(username);
         _disc = disc;
         _nitro = nitro;
-        _badge = badge;
-        _status = status;
+        _badge = encodeBadge(badge);
+        setStatus(StringArena::global().store(status));
     }
 
     /* Getters */
-    string getUsername() const {return _username;}
-    int getDiscriminator() const {return _disc;}
+    const string& getUsername() const {return _username.str();}
+    int getDiscriminator() const {return _disc == ACCOUNT_NO_DISC ? INVALID_DISC : _disc;}
     bool hasNitro() const {return _nitro;}
-    string getBadge() const {return _badge;}
-    string getStatus() const {return _status;}
+    const string& getBadge() const {return decodeBadge(_badge);}
+    string getStatus() const {return string(getStatusView());}
+    std::string_view getStatusView() const {return std::string_view(_status, _statusLength);}
 
 private:
-    string _username;
-    int _disc;
-    bool _nitro;
-    string _badge;
-    string _status;
+    SharedString _username;     // Shared by every account of a UNode
+    const char* _status;        // Text in the arena of the load that read it, or in the global arena when constructed
+    uint32_t _statusLength;
+    uint16_t _disc;             // ACCOUNT_NO_DISC stands for INVALID_DISC
+    uint8_t _badge;             // Index into the badge dictionary
+    bool _nitro : 1;
+
+    // Index of a badge in the process wide dictionary, new badges are added
+    static uint8_t encodeBadge(const string& badge);
+
+    // Index of a badge already in the dictionary, -1 if no account ever had it
+    static int findBadge(const string& badge);
+
+    // Badge text of a dictionary index
+    static const string& decodeBadge(uint8_t index);
+
+    // Makes this account point at the same username text as owner if the usernames match
+    void shareUsername(const Account& owner);
+
+    // Points the status at text that outlives the account, nothing is copied
+    void setStatus(std::string_view status) {_status = status.data(); _statusLength = status.size();}
 };
 
 /* Overloaded << operator to print Accounts */
@@ -77,50 +149,101 @@ class DNode {
     friend class Grader;
     friend class Tester;
     friend class DTree;
+    friend class TreeProfiler;
+    friend class AccountExporter;
+    friend class LookupCache;
+    friend class UNode;
+    friend class UTree;
+    friend class UTreeSnapshot;
+    friend struct DNodeTraits;
 
 public:
     DNode() {
         _size = DEFAULT_SIZE;
         _numVacant = DEFAULT_NUM_VACANT;
-        _vacant = false;
-        _left = nullptr;
-        _right = nullptr;
+        _left = DNODE_NO_CHILD;
+        _right = DNODE_NO_CHILD;
     }
 
     DNode(Account account) {
         _account = account;
         _size = DEFAULT_SIZE;
         _numVacant = DEFAULT_NUM_VACANT;
-        _vacant = false;
-        _left = nullptr;
-        _right = nullptr;
+        _left = DNODE_NO_CHILD;
+        _right = DNODE_NO_CHILD;
     }
 
     /* Getters */
     Account getAccount() const {return _account;}
-    int getSize() const {return _size;}
+    int getSize() const {return _size & ~DNODE_VACANT;}
     int getNumVacant() const {return _numVacant;}
-    bool isVacant() const {return _vacant;}
+    bool isVacant() const {return (_size & DNODE_VACANT) != 0;}
     string getUsername() const {return _account.getUsername();}
     int getDiscriminator() const {return _account.getDiscriminator();}
 
 private:
+    // A DNode is 32 bytes: the children are 16 bit offsets from the node itself within the node
+    // array of its DTree, so links survive the array moving or being copied
     Account _account;
-    int _size;
-    int _numVacant;
-    bool _vacant;
-    DNode* _left;
-    DNode* _right;
+    uint16_t _size;         // Subtree size, the top bit is the vacant flag
+    uint16_t _numVacant;
+    int16_t _left;
+    int16_t _right;
 
     /* IMPLEMENT (optional): any other helper functions */
+
+    // Children, nullptr when missing
+    DNode* left() {return _left == DNODE_NO_CHILD ? nullptr : this + _left;}
+    DNode* right() {return _right == DNODE_NO_CHILD ? nullptr : this + _right;}
+    const DNode* left() const {return _left == DNODE_NO_CHILD ? nullptr : this + _left;}
+    const DNode* right() const {return _right == DNODE_NO_CHILD ? nullptr : this + _right;}
+    void setLeft(DNode* child) {_left = child == nullptr ? DNODE_NO_CHILD : child - this;}
+    void setRight(DNode* child) {_right = child == nullptr ? DNODE_NO_CHILD : child - this;}
+
+    void setSize(int size) {_size = (_size & DNODE_VACANT) | size;}
+    void setVacant(bool vacant) {_size = vacant ? _size | DNODE_VACANT : _size & ~DNODE_VACANT;}
+};
+
+/* How a DTree links its DNodes, for the TreeCore algorithms */
+struct DNodeTraits {
+    typedef DNode* node_ptr;
+    typedef int key_type;
+
+    static DNode* left(DNode* node) {return node->left();}
+    static DNode* right(DNode* node) {return node->right();}
+    static void setLeft(DNode* node, DNode* child) {node->setLeft(child);}
+    static void setRight(DNode* node, DNode* child) {node->setRight(child);}
+    static int compare(int disc, const DNode* node) {return disc - node->_account._disc;}
+    static void assign(DNode* node, const DNode& source) {
+        node->_account = source._account;
+        node->setVacant(source.isVacant());
+    }
+    static void augment(DNode* node);
+    static int weight(const DNode* node) {return node == nullptr ? 0 : node->getSize();}
 };
 
-class DTree {
+/* A pair of iterators, usable in a range-based for loop */
+template<class Iterator>
+struct IteratorRange {
+    Iterator first;
+    Iterator last;
+    Iterator begin() const {return first;}
+    Iterator end() const {return last;}
+};
+
+/* Weight balance rule of a DTree */
+typedef ScapegoatBalance<DNodeTraits, DTREE_ALPHA_NUMERATOR, DTREE_ALPHA_DENOMINATOR> DTreeBalance;
+
+class DTree : private BalancedTree<DNodeTraits, DTreeBalance> {
     friend class Grader;
     friend class Tester;
+    friend class UTree;
+    friend class UNode;
+    friend class TreeProfiler;
+    friend class AccountExporter;
 
 public:
-    DTree(): _root(nullptr) {}
+    DTree(): _readsSinceWrite(0), _generation(0), _owners(1), _bitmaps(nullptr) {}
 
     /* IMPLEMENT: destructor and assignment operator*/
     ~DTree();
@@ -130,18 +253,24 @@ public:
 
     bool insert(Account newAcct);
     bool remove(int disc, DNode*& removed);
+    int removeIf(const std::function<bool(const Account&)>& predicate, bool compact = false,
+                 const std::function<void(const Account&)>& visit = nullptr);
+    void compact();
     DNode* retrieve(int disc);
+    const DNode* find(int disc) const;
+    int rank(int disc) const;
     void clear();
-    void printAccounts() const;
-    void dump() const {dump(_root);}
-    void dump(DNode* node) const;
+    void printAccounts(ostream& sout = cout) const;
+    void dump() const {dump(root());}
+    void dump(ostream& sout) const {dump(root(), sout);}
+    void dump(DNode* node, ostream& sout = cout) const;
 
     /* IMPLEMENT: "Helper" functions */
 
     int getNumUsers() const;
-    string getUsername() const {return _root->getUsername();}
-    void updateSize(DNode* node);
-    void updateNumVacant(DNode* node);
+    string getUsername() const {return root()->getUsername();}
+    static void updateSize(DNode* node);
+    static void updateNumVacant(DNode* node);
     bool checkImbalance(DNode* node);
     //----------------
     //void rebalance(DNode*& node);
@@ -149,42 +278,157 @@ public:
     DNode* rebalance(DNode* node);
     //----------------
 
+    /* Ordered iteration over the non-vacant accounts. The linked nodes are walked, so iterators
+     * stay valid while the tree is read or frozen and are invalidated by inserts. */
+
+    class const_iterator {
+        friend class DTree;
+    public:
+        typedef std::bidirectional_iterator_tag iterator_category;
+        typedef Account value_type;
+        typedef std::ptrdiff_t difference_type;
+        typedef const Account* pointer;
+        typedef const Account& reference;
+
+        const_iterator(): _tree(nullptr) {}
+        reference operator*() const {return _path.back()->_account;}
+        pointer operator->() const {return &_path.back()->_account;}
+        const DNode* node() const {return _path.empty() ? nullptr : _path.back();}
+        const_iterator& operator++();
+        const_iterator& operator--();
+        const_iterator operator++(int) {const_iterator old = *this; ++*this; return old;}
+        const_iterator operator--(int) {const_iterator old = *this; --*this; return old;}
+        bool operator==(const const_iterator& other) const {return node() == other.node();}
+        bool operator!=(const const_iterator& other) const {return node() != other.node();}
+
+    private:
+        const DTree* _tree;
+        std::vector<const DNode*> _path;    // Root to the current node, empty at end()
+
+        explicit const_iterator(const DTree* tree): _tree(tree) {}
+
+        // Moves to the in-order neighbour, vacant or not
+        void step(bool forward);
+    };
+
+    const_iterator begin() const;
+    const_iterator end() const {return const_iterator(this);}
+    const_iterator lower_bound(int disc) const;
+    const_iterator upper_bound(int disc) const {return lower_bound(disc + 1);}
+    IteratorRange<const_iterator> range(int first, int last) const {return {lower_bound(first), lower_bound(last)};}
+
+    /* Optional nitro and badge bitmaps keyed by discriminator, kept up to date by insert and remove */
+
+    void enableBitmaps();
+    void disableBitmaps();
+    const AccountBitmaps* getBitmaps() const {return _bitmaps;}
+
+    /* Bulk operations on whole discriminator ranges. Only O(log n) nodes are relinked; nodes that
+     * change trees are copied once into the node array of the tree that takes them. */
+
+    void join(DTree&& other);
+    void split(int disc, DTree& upper);
+    int merge(DTree&& other, const std::function<void(const Account&)>& visit = nullptr);
+
+    /* Weight balance: an insert rebuilds the highest subtree in which a child holds more than
+     * alpha of the nodes. Alpha is in (0.5, 1], 1 never rebuilds. */
+
+    void setAlpha(double alpha);
+    double getAlpha() const {return _balance.alpha;}
+
+    /* Read optimized layout */
+
+    void freeze();
+    void thaw();
+    bool isFrozen() const {return !_frozenDiscs.empty();}
+
+    /* Changes whenever a DNode is freed or refilled with another account. Returned by reference
+     * so that caches can keep watching the counter. */
+    const unsigned& getGeneration() const {return _generation;}
+
 private:
-    DNode* _root;
+    // Every node of the tree, in allocation order. The root is always the first node, the tree never
+    // holds more than MAX_DISC + 1 accounts so child offsets fit in 16 bits.
+    std::vector<DNode> _nodes;
+
+    // Frozen layout: discriminators in Eytzinger (BFS) order starting at index 1, with the
+    // matching nodes in a parallel array. Empty while the tree is not frozen.
+    std::vector<int> _frozenDiscs;
+    std::vector<DNode*> _frozenNodes;
+    int _readsSinceWrite;
+    unsigned _generation;
+    std::atomic<int> _owners;   // UNodes sharing this tree, only a tree with one owner is written
+    AccountBitmaps* _bitmaps;   // Non-vacant accounts by nitro and badge, nullptr unless enabled
 
     /* IMPLEMENT (optional): any additional helper functions here */
 
-    // Assists in making the insertion recursive
-    bool AssistInsert(DNode* node, Account newAcct);
+    // Hooks of the core insert, refilling vacant nodes and finding the highest unbalanced node on the path
+    struct InsertHooks;
+
+    // Whether a vacant node can be refilled with disc and keep the tree ordered
+    static bool fitsVacant(const DNode* node, int disc);
+
+    // Hooks of the core erase, marking the node vacant
+    struct RemoveHooks;
+
+    // Marks every matching account below node vacant and fixes the vacant counts on the way back up, returns how many
+    int AssistRemoveIf(DNode* node, const std::function<bool(const Account&)>& predicate,
+                       const std::function<void(const Account&)>& visit);
+
+    // Assists in the printing of the tree recursively, also prints DNodes held outside a DTree
+    static void AssistPrint(DNode* node, ostream& sout, int height = 0);
+
+    // Root of the tree, nullptr when empty
+    DNode* root() const {return _nodes.empty() ? nullptr : const_cast<DNode*>(&_nodes[0]);}
 
-    // Assists in making the remove recursive
-    void AssistRemove(DNode* node, int disc, DNode*& removed);
+    // Appends a node to the node array, which must have room for it
+    DNode* allocate(const Account& newAcct);
 
-    // Assists in creating a deep copy of the DTree starting at the passed node
-    void AssistCopy(DNode* O_node, DNode* N_node);
+    // Makes room for one more node, moving the array if it is full
+    void reserveNode();
 
-    // Assists in the printing of the tree recursively
-    void AssistPrint(DNode* node, int height = 0) const;
+    // Search of the linked layout from node down
+    DNode* AssistRetrieve(DNode* node, int disc) {return TreeCore<DNodeTraits>::find(node, disc);}
 
-    // Recursive Function to assist with the rebalance
-    int AssistRebalance(DNode* node, int pos, Account TempArray[]);
+    // Smallest or largest node of a subtree, vacant or not
+    static const DNode* edge(const DNode* node, bool smallest);
 
-    // A sort function that takes an array and the size of the array and quick sorts
-    void AssistSort(Account TempArray[], int small, int large);
+    // Unlinks the smallest or largest node below a link, returns it without children
+    DNode* detachEdge(DNode*& node, bool smallest);
 
-    // A Function to find the pivot points
-    int divide(Account TempArray[], int small, int large);
+    // Links two subtrees below pivot, keys of lower are smaller and keys of upper larger than its own, returns the new subtree root
+    DNode* AssistJoin(DNode* lower, DNode* pivot, DNode* upper);
 
-    // A simple swap function to swap two integers (MAY NEED TO CHANGE THIS)
-    void swap(Account* first, Account* second);
+    // Swaps the contents of two slots so that the root of the tree is the first node again
+    void moveToFront(DNode* node);
 
-    // A function to rebuild the DTree from the array
-    void Recreate(Account AccArr[], DNode* Node, int start, int end);
+    // Copies a subtree in pre-order into a node array with room for it, returns the copy of node
+    static DNode* AssistCopy(const DNode* node, std::vector<DNode>& nodes);
 
-    // Recursive function to dynamic memory
-    void AssistClear(DNode* node);
+    // Replaces every node with a perfectly balanced tree of sorted nodes
+    void fill(const std::vector<DNode>& sorted);
 
-    // Recursive retrieve
-    DNode * AssistRetrieve(DNode* node, int disc);
+    // Branchless search of the frozen layout
+    DNode* FrozenRetrieve(int disc) const;
 
-};
\ No newline at end of file
+    // Places sorted nodes into Eytzinger order, returns the next unused sorted position
+    int AssistFreeze(const std::vector<DNode*>& sorted, int pos, int index);
+
+};
+
+/**
+ * Recomputes the size and vacancy count of a DNode from its children.
+ * @param node DNode to update
+ */
+inline void DNodeTraits::augment(DNode* node) {
+    // Every core update runs this along its whole path, so both values come from one read of each child
+    int size = DEFAULT_SIZE;
+    int vacant = node->isVacant() ? 1 : 0;
+    for(const DNode* child : {node->left(), node->right()}){
+        if(child == nullptr) continue;
+        size += child->getSize();
+        vacant += child->_numVacant;
+    }
+    node->setSize(size);
+    node->_numVacant = vacant;
+}
@@ -0,0 +1,446 @@
+/**
+ * CMSC 341 - Spring 2021
+ * Project 2 - Binary Trees
+ * AccountExporter.cpp
+ * Implementation for the AccountExporter class.
+ */
+
+#include "exporter.h"
+#include <atomic>
+#include <charconv>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <unistd.h>
+#include <cerrno>
+
+/**
+ * Creates an exporter writing to an ostream.
+ * @param sout stream receiving the export, it is only flushed by flush() and the destructor
+ * @param format format of each exported account
+ * @param bufferSize number of bytes gathered before they are passed to the stream
+ */
+AccountExporter::AccountExporter(ostream& sout, ExportFormat format, size_t bufferSize) {
+    _sout = &sout;
+    _fd = NO_FD;
+    _format = format;
+    _bufferSize = bufferSize;
+    _buffer.reserve(bufferSize);
+}
+
+/**
+ * Creates an exporter writing to a file descriptor.
+ * @param fd open file descriptor receiving the export, it is not closed by the exporter
+ * @param format format of each exported account
+ * @param bufferSize number of bytes gathered before they are passed to write(2)
+ */
+AccountExporter::AccountExporter(int fd, ExportFormat format, size_t bufferSize) {
+    _sout = nullptr;
+    _fd = fd;
+    _format = format;
+    _bufferSize = bufferSize;
+    _buffer.reserve(bufferSize);
+}
+
+/**
+ * Destructor, flushes whatever is left in the buffer. A write that fails here is dropped, callers
+ * that need to know call flush themselves first.
+ */
+AccountExporter::~AccountExporter() {
+    try {
+        flush();
+    } catch(const std::exception&) {
+        // Throwing from a destructor would terminate the process
+    }
+}
+
+/**
+ * Buffers a single account.
+ * @param acct Account to export
+ */
+void AccountExporter::write(const Account& acct) {
+    format(_buffer, acct);
+    if(_buffer.size() >= _bufferSize){
+        sink(_buffer.data(), _buffer.size());
+        _buffer.clear();
+    }
+}
+
+/**
+ * Exports every non-vacant account of a DTree in discriminator order.
+ * @param dtree DTree to export
+ * @return number of accounts exported
+ */
+long AccountExporter::exportTree(const DTree& dtree) {
+    long count = AssistFormat(dtree.root(), _buffer);
+    if(_buffer.size() >= _bufferSize){
+        sink(_buffer.data(), _buffer.size());
+        _buffer.clear();
+    }
+    return count;
+}
+
+/**
+ * Exports every account of a UTree in username, then discriminator order.
+ * With more than one thread the UTree is split into subtrees that are formatted in parallel,
+ * the output is still written in order.
+ * @param utree UTree to export
+ * @param threads number of formatting threads
+ * @return number of accounts exported
+ */
+long AccountExporter::exportTree(const UTree& utree, int threads) {
+    if(utree._engine != ENGINE_AVL){
+        // The B-tree and ART engines have no UNode subtrees to hand out, they are exported in order
+        long count = 0;
+        utree.forEachNode([&](UNode* node) {
+            count += formatAccounts(node, _buffer);
+            if(_buffer.size() >= _bufferSize){
+                sink(_buffer.data(), _buffer.size());
+                _buffer.clear();
+            }
+        });
+        return count;
+    }
+    return exportNodes(utree._root, threads);
+}
+
+/**
+ * Exports every account a snapshot holds in username, then discriminator order. The live tree
+ * can keep changing while the snapshot is exported, from this or any other thread.
+ * @param snapshot snapshot to export
+ * @param threads number of formatting threads
+ * @return number of accounts exported
+ */
+long AccountExporter::exportTree(const UTreeSnapshot& snapshot, int threads) {
+    return exportNodes(snapshot._root, threads);
+}
+
+/**
+ * Exports the changes between two versions of a UTree as a change stream, one line per changed
+ * account. Applying the lines in order to a copy of from gives to.
+ * @param from older version
+ * @param to newer version
+ * @return number of changes exported
+ */
+long AccountExporter::exportDiff(const UTreeSnapshot& from, const UTreeSnapshot& to) {
+    return UTreeSnapshot::diff(from, to, [&](ChangeType type, const Account& acct) {
+        formatChange(_buffer, type, acct);
+        if(_buffer.size() >= _bufferSize){
+            sink(_buffer.data(), _buffer.size());
+            _buffer.clear();
+        }
+    });
+}
+
+/**
+ * Exports the accounts of a linked UNode subtree in order, splitting the subtree between
+ * formatting threads when there is more than one.
+ * @param root root of the subtree, may be nullptr
+ * @param threads number of formatting threads
+ * @return number of accounts exported
+ */
+long AccountExporter::exportNodes(UNode* root, int threads) {
+    if(threads <= 1){
+        long count = 0;
+        // Formats one UNode at a time so the buffer never grows far past _bufferSize
+        std::vector<UNode*> stack;
+        UNode* node = root;
+        while(node != nullptr || !stack.empty()){
+            while(node != nullptr){
+                stack.push_back(node);
+                node = node->_left;
+            }
+            node = stack.back();
+            stack.pop_back();
+            count += formatAccounts(node, _buffer);
+            if(_buffer.size() >= _bufferSize){
+                sink(_buffer.data(), _buffer.size());
+                _buffer.clear();
+            }
+            node = node->_right;
+        }
+        return count;
+    }
+
+    // Enough tasks for a reasonable balance between the threads
+    int maxDepth = 0;
+    while((1 << maxDepth) < threads * 4) maxDepth++;
+    std::vector<std::pair<UNode*, bool>> tasks;
+    AssistSplit(root, 0, maxDepth, tasks);
+
+    std::vector<string> results(tasks.size());
+    std::vector<long> counts(tasks.size(), 0);
+    std::vector<char> done(tasks.size(), 0);
+    std::vector<std::exception_ptr> errors(tasks.size());
+    std::atomic<size_t> next(0);
+    std::mutex lock;
+    std::condition_variable ready;
+
+    std::vector<std::thread> workers;
+    for(int t = 0; t < threads; t++){
+        workers.emplace_back([&]() {
+            for(size_t i = next++; i < tasks.size(); i = next++){
+                try {
+                    if(tasks[i].second){
+                        counts[i] = AssistFormat(tasks[i].first, results[i]);
+                    }else{
+                        counts[i] = formatAccounts(tasks[i].first, results[i]);
+                    }
+                } catch(...) {
+                    errors[i] = std::current_exception();
+                }
+                std::lock_guard<std::mutex> guard(lock);
+                done[i] = 1;
+                ready.notify_all();
+            }
+        });
+    }
+
+    // Writes the tasks in order as soon as each one is formatted
+    long count = 0;
+    try {
+        for(size_t i = 0; i < tasks.size(); i++){
+            {
+                std::unique_lock<std::mutex> guard(lock);
+                ready.wait(guard, [&]() {return done[i] != 0;});
+            }
+            if(errors[i]) std::rethrow_exception(errors[i]);
+            writeRaw(results[i]);
+            string().swap(results[i]);
+            count += counts[i];
+        }
+    } catch(...) {
+        // A task failed to format or the sink failed to write: stops the remaining tasks,
+        // everything before the failure has been written
+        next = tasks.size();
+        for(std::thread& worker : workers) worker.join();
+        throw;
+    }
+    for(std::thread& worker : workers) worker.join();
+    return count;
+}
+
+/**
+ * Sends everything in the buffer to the sink and flushes the sink.
+ */
+void AccountExporter::flush() {
+    if(!_buffer.empty()){
+        sink(_buffer.data(), _buffer.size());
+        _buffer.clear();
+    }
+    if(_sout != nullptr) _sout->flush();
+}
+
+/**
+ * Formats a single account onto the end of out.
+ * @param out string the formatted account is appended to
+ * @param acct Account to format
+ */
+void AccountExporter::format(string& out, const Account& acct) const {
+    char digits[16];
+    char* end = std::to_chars(digits, digits + sizeof(digits), acct._disc).ptr;
+
+    if(_format == EXPORT_CSV){
+        appendCsv(out, acct.getUsername());
+        out += ',';
+        out.append(digits, end);
+        out += acct._nitro ? ",1," : ",0,";
+        appendCsv(out, acct.getBadge());
+        out += ',';
+        appendCsv(out, acct.getStatusView());
+        out += '\n';
+    }else{
+        out += "{\"username\":";
+        appendJson(out, acct.getUsername());
+        out += ",\"discriminator\":";
+        out.append(digits, end);
+        out += acct._nitro ? ",\"nitro\":true,\"badge\":" : ",\"nitro\":false,\"badge\":";
+        appendJson(out, acct.getBadge());
+        out += ",\"status\":";
+        appendJson(out, acct.getStatusView());
+        out += "}\n";
+    }
+}
+
+/**
+ * Formats one change. A CSV line starts with '+', '-' or '~' for inserted, removed and modified
+ * accounts, a JSON line gains a "change" member.
+ * @param out string the formatted change is appended to
+ * @param type kind of change
+ * @param acct Account that changed
+ */
+void AccountExporter::formatChange(string& out, ChangeType type, const Account& acct) const {
+    static const char* const symbols[] = {"+", "-", "~"};
+    if(type != CHANGE_REMOVED){
+        size_t start = out.size();
+        format(out, acct);
+        if(_format == EXPORT_CSV){
+            out.insert(start, string(symbols[type]) + ',');
+        }else{
+            out.insert(start + 1, string("\"change\":\"") + symbols[type] + "\",");
+        }
+        return;
+    }
+    char digits[16];
+    char* end = std::to_chars(digits, digits + sizeof(digits), acct._disc).ptr;
+    if(_format == EXPORT_CSV){
+        out += "-,";
+        appendCsv(out, acct.getUsername());
+        out += ',';
+        out.append(digits, end);
+        out += '\n';
+    }else{
+        out += "{\"change\":\"-\",\"username\":";
+        appendJson(out, acct.getUsername());
+        out += ",\"discriminator\":";
+        out.append(digits, end);
+        out += "}\n";
+    }
+}
+
+// Helper Functions
+
+/**
+ * Appends formatted text to the buffer, blocks larger than the buffer are sent straight to the sink.
+ * @param text formatted text
+ */
+void AccountExporter::writeRaw(const string& text) {
+    if(_buffer.size() + text.size() < _bufferSize){
+        _buffer += text;
+        return;
+    }
+    if(!_buffer.empty()){
+        sink(_buffer.data(), _buffer.size());
+        _buffer.clear();
+    }
+    sink(text.data(), text.size());
+}
+
+/**
+ * Sends bytes to the ostream or file descriptor.
+ * @param data bytes to send
+ * @param length number of bytes
+ */
+void AccountExporter::sink(const char* data, size_t length) {
+    if(_sout != nullptr){
+        _sout->write(data, length);
+        return;
+    }
+    while(length > 0){
+        ssize_t written = ::write(_fd, data, length);
+        if(written < 0){
+            if(errno == EINTR) continue;
+            throw std::runtime_error("AccountExporter: write to file descriptor failed");
+        }
+        data += written;
+        length -= written;
+    }
+}
+
+/**
+ * Formats the non-vacant accounts of a DNode subtree using in-order traversal.
+ * @param node root of the subtree, may be nullptr
+ * @param out string the accounts are appended to
+ * @return number of accounts formatted
+ */
+long AccountExporter::AssistFormat(DNode* node, string& out) const {
+    if(node == nullptr) return 0;
+    long count = AssistFormat(node->left(), out);
+    if(!node->isVacant()){
+        format(out, node->_account);
+        count++;
+    }
+    return count + AssistFormat(node->right(), out);
+}
+
+/**
+ * Formats every account of a UNode subtree using in-order traversal.
+ * @param node root of the subtree, may be nullptr
+ * @param out string the accounts are appended to
+ * @return number of accounts formatted
+ */
+long AccountExporter::AssistFormat(UNode* node, string& out) const {
+    if(node == nullptr) return 0;
+    long count = AssistFormat(node->_left, out);
+    count += formatAccounts(node, out);
+    return count + AssistFormat(node->_right, out);
+}
+
+/**
+ * Formats the accounts of a single UNode, held inline or in its DTree.
+ * @param node UNode whose accounts are formatted
+ * @param out string the accounts are appended to
+ * @return number of accounts formatted
+ */
+long AccountExporter::formatAccounts(UNode* node, string& out) const {
+    if(node->_dtree != nullptr){
+        return AssistFormat(node->_dtree->root(), out);
+    }
+    long count = 0;
+    for(int i = 0; i < node->_numInline; i++){
+        count += AssistFormat(&node->_inline[i], out);
+    }
+    return count;
+}
+
+/**
+ * Splits a UNode subtree into in-order tasks. Nodes above maxDepth become single UNode tasks (false),
+ * subtrees rooted at maxDepth become whole subtree tasks (true).
+ * @param node root of the subtree, may be nullptr
+ * @param depth depth of node
+ * @param maxDepth depth at which whole subtrees are handed out
+ * @param tasks list of tasks in order
+ */
+void AccountExporter::AssistSplit(UNode* node, int depth, int maxDepth,
+                                  std::vector<std::pair<UNode*, bool>>& tasks) const {
+    if(node == nullptr) return;
+    if(depth == maxDepth){
+        tasks.push_back({node, true});
+        return;
+    }
+    AssistSplit(node->_left, depth + 1, maxDepth, tasks);
+    tasks.push_back({node, false});
+    AssistSplit(node->_right, depth + 1, maxDepth, tasks);
+}
+
+/**
+ * Appends a JSON string literal, escaping quotes, backslashes and control characters.
+ * @param out string to append to
+ * @param text raw text
+ */
+void AccountExporter::appendJson(string& out, std::string_view text) {
+    static const char hex[] = "0123456789abcdef";
+    out += '"';
+    for(unsigned char c : text){
+        if(c == '"' || c == '\\'){
+            out += '\\';
+            out += (char) c;
+        }else if(c == '\n'){
+            out += "\\n";
+        }else if(c == '\t'){
+            out += "\\t";
+        }else if(c == '\r'){
+            out += "\\r";
+        }else if(c < 0x20){
+            out += "\\u00";
+            out += hex[c >> 4];
+            out += hex[c & 0xF];
+        }else{
+            out += (char) c;
+        }
+    }
+    out += '"';
+}
+
+/**
+ * Appends a CSV field. loadData splits on every ',' and reads line by line, so a field containing
+ * either could not be loaded back and is rejected.
+ * @param out string to append to
+ * @param text raw text
+ */
+void AccountExporter::appendCsv(string& out, std::string_view text) {
+    if(text.find_first_of(",\n") != std::string_view::npos){
+        throw std::invalid_argument("Field \"" + string(text) + "\" contains a ',' or newline and cannot be exported to .csv");
+    }
+    out += text;
+}
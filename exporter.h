@@ -0,0 +1,82 @@
+/**
+ * CMSC 341 - Spring 2021
+ * Project 2 - Binary Trees
+ * AccountExporter.h
+ * An interface for the AccountExporter class, buffered streaming export of accounts to any sink.
+ */
+
+#pragma once
+
+#include "utree.h"
+#include "snapshot.h"
+#include <vector>
+
+#define EXPORT_BUFFER_SIZE (1 << 20)
+#define NO_FD -1
+
+enum ExportFormat {
+    EXPORT_CSV,     // Same layout loadData reads: username,disc,nitro,badge,status
+    EXPORT_JSONL    // One JSON object per line
+};
+
+class AccountExporter {
+    friend class Grader;
+    friend class Tester;
+
+public:
+    AccountExporter(ostream& sout, ExportFormat format = EXPORT_CSV, size_t bufferSize = EXPORT_BUFFER_SIZE);
+    AccountExporter(int fd, ExportFormat format = EXPORT_CSV, size_t bufferSize = EXPORT_BUFFER_SIZE);
+
+    /* Flushes whatever is left in the buffer */
+    ~AccountExporter();
+
+    /* Basic operations */
+
+    void write(const Account& acct);
+    long exportTree(const DTree& dtree);
+    long exportTree(const UTree& utree, int threads = 1);
+    long exportTree(const UTreeSnapshot& snapshot, int threads = 1);
+    long exportDiff(const UTreeSnapshot& from, const UTreeSnapshot& to);
+    void flush();
+
+    /* Formats a single account onto the end of out, the exporter's format is used */
+    void format(string& out, const Account& acct) const;
+
+    /* Formats one change of a diff onto the end of out. Inserted and modified accounts are written
+     * whole, a removed account only by username and discriminator. */
+    void formatChange(string& out, ChangeType type, const Account& acct) const;
+
+private:
+    ostream* _sout;
+    int _fd;
+    ExportFormat _format;
+    size_t _bufferSize;
+    string _buffer;
+
+    // Appends already formatted text to the buffer, large blocks bypass it
+    void writeRaw(const string& text);
+
+    // Sends bytes to the sink
+    void sink(const char* data, size_t length);
+
+    // Exports a linked UNode subtree, shared by the AVL engine and snapshots
+    long exportNodes(UNode* root, int threads);
+
+    // Formats every non-vacant account of a DNode subtree in order
+    long AssistFormat(DNode* node, string& out) const;
+
+    // Formats every account of a UNode subtree in order
+    long AssistFormat(UNode* node, string& out) const;
+
+    // Formats the accounts of a single UNode in order
+    long formatAccounts(UNode* node, string& out) const;
+
+    // Splits a UNode subtree into in-order tasks, each a single UNode or a whole subtree
+    void AssistSplit(UNode* node, int depth, int maxDepth, std::vector<std::pair<UNode*, bool>>& tasks) const;
+
+    // Appends a JSON string literal
+    static void appendJson(string& out, std::string_view text);
+
+    // Appends a CSV field, loadData has no quoting so delimiters cannot be exported
+    static void appendCsv(string& out, std::string_view text);
+};
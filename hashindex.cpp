@@ -0,0 +1,150 @@
+/**
+ * CMSC 341 - Spring 2021
+ * Project 2 - Binary Trees
+ * HashIndex.cpp
+ * Implementation for the HashIndex class.
+ */
+
+#include "hashindex.h"
+#include "utree.h"
+#include <functional>
+
+/**
+ * Creates an empty table large enough for expectedUsers without resizing.
+ * @param expectedUsers number of usernames the table is sized for
+ */
+HashIndex::HashIndex(size_t expectedUsers) {
+    _capacity = HASH_MIN_CAPACITY;
+    while(_capacity * HASH_MAX_LOAD < expectedUsers) _capacity *= 2;
+    _slots = new Slot[_capacity]();
+    _size = 0;
+}
+
+/**
+ * Destructor, the UNodes belong to the UTree and are not deleted.
+ */
+HashIndex::~HashIndex() {
+    delete[] _slots;
+}
+
+/**
+ * Adds a username to the table.
+ * @param username key to add
+ * @param node UNode holding the username
+ * @return true if the username was added, false if it was already present
+ */
+bool HashIndex::insert(const string& username, UNode* node) {
+    if(_size + 1 > _capacity * HASH_MAX_LOAD){
+        resize(_capacity * 2);
+    }
+    uint64_t hash = hashOf(username);
+    size_t slot = probe(hash, username);
+    if(_slots[slot].node != nullptr){
+        return false;
+    }
+    _slots[slot].hash = hash;
+    _slots[slot].node = node;
+    _size++;
+    return true;
+}
+
+/**
+ * Finds the UNode holding a username.
+ * @param username key to search for
+ * @return the UNode, nullptr if the username is not in the table
+ */
+UNode* HashIndex::find(const string& username) const {
+    return _slots[probe(hashOf(username), username)].node;
+}
+
+/**
+ * Removes a username. Later entries of the probe run are shifted back so that no tombstones are needed.
+ * @param username key to remove
+ * @return true if the username was removed, false if it was not in the table
+ */
+bool HashIndex::erase(const string& username) {
+    size_t mask = _capacity - 1;
+    size_t hole = probe(hashOf(username), username);
+    if(_slots[hole].node == nullptr){
+        return false;
+    }
+    _slots[hole].node = nullptr;
+    _size--;
+
+    // Backward shift: an entry may fill the hole if the hole lies between its home slot and its slot
+    for(size_t next = (hole + 1) & mask; _slots[next].node != nullptr; next = (next + 1) & mask){
+        size_t home = _slots[next].hash & mask;
+        if(((next - home) & mask) >= ((next - hole) & mask)){
+            _slots[hole] = _slots[next];
+            _slots[next].node = nullptr;
+            hole = next;
+        }
+    }
+    return true;
+}
+
+/**
+ * Removes every username and returns to the minimum capacity.
+ */
+void HashIndex::clear() {
+    delete[] _slots;
+    _capacity = HASH_MIN_CAPACITY;
+    _slots = new Slot[_capacity]();
+    _size = 0;
+}
+
+// Helper Functions
+
+/**
+ * Hashes a username.
+ * @param username key to hash
+ * @return 64 bit hash
+ */
+uint64_t HashIndex::hashOf(const string& username) {
+    return std::hash<string>()(username);
+}
+
+/**
+ * Checks a slot against a username, the string is only compared when the full hashes match.
+ * @param slot slot to check
+ * @param hash hash of username
+ * @param username key to match
+ * @return true if the slot holds the username
+ */
+bool HashIndex::matches(const Slot& slot, uint64_t hash, const string& username) {
+    return slot.hash == hash && slot.node->getUsername() == username;
+}
+
+/**
+ * Linear probing from the home slot of the hash.
+ * @param hash hash of username
+ * @param username key to search for
+ * @return position of the slot holding username, or of the first empty slot
+ */
+size_t HashIndex::probe(uint64_t hash, const string& username) const {
+    size_t mask = _capacity - 1;
+    size_t slot = hash & mask;
+    while(_slots[slot].node != nullptr && !matches(_slots[slot], hash, username)){
+        slot = (slot + 1) & mask;
+    }
+    return slot;
+}
+
+/**
+ * Rehashes every entry into a new slot array, the stored hashes are reused.
+ * @param capacity new capacity, a power of two
+ */
+void HashIndex::resize(size_t capacity) {
+    Slot* old = _slots;
+    size_t oldCapacity = _capacity;
+    _slots = new Slot[capacity]();
+    _capacity = capacity;
+    size_t mask = capacity - 1;
+    for(size_t i = 0; i < oldCapacity; i++){
+        if(old[i].node == nullptr) continue;
+        size_t slot = old[i].hash & mask;
+        while(_slots[slot].node != nullptr) slot = (slot + 1) & mask;
+        _slots[slot] = old[i];
+    }
+    delete[] old;
+}
@@ -0,0 +1,63 @@
+/**
+ * CMSC 341 - Spring 2021
+ * Project 2 - Binary Trees
+ * HashIndex.h
+ * An interface for the HashIndex class, an open addressing hash table from username to UNode.
+ */
+
+#pragma once
+
+#include <string>
+#include <cstdint>
+#include <cstddef>
+
+using std::string;
+
+#define HASH_MIN_CAPACITY 16
+#define HASH_MAX_LOAD 0.7   // The table doubles once more than this fraction of the slots are used
+
+class UNode;
+
+class HashIndex {
+    friend class Grader;
+    friend class Tester;
+
+public:
+    HashIndex(size_t expectedUsers = 0);
+    ~HashIndex();
+
+    /* Basic operations */
+
+    bool insert(const string& username, UNode* node);
+    UNode* find(const string& username) const;
+    bool erase(const string& username);
+    void clear();
+    size_t size() const {return _size;}
+    size_t capacity() const {return _capacity;}
+
+    /* Bytes used by the slot array */
+    size_t memoryBytes() const {return _capacity * sizeof(Slot);}
+
+private:
+    /* A slot is empty when node is nullptr, the full hash avoids most string comparisons */
+    struct Slot {
+        uint64_t hash;
+        UNode* node;
+    };
+
+    Slot* _slots;
+    size_t _capacity;   // Always a power of two
+    size_t _size;
+
+    // Hash of a username, never changes for the life of the process
+    static uint64_t hashOf(const string& username);
+
+    // True if the slot holds the username
+    static bool matches(const Slot& slot, uint64_t hash, const string& username);
+
+    // Finds the slot holding the username, or the empty slot where it would go
+    size_t probe(uint64_t hash, const string& username) const;
+
+    // Moves every entry into a table with the new capacity
+    void resize(size_t capacity);
+};
@@ -0,0 +1,161 @@
+/**
+ * CMSC 341 - Spring 2021
+ * Project 2 - Binary Trees
+ * LookupCache.cpp
+ * Implementation for the LookupCache class.
+ */
+
+#include "lookupcache.h"
+#include "dtree.h"
+
+/**
+ * Creates an empty cache. The entries are split into sets of LOOKUP_CACHE_WAYS, each set runs its
+ * own CLOCK, so a hit costs one hash and at most LOOKUP_CACHE_WAYS comparisons.
+ * @param capacity number of entries, rounded up to a power of two number of sets
+ */
+LookupCache::LookupCache(size_t capacity) {
+    _numSets = 1;
+    while(_numSets * LOOKUP_CACHE_WAYS < capacity) _numSets *= 2;
+    _entries = new Entry[_numSets * LOOKUP_CACHE_WAYS]();
+    _hands = new uint8_t[_numSets]();
+    _hits = 0;
+    _misses = 0;
+}
+
+/**
+ * Destructor, the DNodes belong to the UTree and are not deleted.
+ */
+LookupCache::~LookupCache() {
+    delete[] _entries;
+    delete[] _hands;
+}
+
+/**
+ * Finds the DNode cached for a pair. An entry whose DNode was freed, moved or refilled since it
+ * was cached is dropped and counted as a miss.
+ * @param username username to match
+ * @param disc discriminator to match
+ * @return the cached DNode, nullptr on a miss
+ */
+DNode* LookupCache::find(const string& username, int disc) {
+    Entry* entry = lookup(hashOf(hashOf(username), disc), username, disc);
+    if(entry == nullptr){
+        _misses++;
+        return nullptr;
+    }
+    _hits++;
+    entry->referenced = true;
+    return entry->node;
+}
+
+/**
+ * Caches the DNode of a pair. When the set is full the CLOCK hand skips referenced entries,
+ * clearing their bit, and evicts the first entry that was not hit since the hand last passed.
+ * @param username username of the account
+ * @param disc discriminator of the account
+ * @param generation generation counter of the DTree or UNode holding node, it is watched while cached
+ * @param node DNode to cache
+ */
+void LookupCache::insert(const string& username, int disc, const unsigned& generation, DNode* node) {
+    uint64_t user = hashOf(username);
+    uint64_t hash = hashOf(user, disc);
+    Entry* entry = lookup(hash, username, disc);
+    if(entry == nullptr){
+        size_t set = hash & (_numSets - 1);
+        Entry* ways = _entries + set * LOOKUP_CACHE_WAYS;
+        for(int way = 0; way < LOOKUP_CACHE_WAYS && entry == nullptr; way++){
+            if(ways[way].node == nullptr) entry = &ways[way];
+        }
+        if(entry == nullptr){
+            uint8_t& hand = _hands[set];
+            while(ways[hand].referenced){
+                ways[hand].referenced = false;
+                hand = (hand + 1) % LOOKUP_CACHE_WAYS;
+            }
+            entry = &ways[hand];
+            hand = (hand + 1) % LOOKUP_CACHE_WAYS;
+        }
+        entry->hash = hash;
+        entry->disc = disc;
+        entry->user = (uint32_t) user;
+    }
+    entry->referenced = false;
+    entry->counter = &generation;
+    entry->generation = generation;
+    entry->node = node;
+}
+
+/**
+ * Drops the entry of a pair.
+ * @param username username to match
+ * @param disc discriminator to match
+ * @return true if the pair was cached
+ */
+bool LookupCache::erase(const string& username, int disc) {
+    Entry* entry = lookup(hashOf(hashOf(username), disc), username, disc);
+    if(entry == nullptr){
+        return false;
+    }
+    entry->node = nullptr;
+    return true;
+}
+
+/**
+ * Drops every entry of a username, whatever its discriminator, including entries whose DNode is no
+ * longer in the tree. Entries are matched on the username hash, so no DNode or generation counter
+ * is read and the structures they point into may already be freed. An entry of another username
+ * with the same hash is dropped as well, which only costs it a miss. Every set is scanned.
+ * @param username username to drop
+ */
+void LookupCache::eraseUsername(const string& username) {
+    uint32_t user = (uint32_t) hashOf(username);
+    for(size_t i = 0; i < capacity(); i++){
+        if(_entries[i].user == user) _entries[i].node = nullptr;
+    }
+}
+
+/**
+ * Drops every entry, the hit rate counters are kept.
+ */
+void LookupCache::clear() {
+    for(size_t i = 0; i < capacity(); i++){
+        _entries[i].node = nullptr;
+        _entries[i].referenced = false;
+    }
+}
+
+// Helper Functions
+
+/**
+ * Hashes a (username, discriminator) pair.
+ * @param user hash of the username
+ * @param disc discriminator to hash
+ * @return 64 bit hash
+ */
+uint64_t LookupCache::hashOf(uint64_t user, int disc) {
+    // Mixes the discriminator in so that the accounts of one username spread over the sets
+    uint64_t hash = user ^ ((uint64_t) disc * 0x9E3779B97F4A7C15ULL);
+    return hash ^ (hash >> 29);
+}
+
+/**
+ * Searches the set of a pair.
+ * @param hash hash of the pair
+ * @param username username to match
+ * @param disc discriminator to match
+ * @return the entry holding the pair, nullptr if it is not cached
+ */
+LookupCache::Entry* LookupCache::lookup(uint64_t hash, const string& username, int disc) {
+    Entry* ways = _entries + (hash & (_numSets - 1)) * LOOKUP_CACHE_WAYS;
+    for(int way = 0; way < LOOKUP_CACHE_WAYS; way++){
+        Entry& entry = ways[way];
+        if(entry.node == nullptr || entry.hash != hash || entry.disc != disc) continue;
+        if(*entry.counter != entry.generation){
+            // The node may be freed, it must not be read
+            entry.node = nullptr;
+        }else if(entry.node->_account.getUsername() == username){
+            return &entry;
+        }
+    }
+    return nullptr;
+}
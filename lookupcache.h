@@ -0,0 +1,78 @@
+/**
+ * CMSC 341 - Spring 2021
+ * Project 2 - Binary Trees
+ * LookupCache.h
+ * An interface for the LookupCache class, a bounded cache from (username, discriminator) to DNode.
+ */
+
+#pragma once
+
+#include <string>
+#include <cstdint>
+#include <cstddef>
+#include <functional>
+
+using std::string;
+
+#define LOOKUP_CACHE_WAYS 8             // Entries per set, a miss evicts within its set only
+#define LOOKUP_CACHE_DEFAULT 4096       // Entries held when no capacity is given
+
+class DNode;
+
+class LookupCache {
+    friend class Grader;
+    friend class Tester;
+
+public:
+    LookupCache(size_t capacity = LOOKUP_CACHE_DEFAULT);
+    ~LookupCache();
+
+    /* Basic operations */
+
+    DNode* find(const string& username, int disc);
+    void insert(const string& username, int disc, const unsigned& generation, DNode* node);
+    bool erase(const string& username, int disc);
+    void eraseUsername(const string& username);
+    void clear();
+    size_t capacity() const {return _numSets * LOOKUP_CACHE_WAYS;}
+
+    /* Hit rate counters, kept until resetStats */
+
+    long hits() const {return _hits;}
+    long misses() const {return _misses;}
+    double hitRate() const {return _hits + _misses == 0 ? 0.0 : (double) _hits / (_hits + _misses);}
+    void resetStats() {_hits = 0; _misses = 0;}
+
+    /* Bytes used by the entry and hand arrays */
+    size_t memoryBytes() const {return capacity() * sizeof(Entry) + _numSets;}
+
+private:
+    /* An entry is empty when node is nullptr. The generation of the structure holding node, taken at
+     * insertion, tells whether node has since been moved or reused for another discriminator.
+     * The username is read from node once the generation checks out so entries hold no strings. */
+    struct Entry {
+        uint64_t hash;
+        // Generation counter of the DTree or UNode holding node. It is read on every lookup, so the
+        // owner of the cache must call eraseUsername before it frees a DTree or UNode of a username
+        // still cached, or replaces one by a copy: a generation cannot tell that its structure is gone.
+        const unsigned* counter;
+        DNode* node;
+        unsigned generation;
+        int disc;
+        uint32_t user;      // Hash of the username alone, matched by eraseUsername without reading node
+        bool referenced;    // CLOCK bit, set on every hit and cleared as the hand passes
+    };
+
+    Entry* _entries;        // _numSets sets of LOOKUP_CACHE_WAYS entries
+    uint8_t* _hands;        // CLOCK hand of each set
+    size_t _numSets;        // Always a power of two
+    long _hits;
+    long _misses;
+
+    // Hash of a username, and of a (username, discriminator) pair given the username's hash
+    static uint64_t hashOf(const string& username) {return std::hash<string>()(username);}
+    static uint64_t hashOf(uint64_t user, int disc);
+
+    // Finds the entry holding the pair, nullptr if it is not cached. Stale entries met on the way are emptied
+    Entry* lookup(uint64_t hash, const string& username, int disc);
+};
@@ -0,0 +1,26 @@
+/**
+ * CMSC 341 - Spring 2021
+ * Project 2 - Binary Trees
+ * profile.cpp
+ * Command line tool that loads a .csv file of accounts and reports the shape of the resulting trees.
+ * Usage: ./profile [accounts.csv] [number of worst subtrees]
+ */
+
+#include "treestats.h"
+
+int main(int argc, char* argv[]) {
+    string dataFile = argc > 1 ? argv[1] : "accounts.csv";
+    int worstCount = argc > 2 ? std::stoi(argv[2]) : PROFILE_WORST_COUNT;
+
+    UTree utree;
+    try {
+        utree.loadData(dataFile);
+    } catch(std::invalid_argument& e) {
+        std::cerr << e.what() << endl;
+        return 1;
+    }
+
+    TreeProfiler profiler(worstCount);
+    profiler.report(profiler.profile(utree));
+    return 0;
+}
@@ -0,0 +1,145 @@
+/**
+ * CMSC 341 - Spring 2021
+ * Project 2 - Binary Trees
+ * Reclaimer.cpp
+ * Implementation for the Reclaimer class.
+ */
+
+#include "reclaimer.h"
+#include "utree.h"
+#include <algorithm>
+
+/**
+ * Constructor, starts the background thread.
+ */
+Reclaimer::Reclaimer() {
+    _reclaimed = 0;
+    _busy = false;
+    _stopping = false;
+    _thread = std::thread([this]() {work();});
+}
+
+/**
+ * Destructor, frees everything still queued and joins the background thread.
+ */
+Reclaimer::~Reclaimer() {
+    {
+        std::lock_guard<std::mutex> guard(_lock);
+        _stopping = true;
+    }
+    _wake.notify_all();
+    _thread.join();
+}
+
+/**
+ * Returns the reclaimer every UTree hands its detached structures to.
+ * @return process wide reclaimer
+ */
+Reclaimer& Reclaimer::global() {
+    static Reclaimer reclaimer;
+    return reclaimer;
+}
+
+/**
+ * Queues one link to a UNode to be dropped, like UNode::release but on the background thread.
+ * The caller must not use the link afterwards.
+ * @param node root of the subtree, nullptr is ignored
+ */
+void Reclaimer::retire(UNode* node) {
+    if(node == nullptr){
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> guard(_lock);
+        _links.push_back(node);
+    }
+    _wake.notify_one();
+}
+
+/**
+ * Queues a function to run on the background thread, such as walking a detached index to retire
+ * its UNodes.
+ * @param task function to run once
+ */
+void Reclaimer::retire(std::function<void()> task) {
+    {
+        std::lock_guard<std::mutex> guard(_lock);
+        _tasks.push_back(std::move(task));
+    }
+    _wake.notify_one();
+}
+
+/**
+ * Waits until everything queued so far, and everything it queued in turn, is freed.
+ */
+void Reclaimer::drain() {
+    std::unique_lock<std::mutex> guard(_lock);
+    _drained.wait(guard, [&]() {return _links.empty() && _tasks.empty() && !_busy;});
+}
+
+// Helper Functions
+
+/**
+ * Runs tasks and frees batches until the reclaimer stops with nothing left to free.
+ */
+void Reclaimer::work() {
+    std::vector<UNode*> batch;
+    std::vector<UNode*> children;
+    std::unique_lock<std::mutex> guard(_lock);
+    while(true){
+        _wake.wait(guard, [&]() {return _stopping || !_links.empty() || !_tasks.empty();});
+        if(_links.empty() && _tasks.empty()) return;
+
+        _busy = true;
+        if(!_tasks.empty()){
+            std::function<void()> task = std::move(_tasks.front());
+            _tasks.pop_front();
+            guard.unlock();
+            task();
+            task = nullptr;
+            guard.lock();
+        }else{
+            size_t count = std::min<size_t>(RECLAIM_BATCH, _links.size());
+            batch.assign(_links.end() - count, _links.end());
+            _links.resize(_links.size() - count);
+            guard.unlock();
+            long deleted = 0;
+            for(UNode* node : batch){
+                if(release(node, children)) deleted++;
+            }
+            _reclaimed += deleted;
+            guard.lock();
+            _links.insert(_links.end(), children.begin(), children.end());
+            children.clear();
+        }
+        _busy = false;
+
+        if(_links.empty() && _tasks.empty()){
+            _drained.notify_all();
+        }else{
+            // Lets the threads building the new tree have the allocator between batches
+            guard.unlock();
+            std::this_thread::yield();
+            guard.lock();
+        }
+    }
+}
+
+/**
+ * Drops one link to a UNode. The UNode is deleted, along with its DTree unless a snapshot still
+ * shares it, once no parent, root or snapshot links to it.
+ * @param node UNode to release
+ * @param children set to the children of a deleted UNode, whose links are dropped next
+ * @return true if the UNode was deleted
+ */
+bool Reclaimer::release(UNode* node, std::vector<UNode*>& children) {
+    if(node->_refs.fetch_sub(1, std::memory_order_acq_rel) != 1){
+        return false;
+    }
+    if(node->_left != nullptr) children.push_back(node->_left);
+    if(node->_right != nullptr) children.push_back(node->_right);
+    node->_left = nullptr;
+    node->_right = nullptr;
+    delete node;
+    return true;
+}
@@ -0,0 +1,68 @@
+/**
+ * CMSC 341 - Spring 2021
+ * Project 2 - Binary Trees
+ * Reclaimer.h
+ * An interface for the Reclaimer class, which frees detached UTree structures in the background.
+ */
+
+#pragma once
+
+#include <vector>
+#include <deque>
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+
+#define RECLAIM_BATCH 256       // UNodes freed before the reclaimer takes its lock again and yields
+
+class Grader;   /* For grading purposes */
+class Tester;   /* Forward declaration for testing class */
+class UNode;
+
+/* UTree::clear detaches its structure and hands it over here, so the caller does not wait for
+ * every UNode, DTree and DNode to be freed. One background thread drops the links it was given
+ * in batches of RECLAIM_BATCH UNodes: a UNode whose last link is dropped is deleted with its DTree,
+ * and its children are queued, so nothing is recursive and a snapshot sharing part of the tree
+ * keeps that part alive as usual. The global reclaimer frees everything still queued when the
+ * process exits. */
+class Reclaimer {
+    friend class Grader;
+    friend class Tester;
+
+public:
+    Reclaimer();
+    ~Reclaimer();
+
+    Reclaimer(const Reclaimer&) = delete;
+    Reclaimer& operator=(const Reclaimer&) = delete;
+
+    static Reclaimer& global();
+
+    /* Basic operations */
+
+    void retire(UNode* node);
+    void retire(std::function<void()> task);
+    void drain();
+
+    /* UNodes deleted since the reclaimer started */
+    long reclaimed() const {return _reclaimed;}
+
+private:
+    std::vector<UNode*> _links;             // One dropped link each, a UNode may appear again once it is shared
+    std::deque<std::function<void()>> _tasks;   // Run before the next batch, such as walking a detached index
+    std::thread _thread;
+    std::mutex _lock;
+    std::condition_variable _wake;          // Signalled when work is queued or the reclaimer stops
+    std::condition_variable _drained;       // Signalled when the queues run empty
+    std::atomic<long> _reclaimed;
+    bool _busy;                             // The thread is running a batch or a task outside the lock
+    bool _stopping;
+
+    // Body of the background thread
+    void work();
+
+    // Drops one link to a UNode, deletes it if that was the last one and queues its children
+    bool release(UNode* node, std::vector<UNode*>& children);
+};
@@ -0,0 +1,244 @@
+/**
+ * CMSC 341 - Spring 2021
+ * Project 2 - Binary Trees
+ * UTreeSnapshot.cpp
+ * Implementation for the UTreeSnapshot class.
+ */
+
+#include "snapshot.h"
+#include "exporter.h"
+#include <stdexcept>
+
+/**
+ * Creates a snapshot of a UNode tree. Nothing is copied: the UTree copies a shared node, and the
+ * DTree of a shared node, before its first write to it, so the nodes reachable from root never change.
+ * @param root root of the tree, may be nullptr
+ * @param arenas arenas holding the status text of the tree
+ */
+UTreeSnapshot::UTreeSnapshot(UNode* root, const std::vector<std::shared_ptr<StringArena>>& arenas) : _arenas(arenas) {
+    _root = root;
+    if(_root != nullptr) _root->_refs.fetch_add(1, std::memory_order_relaxed);
+}
+
+/**
+ * Copy constructor, both snapshots share every node.
+ * @param other snapshot to share
+ */
+UTreeSnapshot::UTreeSnapshot(const UTreeSnapshot& other) : UTreeSnapshot(other._root, other._arenas) {}
+
+/**
+ * Assignment operator, drops the current version and shares the version of other.
+ * @param other snapshot to share
+ * @return this snapshot
+ */
+UTreeSnapshot& UTreeSnapshot::operator=(const UTreeSnapshot& other) {
+    if(_root != other._root){
+        if(other._root != nullptr) other._root->_refs.fetch_add(1, std::memory_order_relaxed);
+        UNode::release(_root);
+        _root = other._root;
+        _arenas = other._arenas;
+    }
+    return *this;
+}
+
+/**
+ * Destructor, nodes the UTree has since replaced are deleted with the last snapshot holding them.
+ */
+UTreeSnapshot::~UTreeSnapshot() {
+    UNode::release(_root);
+    _root = nullptr;
+}
+
+/**
+ * Retrieves the UNode of a username.
+ * @param username username to match
+ * @return UNode with a matching username, nullptr otherwise
+ */
+const UNode* UTreeSnapshot::retrieve(const string& username) const {
+    return TreeCore<UNodeTraits>::find(_root, username);
+}
+
+/**
+ * Retrieves the DNode of an account, vacant or not, like UTree::retrieveUser.
+ * @param username username to match
+ * @param disc discriminator to match
+ * @return DNode with a matching username and discriminator, nullptr otherwise
+ */
+const DNode* UTreeSnapshot::retrieveUser(const string& username, int disc) const {
+    const UNode* node = retrieve(username);
+    return node == nullptr ? nullptr : node->find(disc);
+}
+
+/**
+ * Returns the number of accounts with a username.
+ * @param username username to match
+ * @return number of non-vacant accounts with the username
+ */
+int UTreeSnapshot::numUsers(const string& username) const {
+    const UNode* node = retrieve(username);
+    return node == nullptr ? 0 : node->getNumUsers();
+}
+
+/**
+ * Visits every UNode in username order.
+ * @param visit function called once per UNode
+ */
+void UTreeSnapshot::forEachNode(const std::function<void(const UNode*)>& visit) const {
+    AssistVisit(_root, visit);
+}
+
+/**
+ * Writes every account to a .csv file.
+ * @param path file to write, it is replaced
+ * @return number of accounts written
+ */
+long UTreeSnapshot::save(const string& path) const {
+    std::ofstream out(path, std::ios::trunc);
+    if(!out.is_open()){
+        throw std::runtime_error("Snapshot file " + path + " could not be opened");
+    }
+    AccountExporter exporter(out);
+    long count = exporter.exportTree(*this);
+    exporter.flush();
+    if(!out){
+        throw std::runtime_error("Snapshot file " + path + " could not be written");
+    }
+    return count;
+}
+
+/**
+ * Walks two versions in username order together. Where both walks reach the same subtree it is
+ * skipped whole, so versions related by snapshots are compared in time proportional to the
+ * paths written between them rather than to their size.
+ * @param from older version
+ * @param to newer version
+ * @param emit function called once per changed account, with the newer account unless it was removed
+ * @return number of changes reported
+ */
+long UTreeSnapshot::diff(const UTreeSnapshot& from, const UTreeSnapshot& to,
+                         const std::function<void(ChangeType, const Account&)>& emit) {
+    DiffStack older, newer;
+    if(from._root != nullptr) older.push_back({from._root, false});
+    if(to._root != nullptr) newer.push_back({to._root, false});
+
+    long changes = 0;
+    while(!older.empty() || !newer.empty()){
+        bool expandOlder = !older.empty() && !older.back().second;
+        bool expandNewer = !newer.empty() && !newer.back().second;
+        if(expandOlder && expandNewer){
+            if(older.back().first == newer.back().first){
+                // Shared subtree, nothing in it changed
+                older.pop_back();
+                newer.pop_back();
+                continue;
+            }
+            // The taller subtree is split first so that shared subtrees below it line up
+            int olderHeight = older.back().first->getHeight();
+            int newerHeight = newer.back().first->getHeight();
+            if(olderHeight > newerHeight) expandNewer = false;
+            if(newerHeight > olderHeight) expandOlder = false;
+        }
+        if(expandOlder || expandNewer){
+            if(expandOlder) expand(older);
+            if(expandNewer) expand(newer);
+            continue;
+        }
+
+        // Both walks stand on a single UNode, or one of them is done
+        const UNode* before = older.empty() ? nullptr : older.back().first;
+        const UNode* after = newer.empty() ? nullptr : newer.back().first;
+        int order = before == nullptr ? 1 : after == nullptr ? -1 : before->getUsername().compare(after->getUsername());
+        if(order < 0){
+            changes += diffAccounts(before, nullptr, emit);
+            older.pop_back();
+        }else if(order > 0){
+            changes += diffAccounts(nullptr, after, emit);
+            newer.pop_back();
+        }else{
+            if(before != after) changes += diffAccounts(before, after, emit);
+            older.pop_back();
+            newer.pop_back();
+        }
+    }
+    return changes;
+}
+
+// Helper Functions
+
+/**
+ * Splits the subtree on top of a walk so that its left subtree comes next.
+ * @param stack pending part of the walk, its top is an unexpanded subtree
+ */
+void UTreeSnapshot::expand(DiffStack& stack) {
+    const UNode* node = stack.back().first;
+    stack.pop_back();
+    if(node->_right != nullptr) stack.push_back({node->_right, false});
+    stack.push_back({node, true});
+    if(node->_left != nullptr) stack.push_back({node->_left, false});
+}
+
+/**
+ * Merges the accounts of one username in both versions by discriminator. A vacant account
+ * counts as missing.
+ * @param from UNode in the older version, nullptr if the username is new
+ * @param to UNode in the newer version, nullptr if the username is gone
+ * @param emit function called once per changed account
+ * @return number of changes reported
+ */
+long UTreeSnapshot::diffAccounts(const UNode* from, const UNode* to,
+                                 const std::function<void(ChangeType, const Account&)>& emit) {
+    if(from != nullptr && to != nullptr && from->_dtree != nullptr && from->_dtree == to->_dtree){
+        // Copies of a UNode share the DTree until one of them changes an account
+        return 0;
+    }
+    std::vector<const DNode*> older, newer;
+    if(from != nullptr) from->collectAccounts(older);
+    if(to != nullptr) to->collectAccounts(newer);
+
+    long changes = 0;
+    size_t i = 0, j = 0;
+    while(i < older.size() || j < newer.size()){
+        const DNode* before = i < older.size() ? older[i] : nullptr;
+        const DNode* after = j < newer.size() ? newer[j] : nullptr;
+        if(after == nullptr || (before != nullptr && before->getDiscriminator() < after->getDiscriminator())){
+            after = nullptr;
+            i++;
+        }else if(before == nullptr || after->getDiscriminator() < before->getDiscriminator()){
+            before = nullptr;
+            j++;
+        }else{
+            i++;
+            j++;
+        }
+        bool existed = before != nullptr && !before->isVacant();
+        bool exists = after != nullptr && !after->isVacant();
+        if(existed && exists){
+            const Account& old = before->_account;
+            const Account& current = after->_account;
+            if(old.hasNitro() != current.hasNitro() || old.getBadge() != current.getBadge()
+               || old.getStatusView() != current.getStatusView()){
+                emit(CHANGE_MODIFIED, current);
+                changes++;
+            }
+        }else if(existed){
+            emit(CHANGE_REMOVED, before->_account);
+            changes++;
+        }else if(exists){
+            emit(CHANGE_INSERTED, after->_account);
+            changes++;
+        }
+    }
+    return changes;
+}
+
+/**
+ * In-order walk of a UNode subtree.
+ * @param node root of the subtree, may be nullptr
+ * @param visit function called once per UNode
+ */
+void UTreeSnapshot::AssistVisit(const UNode* node, const std::function<void(const UNode*)>& visit) const {
+    if(node == nullptr) return;
+    AssistVisit(node->_left, visit);
+    visit(node);
+    AssistVisit(node->_right, visit);
+}
@@ -0,0 +1,70 @@
+/**
+ * CMSC 341 - Spring 2021
+ * Project 2 - Binary Trees
+ * UTreeSnapshot.h
+ * An interface for the UTreeSnapshot class, a read-only view of a UTree at one point in time.
+ */
+
+#pragma once
+
+#include "utree.h"
+
+/* Kind of change diff reports for one account */
+enum ChangeType {
+    CHANGE_INSERTED,    // Account missing or vacant in the older version
+    CHANGE_REMOVED,     // Account missing or vacant in the newer version
+    CHANGE_MODIFIED     // Account in both versions with another nitro, badge or status
+};
+
+class UTreeSnapshot {
+    friend class Grader;
+    friend class Tester;
+    friend class UTree;
+    friend class AccountExporter;
+
+public:
+    UTreeSnapshot(): _root(nullptr) {}
+    UTreeSnapshot(const UTreeSnapshot& other);
+    UTreeSnapshot& operator=(const UTreeSnapshot& other);
+
+    /* Releases the nodes no other version links to */
+    ~UTreeSnapshot();
+
+    /* Basic operations, they answer as the UTree did when the snapshot was taken */
+
+    const UNode* retrieve(const string& username) const;
+    const DNode* retrieveUser(const string& username, int disc) const;
+    int numUsers(const string& username) const;
+    bool empty() const {return _root == nullptr;}
+
+    /* Visits every UNode in username order */
+    void forEachNode(const std::function<void(const UNode*)>& visit) const;
+
+    /* Writes every account as a .csv loadData can read, returns the number of accounts written */
+    long save(const string& path) const;
+
+    /* Reports every account that differs between two versions in username, then discriminator
+     * order, returns the number of changes. Subtrees both versions share are skipped. */
+    static long diff(const UTreeSnapshot& from, const UTreeSnapshot& to,
+                     const std::function<void(ChangeType, const Account&)>& emit);
+
+private:
+    UNode* _root;
+    std::vector<std::shared_ptr<StringArena>> _arenas;  // Status text of the accounts, kept after the tree clears
+
+    // Takes a new link to root
+    UTreeSnapshot(UNode* root, const std::vector<std::shared_ptr<StringArena>>& arenas);
+
+    // Recursive in-order walk
+    void AssistVisit(const UNode* node, const std::function<void(const UNode*)>& visit) const;
+
+    // Pending part of an in-order walk: a UNode, or its whole subtree while the flag is false
+    typedef std::vector<std::pair<const UNode*, bool>> DiffStack;
+
+    // Replaces the subtree on top of the stack by its left subtree, its root and its right subtree
+    static void expand(DiffStack& stack);
+
+    // Reports the changes between the accounts of one username, either UNode may be nullptr
+    static long diffAccounts(const UNode* from, const UNode* to,
+                             const std::function<void(ChangeType, const Account&)>& emit);
+};
@@ -0,0 +1,84 @@
+/**
+ * CMSC 341 - Spring 2021
+ * Project 2 - Binary Trees
+ * StringArena.cpp
+ * Implementation for the StringArena class.
+ */
+
+#include "stringarena.h"
+#include <cstring>
+#include <sys/mman.h>
+
+/**
+ * Destructor, frees every chunk and unmaps every file the arena kept.
+ */
+StringArena::~StringArena() {
+    for(char* chunk : _chunks) delete[] chunk;
+    for(const std::pair<void*, size_t>& mapping : _mappings) munmap(mapping.first, mapping.second);
+}
+
+/**
+ * Returns the process wide arena. Nothing is ever removed from it, text outlives the accounts
+ * that pointed at it until the process exits.
+ * @return the global arena
+ */
+StringArena& StringArena::global() {
+    static StringArena arena;
+    return arena;
+}
+
+/**
+ * Copies text into the arena. Chunks never move, so views stay valid while more text is added.
+ * @param text characters to copy
+ * @return view of the copy, an empty view for empty text
+ */
+std::string_view StringArena::store(std::string_view text) {
+    if(text.empty()) return std::string_view();
+
+    std::lock_guard<std::mutex> guard(_lock);
+    _bytes += text.size();
+    if(text.size() > ARENA_CHUNK_SIZE / 4){
+        // A long string gets its own chunk, placed before the current one so it stays in use
+        char* chunk = new char[text.size()];
+        memcpy(chunk, text.data(), text.size());
+        _chunks.insert(_chunks.empty() ? _chunks.end() : _chunks.end() - 1, chunk);
+        return std::string_view(chunk, text.size());
+    }
+    if(_used + text.size() > ARENA_CHUNK_SIZE){
+        _chunks.push_back(new char[ARENA_CHUNK_SIZE]);
+        _used = 0;
+    }
+    char* copy = _chunks.back() + _used;
+    memcpy(copy, text.data(), text.size());
+    _used += text.size();
+    return std::string_view(copy, text.size());
+}
+
+/**
+ * Takes ownership of a read-only file mapping, it is unmapped with the arena.
+ * @param data start of the mapping
+ * @param length length of the mapping
+ */
+void StringArena::keepMapping(void* data, size_t length) {
+    std::lock_guard<std::mutex> guard(_lock);
+    _mappings.push_back({data, length});
+    _mappedBytes += length;
+}
+
+/**
+ * Returns the number of bytes copied into the arena.
+ * @return bytes of stored text
+ */
+size_t StringArena::bytes() const {
+    std::lock_guard<std::mutex> guard(_lock);
+    return _bytes;
+}
+
+/**
+ * Returns the number of bytes of file mappings the arena keeps.
+ * @return bytes of kept mappings
+ */
+size_t StringArena::mappedBytes() const {
+    std::lock_guard<std::mutex> guard(_lock);
+    return _mappedBytes;
+}
@@ -0,0 +1,49 @@
+/**
+ * CMSC 341 - Spring 2021
+ * Project 2 - Binary Trees
+ * StringArena.h
+ * An interface for the StringArena class, append-only storage for account text.
+ */
+
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <mutex>
+#include <cstddef>
+
+#define ARENA_CHUNK_SIZE (1 << 20)      // Bytes per chunk, longer strings get a chunk of their own
+
+class StringArena {
+    friend class Grader;
+    friend class Tester;
+
+public:
+    StringArena() : _used(ARENA_CHUNK_SIZE), _bytes(0), _mappedBytes(0) {}
+    ~StringArena();
+    StringArena(const StringArena&) = delete;
+    StringArena& operator=(const StringArena&) = delete;
+
+    /* Arena holding the status text of Accounts built by the constructor, never freed. Loads
+     * use an arena of their own, which the UTree releases when it is cleared. */
+    static StringArena& global();
+
+    /* Copies text into the arena, the returned view is valid until the arena is destroyed */
+    std::string_view store(std::string_view text);
+
+    /* Keeps a read-only file mapping alive for as long as the arena, views into it stay valid */
+    void keepMapping(void* data, size_t length);
+
+    /* Bytes copied into the arena, and bytes of the file mappings it keeps */
+    size_t bytes() const;
+    size_t mappedBytes() const;
+
+private:
+    mutable std::mutex _lock;
+    std::vector<char*> _chunks;
+    std::vector<std::pair<void*, size_t>> _mappings;
+    size_t _used;           // Bytes used in the last chunk
+    size_t _bytes;
+    size_t _mappedBytes;
+};
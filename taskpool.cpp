@@ -0,0 +1,204 @@
+/**
+ * CMSC 341 - Spring 2021
+ * Project 2 - Binary Trees
+ * TaskPool.cpp
+ * Implementation for the TaskPool class.
+ */
+
+#include "taskpool.h"
+#include <algorithm>
+
+// Pool and queue of the running thread, set while it works for a pool
+static thread_local const TaskPool* currentPool = nullptr;
+static thread_local int currentIndex = -1;
+
+/**
+ * Starts threads - 1 workers, the thread that waits on the pool is the last one.
+ * @param threads number of threads running tasks, at least 1
+ */
+TaskPool::TaskPool(int threads) : _queues(std::max(1, threads)) {
+    _queued = 0;
+    _unfinished = 0;
+    _steals = 0;
+    _next = 0;
+    _stopping = false;
+    for(int index = 1; index < size(); index++){
+        _workers.emplace_back([this, index]() {work(index);});
+    }
+}
+
+/**
+ * Destructor, lets the workers finish every queued task and joins them.
+ */
+TaskPool::~TaskPool() {
+    {
+        std::lock_guard<std::mutex> guard(_lock);
+        _stopping = true;
+    }
+    _wake.notify_all();
+    for(std::thread& worker : _workers) worker.join();
+}
+
+/**
+ * Queues a task. A task submitted by a thread of the pool goes to that thread's queue, where it
+ * runs next unless another thread steals it first. Others are spread over the queues.
+ * @param task function to run once
+ */
+void TaskPool::submit(std::function<void()> task) {
+    int index = current();
+    if(index < 0) index = _next++ % _queues.size();
+    _unfinished++;
+    {
+        std::lock_guard<std::mutex> guard(_queues[index].lock);
+        _queues[index].tasks.push_back(std::move(task));
+    }
+    _queued++;
+    // Taking the lock orders the count before a sleeping thread checks it again
+    {
+        std::lock_guard<std::mutex> guard(_lock);
+    }
+    _wake.notify_all();
+}
+
+/**
+ * Runs tasks on the calling thread until every submitted task, including tasks submitted by
+ * tasks, is done.
+ * @throw the first exception a task threw since the last wait, after every task is done
+ */
+void TaskPool::wait() {
+    const TaskPool* pool = currentPool;
+    int index = currentIndex;
+    currentPool = this;
+    currentIndex = 0;
+    std::function<void()> task;
+    while(_unfinished > 0){
+        if(take(0, task)){
+            run(task);
+            continue;
+        }
+        std::unique_lock<std::mutex> guard(_lock);
+        _wake.wait(guard, [&]() {return _unfinished == 0 || _queued > 0;});
+    }
+    currentPool = pool;
+    currentIndex = index;
+
+    std::exception_ptr error;
+    {
+        std::lock_guard<std::mutex> guard(_lock);
+        std::swap(error, _error);
+    }
+    if(error) std::rethrow_exception(error);
+}
+
+/**
+ * Runs work over the positions [0, count) and waits for it. The range is halved while a half still
+ * costs more than 1 / (TASK_POOL_SPLITS * size()) of the total: the thread splitting keeps the
+ * first half and queues the second, which idle threads steal. Halves are cut by cost rather than by
+ * count, so a few expensive positions do not end up in one run.
+ * @param count number of positions
+ * @param work function called with the first and the last (excluded) position of each run
+ * @param cost cumulative cost, cost[i] is the cost of the positions 0 to i; empty if every position costs the same
+ */
+void TaskPool::parallelFor(size_t count, const std::function<void(size_t, size_t)>& work, const std::vector<long>& cost) {
+    if(count == 0){
+        return;
+    }
+    // Cost of the positions before i
+    auto before = [&](size_t i) -> long {
+        return i == 0 ? 0 : cost.empty() ? (long) i : cost[i - 1];
+    };
+    long grain = std::max(1L, before(count) / (size() * TASK_POOL_SPLITS));
+    std::function<void(size_t, size_t)> split = [&](size_t first, size_t last) {
+        while(last - first > 1 && before(last) - before(first) > grain){
+            size_t cut = (first + last) / 2;
+            if(!cost.empty()){
+                long middle = (before(first) + before(last)) / 2;
+                cut = std::lower_bound(cost.begin() + first, cost.begin() + last, middle) - cost.begin() + 1;
+                cut = std::min(std::max(cut, first + 1), last - 1);
+            }
+            submit([&split, cut, last]() {split(cut, last);});
+            last = cut;
+        }
+        work(first, last);
+    };
+    submit([&]() {split(0, count);});
+    wait();
+}
+
+// Helper Functions
+
+/**
+ * Takes the newest task of a queue, or else the oldest task of the next non-empty queue.
+ * @param index queue of the calling thread
+ * @param task set to the task taken
+ * @return true if a task was taken
+ */
+bool TaskPool::take(int index, std::function<void()>& task) {
+    {
+        Queue& own = _queues[index];
+        std::lock_guard<std::mutex> guard(own.lock);
+        if(!own.tasks.empty()){
+            task = std::move(own.tasks.back());
+            own.tasks.pop_back();
+            _queued--;
+            return true;
+        }
+    }
+    for(size_t k = 1; k < _queues.size(); k++){
+        Queue& victim = _queues[(index + k) % _queues.size()];
+        std::lock_guard<std::mutex> guard(victim.lock);
+        if(!victim.tasks.empty()){
+            task = std::move(victim.tasks.front());
+            victim.tasks.pop_front();
+            _queued--;
+            _steals++;
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * Runs a task, keeping the first exception for wait.
+ * @param task task to run, emptied afterwards
+ */
+void TaskPool::run(std::function<void()>& task) {
+    try {
+        task();
+    } catch(...) {
+        std::lock_guard<std::mutex> guard(_lock);
+        if(!_error) _error = std::current_exception();
+    }
+    task = nullptr;
+    if(--_unfinished == 0){
+        std::lock_guard<std::mutex> guard(_lock);
+        _wake.notify_all();
+    }
+}
+
+/**
+ * Runs tasks until the pool stops, sleeping while every queue is empty.
+ * @param index queue of this thread
+ */
+void TaskPool::work(int index) {
+    currentPool = this;
+    currentIndex = index;
+    std::function<void()> task;
+    while(true){
+        if(take(index, task)){
+            run(task);
+            continue;
+        }
+        std::unique_lock<std::mutex> guard(_lock);
+        _wake.wait(guard, [&]() {return _stopping || _queued > 0;});
+        if(_stopping && _queued == 0) return;
+    }
+}
+
+/**
+ * Returns the queue of the calling thread.
+ * @return queue index, -1 for a thread outside the pool
+ */
+int TaskPool::current() const {
+    return currentPool == this ? currentIndex : -1;
+}
@@ -0,0 +1,79 @@
+/**
+ * CMSC 341 - Spring 2021
+ * Project 2 - Binary Trees
+ * TaskPool.h
+ * An interface for the TaskPool class, a work-stealing thread pool for tree-wide maintenance.
+ */
+
+#pragma once
+
+#include <vector>
+#include <deque>
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <exception>
+#include <cstddef>
+
+#define TASK_POOL_SPLITS 8      // Runs per thread a parallelFor is cut into before it stops splitting
+
+class Grader;   /* For grading purposes */
+class Tester;   /* Forward declaration for testing class */
+
+/* Each thread owns a queue: it pushes and pops its own tasks at the back, and an idle thread steals
+ * from the front of another queue, which holds the oldest and largest tasks. The thread calling
+ * wait or parallelFor works as thread 0 until every task is done, so a pool of one thread runs
+ * everything on the caller. Only one thread at a time may wait on a pool. */
+class TaskPool {
+    friend class Grader;
+    friend class Tester;
+
+public:
+    explicit TaskPool(int threads = std::thread::hardware_concurrency());
+    ~TaskPool();
+
+    TaskPool(const TaskPool&) = delete;
+    TaskPool& operator=(const TaskPool&) = delete;
+
+    /* Basic operations */
+
+    void submit(std::function<void()> task);
+    void wait();
+    void parallelFor(size_t count, const std::function<void(size_t, size_t)>& work,
+                     const std::vector<long>& cost = {});
+    int size() const {return _queues.size();}
+
+    /* Tasks taken from another thread's queue since the pool was created */
+    long steals() const {return _steals;}
+
+private:
+    struct Queue {
+        std::mutex lock;
+        std::deque<std::function<void()>> tasks;
+    };
+
+    std::vector<Queue> _queues;         // Queue 0 belongs to the waiting thread
+    std::vector<std::thread> _workers;  // Threads 1 and up
+    std::mutex _lock;                   // Guards sleeping and waking, not the queues
+    std::condition_variable _wake;      // Signalled when a task is submitted, the last one is done or the pool stops
+    std::atomic<long> _queued;          // Tasks sitting in a queue
+    std::atomic<long> _unfinished;      // Tasks submitted and not yet done
+    std::atomic<long> _steals;
+    std::atomic<size_t> _next;          // Round robin queue for tasks submitted from outside the pool
+    std::exception_ptr _error;          // First exception thrown by a task since the last wait
+    bool _stopping;
+
+    // Takes a task from this thread's queue, or steals one, returns false if every queue is empty
+    bool take(int index, std::function<void()>& task);
+
+    // Runs a task and records its exception, if any
+    void run(std::function<void()>& task);
+
+    // Body of threads 1 and up
+    void work(int index);
+
+    // Queue of the calling thread, -1 outside the pool
+    int current() const;
+};
@@ -0,0 +1,307 @@
+/**
+ * CMSC 341 - Spring 2021
+ * Project 2 - Binary Trees
+ * TreeCore.h
+ * Search tree algorithms, balance policies and the BalancedTree base shared by DTree and UTree.
+ * Everything is a template over a node traits class, so each tree gets code specialized for its own
+ * key type, payload and augmentation.
+ */
+
+#pragma once
+
+#include <vector>
+#include <algorithm>
+#include <cstddef>
+#include <ostream>
+
+/* A node traits class describes how a tree stores its nodes. The algorithms only use the members
+ * they name in their comments:
+ *
+ *   typedef ... node_ptr;                          pointer to a node, nullptr for a missing child
+ *   typedef ... key_type;                          search key
+ *   static node_ptr left(node_ptr node);           children
+ *   static node_ptr right(node_ptr node);
+ *   static void setLeft(node_ptr node, node_ptr child);
+ *   static void setRight(node_ptr node, node_ptr child);
+ *   static int compare(const key_type& key, node_ptr node);    <0, 0 or >0 as key sorts before,
+ *                                                              at or after the key of node
+ *   static void assign(node_ptr node, const Source& source);   copies the payload of a source
+ *   static void augment(node_ptr node);            recomputes subtree data from the children
+ *   static int weight(node_ptr node);              nodes in a subtree, 0 for nullptr
+ *   static int height(node_ptr node);              height of a subtree, one less than a leaf for nullptr
+ *
+ * The recursive updates (insert, erase, detachEdge) take a hooks object through which each tree
+ * adds its own storage and balancing:
+ *
+ *   node_ptr enter(node_ptr node);     node about to be written on the way down, returns the node
+ *                                      to write instead, such as a copy of a node a snapshot shares
+ *   node_ptr leave(node_ptr node);     node augmented on the way back up, returns the root of its
+ *                                      subtree, such as the child a rotation lifted
+ *   bool absorb(node_ptr node);        insert only: true if node took the key itself, such as a
+ *                                      vacant node refilled
+ *   node_ptr create();                 insert only: new leaf holding the key
+ *   node_ptr erase(node_ptr node);     erase only: node holding the key, returns the finished
+ *                                      subtree taking its place
+ */
+
+template<class Traits>
+struct TreeCore {
+    typedef typename Traits::node_ptr node_ptr;
+    typedef typename Traits::key_type key_type;
+
+    /* Hooks of a tree that writes its nodes in place and restores balance elsewhere */
+    struct InPlace {
+        node_ptr enter(node_ptr node) const {return node;}
+        node_ptr leave(node_ptr node) const {return node;}
+    };
+
+    /**
+     * Iterative search. Uses left, right and compare.
+     * @param node root of the tree, may be nullptr
+     * @param key key to match
+     * @return node with the key, nullptr otherwise
+     */
+    static node_ptr find(node_ptr node, const key_type& key) {
+        while(node != nullptr){
+            int order = Traits::compare(key, node);
+            if(order == 0) return node;
+            node = order < 0 ? Traits::left(node) : Traits::right(node);
+        }
+        return nullptr;
+    }
+
+    /**
+     * In-order walk. Uses left and right.
+     * @param node root of the subtree, may be nullptr
+     * @param visit function called once per node
+     */
+    template<class Visit>
+    static void inOrder(node_ptr node, const Visit& visit) {
+        if(node == nullptr) return;
+        inOrder(Traits::left(node), visit);
+        visit(node);
+        inOrder(Traits::right(node), visit);
+    }
+
+    /**
+     * In-order walk that also passes the depth of each node. Uses left and right.
+     * @param node root of the subtree, may be nullptr
+     * @param depth depth of node
+     * @param visit function called once per node with the node and its depth
+     */
+    template<class Visit>
+    static void inOrder(node_ptr node, int depth, const Visit& visit) {
+        if(node == nullptr) return;
+        inOrder(Traits::left(node), depth + 1, visit);
+        visit(node, depth);
+        inOrder(Traits::right(node), depth + 1, visit);
+    }
+
+    /**
+     * Writes a subtree in the '()' notation: each node is wrapped in parentheses with its left
+     * subtree before and its right subtree after its label. Uses left and right.
+     * @param node root of the subtree, may be nullptr
+     * @param sout stream to write to
+     * @param label function writing the label of a node to sout
+     */
+    template<class Label>
+    static void dump(node_ptr node, std::ostream& sout, const Label& label) {
+        if(node == nullptr) return;
+        sout << "(";
+        dump(Traits::left(node), sout, label);
+        label(node);
+        dump(Traits::right(node), sout, label);
+        sout << ")";
+    }
+
+    /**
+     * Post-order teardown. Uses left and right.
+     * @param node root of the subtree, may be nullptr
+     * @param unlink function dropping the link to a node, false if the node stays linked elsewhere
+     *               and is kept along with its subtrees
+     * @param free function freeing a node, called after its subtrees
+     */
+    template<class Unlink, class Free>
+    static void destroy(node_ptr node, const Unlink& unlink, const Free& free) {
+        if(node == nullptr || !unlink(node)) return;
+        destroy(Traits::left(node), unlink, free);
+        destroy(Traits::right(node), unlink, free);
+        free(node);
+    }
+
+    /**
+     * Recursive insert of a key not yet in the tree. Nodes are entered on the way down, and
+     * relinked, augmented and left on the way back up. Uses left, right, setLeft, setRight,
+     * compare and augment, and the enter, leave, absorb and create hooks.
+     * @param node root of the subtree, may be nullptr
+     * @param key key to insert
+     * @param hooks hooks of the tree
+     * @return root of the subtree afterwards
+     */
+    template<class Hooks>
+    static node_ptr insert(node_ptr node, const key_type& key, Hooks& hooks) {
+        if(node == nullptr) return hooks.create();
+        node = hooks.enter(node);
+        if(!hooks.absorb(node)){
+            int order = Traits::compare(key, node);
+            if(order == 0) return node;
+            node_ptr child = order < 0 ? Traits::left(node) : Traits::right(node);
+            relink(node, order < 0, child, insert(child, key, hooks));
+        }
+        Traits::augment(node);
+        return hooks.leave(node);
+    }
+
+    /**
+     * Recursive removal of a key. The node holding it is handed to the erase hook, the nodes above
+     * it are relinked, augmented and left on the way back up. Uses left, right, setLeft, setRight,
+     * compare and augment, and the enter, leave and erase hooks.
+     * @param node root of the subtree, may be nullptr
+     * @param key key to remove, nothing changes if it is missing
+     * @param hooks hooks of the tree
+     * @return root of the subtree afterwards
+     */
+    template<class Hooks>
+    static node_ptr erase(node_ptr node, const key_type& key, Hooks& hooks) {
+        if(node == nullptr) return nullptr;
+        node = hooks.enter(node);
+        int order = Traits::compare(key, node);
+        if(order == 0) return hooks.erase(node);
+        node_ptr child = order < 0 ? Traits::left(node) : Traits::right(node);
+        relink(node, order < 0, child, erase(child, key, hooks));
+        Traits::augment(node);
+        return hooks.leave(node);
+    }
+
+    /**
+     * Unlinks the node at one end of a subtree, its other child takes its place. Uses left,
+     * right, setLeft, setRight and augment, and the enter and leave hooks.
+     * @param node root of the subtree, which must not be empty
+     * @param smallest true for the smallest key, false for the largest
+     * @param hooks hooks of the tree
+     * @param found set to the unlinked node, augmented without children
+     * @return root of the subtree afterwards
+     */
+    template<class Hooks>
+    static node_ptr detachEdge(node_ptr node, bool smallest, Hooks& hooks, node_ptr& found) {
+        node = hooks.enter(node);
+        node_ptr next = smallest ? Traits::left(node) : Traits::right(node);
+        if(next == nullptr){
+            found = node;
+            node_ptr other = smallest ? Traits::right(node) : Traits::left(node);
+            Traits::setLeft(found, nullptr);
+            Traits::setRight(found, nullptr);
+            Traits::augment(found);
+            return other;
+        }
+        relink(node, smallest, next, detachEdge(next, smallest, hooks, found));
+        Traits::augment(node);
+        return hooks.leave(node);
+    }
+
+    /**
+     * Links a new child below a node. A link that did not change is not stored, so a node shared
+     * with a snapshot is not written. Uses setLeft and setRight.
+     * @param node parent
+     * @param left true for the left child, false for the right one
+     * @param before child linked until now, may be nullptr
+     * @param child new child, may be nullptr
+     */
+    static void relink(node_ptr node, bool left, node_ptr before, node_ptr child) {
+        if(child == before) return;
+        if(left){
+            Traits::setLeft(node, child);
+        }else{
+            Traits::setRight(node, child);
+        }
+    }
+
+    /**
+     * Collects every node of a subtree in order. Uses left and right.
+     * @param node root of the subtree, may be nullptr
+     * @param nodes list the nodes are appended to
+     */
+    static void collect(node_ptr node, std::vector<node_ptr>& nodes) {
+        auto append = [&](node_ptr visited) {nodes.push_back(visited);};
+        inOrder(node, append);
+    }
+
+    /**
+     * Builds a perfectly balanced subtree out of existing nodes: the middle source goes to the next
+     * free slot and the halves on either side become its subtrees. Slots are handed out in
+     * pre-order, so the first slot becomes the root. Uses setLeft, setRight, assign and augment.
+     * @param sorted payloads in key order
+     * @param first first position of sorted to place
+     * @param last last position of sorted to place
+     * @param slots nodes to reuse, at least last - first + 1 of them from next on
+     * @param next next unused position of slots
+     * @return root of the built subtree, nullptr if first > last
+     */
+    template<class Source>
+    static node_ptr build(const std::vector<Source>& sorted, int first, int last,
+                          const std::vector<node_ptr>& slots, size_t& next) {
+        if(first > last) return nullptr;
+        int middle = first + (last - first) / 2;
+        node_ptr node = slots[next++];
+        Traits::assign(node, sorted[middle]);
+        Traits::setLeft(node, build(sorted, first, middle - 1, slots, next));
+        Traits::setRight(node, build(sorted, middle + 1, last, slots, next));
+        Traits::augment(node);
+        return node;
+    }
+};
+
+/* Balance policies. Each one answers whether a single node breaks its rule, given correct
+ * augmentation of the node and its children. */
+
+/* AVL rule: the heights of the two subtrees differ by at most one. Uses height. */
+template<class Traits>
+struct AVLBalance {
+    bool unbalanced(typename Traits::node_ptr node) const {
+        int left = Traits::height(Traits::left(node));
+        int right = Traits::height(Traits::right(node));
+        return left > right + 1 || right > left + 1;
+    }
+};
+
+/* Weight balance with the bound fixed at compile time: neither child holds more than
+ * Numerator / Denominator of the nodes of its subtree. The check is integer only. Uses weight. */
+template<class Traits, int Numerator, int Denominator>
+struct WeightBalance {
+    static_assert(2 * Numerator > Denominator && Numerator <= Denominator, "alpha must be in (0.5, 1]");
+    static constexpr double alpha = (double) Numerator / Denominator;
+
+    bool unbalanced(typename Traits::node_ptr node) const {
+        int heavier = std::max(Traits::weight(Traits::left(node)), Traits::weight(Traits::right(node)));
+        return heavier * Denominator > Numerator * Traits::weight(node);
+    }
+};
+
+/* Weight balance with the bound set at run time, for trees that rebuild the highest node breaking
+ * it (scapegoat trees). The default bound Numerator / Denominator is checked with the integer only
+ * WeightBalance until setAlpha picks another one. An alpha of 1 accepts every tree. Uses weight. */
+template<class Traits, int Numerator, int Denominator>
+struct ScapegoatBalance {
+    typedef WeightBalance<Traits, Numerator, Denominator> Default;
+    double alpha;
+
+    ScapegoatBalance(): alpha(Default::alpha) {}
+
+    bool unbalanced(typename Traits::node_ptr node) const {
+        if(alpha == Default::alpha) return Default().unbalanced(node);
+        int heavier = std::max(Traits::weight(Traits::left(node)), Traits::weight(Traits::right(node)));
+        return heavier > alpha * Traits::weight(node);
+    }
+};
+
+/* Base of a tree built on the core: the algorithms for its node traits and its balance rule.
+ * DTree and UTree derive from their instantiation. */
+template<class Traits, class Balance>
+class BalancedTree {
+protected:
+    typedef TreeCore<Traits> Core;
+
+    Balance _balance;   // Rule checked on the way back up of every update
+
+    BalancedTree() {}
+};
@@ -0,0 +1,273 @@
+/**
+ * CMSC 341 - Spring 2021
+ * Project 2 - Binary Trees
+ * TreeProfiler.cpp
+ * Implementation for the TreeProfiler class.
+ */
+
+#include "treestats.h"
+#include <iomanip>
+
+/**
+ * Walks the UTree and every DTree once and collects the shape statistics.
+ * @param utree UTree to profile
+ * @return the collected TreeProfile
+ */
+TreeProfile TreeProfiler::profile(const UTree& utree) const {
+    TreeProfile profile;
+    for(const std::shared_ptr<StringArena>& arena : utree._arenas){
+        profile.arenaBytes += arena->bytes();
+        profile.mappedBytes += arena->mappedBytes();
+    }
+    if(utree._hash != nullptr){
+        profile.hashBytes = utree._hash->memoryBytes();
+    }
+    if(utree._filter != nullptr){
+        profile.filterBytes = utree._filter->memoryBytes();
+    }
+    if(utree._cache != nullptr){
+        profile.cacheBytes = utree._cache->memoryBytes();
+        profile.cacheHitRate = utree._cache->hitRate();
+    }
+    if(utree._engine != ENGINE_AVL){
+        // Every search passes through one B-tree node per level before reaching the DTree,
+        // an ART search is counted as a single step
+        int userDepth = utree._btree != nullptr ? utree._btree->height() : 1;
+        utree.forEachNode([&](UNode* node) {
+            profileAccounts(node, userDepth, profile);
+        });
+        return profile;
+    }
+    AssistProfile(utree._root, 0, profile);
+    return profile;
+}
+
+/**
+ * Profiles a single DTree, the UTree statistics are left empty.
+ * @param dtree DTree to profile
+ * @return the collected TreeProfile
+ */
+TreeProfile TreeProfiler::profile(const DTree& dtree) const {
+    TreeProfile profile;
+    profileDTree(dtree, 0, profile);
+    return profile;
+}
+
+/**
+ * Writes a human readable report of a profile.
+ * @param profile TreeProfile to report
+ * @param sout stream to write the report to
+ */
+void TreeProfiler::report(const TreeProfile& profile, ostream& sout) const {
+    sout << std::fixed << std::setprecision(2);
+    reportShape("UTree", profile.utree, sout);
+    reportShape("DTrees", profile.dtrees, sout);
+
+    sout << "Accounts: " << profile.numAccounts << " (" << profile.numVacant << " vacant)\n";
+    sout << "retrieveUser path: avg " << profile.averageUserPath() << ", max " << profile.userPathMax << "\n";
+
+    sout << "DTree vacancy (_numVacant / _size):\n";
+    for(int i = 0; i < PROFILE_VACANCY_BUCKETS; i++){
+        sout << "  " << std::setw(3) << i * 100 / PROFILE_VACANCY_BUCKETS << "%-"
+             << std::setw(3) << (i + 1) * 100 / PROFILE_VACANCY_BUCKETS << "%: "
+             << profile.vacancyHistogram[i] << "\n";
+    }
+
+    sout << "Worst DTree subtrees (weight ratio, left:right size):\n";
+    for(const ImbalanceEntry& entry : profile.worstDNodes){
+        sout << "  " << entry.username << "#" << entry.disc << "  " << entry.score
+             << "  " << entry.left << ":" << entry.right << "\n";
+    }
+
+    sout << "Worst UTree subtrees (height difference, left:right height):\n";
+    for(const ImbalanceEntry& entry : profile.worstUNodes){
+        sout << "  " << entry.username << "  " << entry.score
+             << "  " << entry.left << ":" << entry.right << "\n";
+    }
+
+    long nodes = profile.utree.nodes + profile.dtrees.nodes;
+    sout << "Estimated bytes: " << profile.unodeBytes + profile.dnodeBytes;
+    if(profile.utree.nodes > 0) sout << ", " << (double) profile.unodeBytes / profile.utree.nodes << " per UNode";
+    if(profile.dtrees.nodes > 0) sout << ", " << (double) profile.dnodeBytes / profile.dtrees.nodes << " per DNode";
+    if(nodes > 0) sout << ", " << (double) (profile.unodeBytes + profile.dnodeBytes) / nodes << " per node";
+    sout << "\n";
+    if(profile.hashBytes > 0){
+        sout << "Hash index bytes: " << profile.hashBytes;
+        if(profile.utree.nodes > 0) sout << ", " << (double) profile.hashBytes / profile.utree.nodes << " per user";
+        sout << "\n";
+    }
+    if(profile.filterBytes > 0){
+        sout << "Username filter bytes: " << profile.filterBytes << "\n";
+    }
+    if(profile.arenaBytes + profile.mappedBytes > 0){
+        sout << "Status arena bytes: " << profile.arenaBytes << " copied, " << profile.mappedBytes
+             << " mapped\n";
+    }
+    if(profile.cacheBytes > 0){
+        sout << "Lookup cache bytes: " << profile.cacheBytes << ", hit rate " << profile.cacheHitRate << "\n";
+    }
+    sout.flush();
+}
+
+// Helper Functions
+
+/**
+ * Recursively profiles a UNode subtree and every DTree inside of it.
+ * @param node root of the subtree, may be nullptr
+ * @param depth depth of node in the UTree
+ * @param profile TreeProfile collecting the results
+ * @return height of the subtree, -1 for an empty subtree
+ */
+int TreeProfiler::AssistProfile(UNode* node, int depth, TreeProfile& profile) const {
+    if(node == nullptr) return -1;
+
+    record(profile.utree, depth);
+
+    // Profile the accounts, the search path continues from this UNode
+    profileAccounts(node, depth + 1, profile);
+
+    int left = AssistProfile(node->_left, depth + 1, profile);
+    int right = AssistProfile(node->_right, depth + 1, profile);
+
+    // AVL criterion, the difference of the subtree heights
+    keepWorst(profile.worstUNodes, {node->getUsername(), INVALID_DISC, left + 1, right + 1,
+                                    (double) (left > right ? left - right : right - left)});
+    return (left > right ? left : right) + 1;
+}
+
+/**
+ * Profiles one DTree and counts it into the vacancy distribution.
+ * @param dtree DTree to profile
+ * @param userDepth number of nodes visited before reaching the DTree root
+ * @param profile TreeProfile collecting the results
+ */
+void TreeProfiler::profileDTree(const DTree& dtree, int userDepth, TreeProfile& profile) const {
+    DNode* root = dtree.root();
+    if(root == nullptr) return;
+    long vacantBefore = profile.numVacant;
+    int size = AssistProfile(root, 0, userDepth, root->getUsername(), profile);
+    recordVacancy(profile.numVacant - vacantBefore, size, profile);
+}
+
+/**
+ * Profiles the accounts of one UNode. Inline accounts are all reached at the UNode, so each is
+ * counted at depth 0, and the slots they do not use are counted as UNode bytes. The username text
+ * shared by the accounts is counted once, with the UNode.
+ * @param node UNode to profile
+ * @param userDepth number of nodes visited before reaching the accounts
+ * @param profile TreeProfile collecting the results
+ */
+void TreeProfiler::profileAccounts(UNode* node, int userDepth, TreeProfile& profile) const {
+    profile.unodeBytes += sizeof(UNode) - sizeof(node->_inline);
+    DNode* owner = node->_dtree != nullptr ? node->_dtree->root() : &node->_inline[0];
+    if(owner != nullptr) profile.unodeBytes += owner->_account._username.heapBytes();
+    if(node->_dtree != nullptr){
+        profile.unodeBytes += sizeof(DTree) + sizeof(node->_inline);
+        profileDTree(*node->_dtree, userDepth, profile);
+        return;
+    }
+    profile.unodeBytes += (UNODE_INLINE_ACCOUNTS - node->_numInline) * sizeof(DNode);
+    if(node->_numInline == 0) return;
+    long vacantBefore = profile.numVacant;
+    string username = node->getUsername();
+    for(int i = 0; i < node->_numInline; i++){
+        AssistProfile(&node->_inline[i], 0, userDepth, username, profile);
+    }
+    recordVacancy(profile.numVacant - vacantBefore, node->_numInline, profile);
+}
+
+/**
+ * Counts the accounts of one username into the vacancy distribution.
+ * @param vacant number of vacant DNodes
+ * @param size number of DNodes
+ * @param profile TreeProfile collecting the results
+ */
+void TreeProfiler::recordVacancy(long vacant, int size, TreeProfile& profile) const {
+    int bucket = (int) (vacant * PROFILE_VACANCY_BUCKETS / size);
+    profile.vacancyHistogram[bucket < PROFILE_VACANCY_BUCKETS ? bucket : PROFILE_VACANCY_BUCKETS - 1]++;
+}
+
+/**
+ * Recursively profiles a DNode subtree.
+ * @param node root of the subtree, may be nullptr
+ * @param depth depth of node in its DTree
+ * @param userDepth number of UNodes visited before reaching the DTree root
+ * @param username owner of the DTree
+ * @param profile TreeProfile collecting the results
+ * @return number of nodes in the subtree
+ */
+int TreeProfiler::AssistProfile(DNode* node, int depth, int userDepth, const string& username,
+                                TreeProfile& profile) const {
+    if(node == nullptr) return 0;
+
+    record(profile.dtrees, depth);
+    int userPath = userDepth + depth + 1;
+    profile.userPathTotal += userPath;
+    if(userPath > profile.userPathMax) profile.userPathMax = userPath;
+
+    if(node->isVacant()){
+        profile.numVacant++;
+    }else{
+        profile.numAccounts++;
+    }
+    // Usernames are shared by the accounts of a UNode, badges are dictionary indices and status
+    // text lives in the arenas of the loads
+    profile.dnodeBytes += sizeof(DNode);
+
+    int left = AssistProfile(node->left(), depth + 1, userDepth, username, profile);
+    int right = AssistProfile(node->right(), depth + 1, userDepth, username, profile);
+
+    // Weight criterion, empty children count as 1 just like DTree::checkImbalance
+    int leftVal = left == 0 ? 1 : left;
+    int rightVal = right == 0 ? 1 : right;
+    double ratio = leftVal > rightVal ? (double) leftVal / rightVal : (double) rightVal / leftVal;
+    if(left + right > 0){
+        keepWorst(profile.worstDNodes, {username, node->getDiscriminator(), left, right, ratio});
+    }
+    return left + right + 1;
+}
+
+/**
+ * Counts one node into the shape statistics.
+ * @param stats ShapeStats to update
+ * @param depth depth of the node, the root is 0
+ */
+void TreeProfiler::record(ShapeStats& stats, int depth) const {
+    if((int) stats.depthHistogram.size() <= depth){
+        stats.depthHistogram.resize(depth + 1, 0);
+    }
+    stats.depthHistogram[depth]++;
+    stats.nodes++;
+    stats.totalPath += depth + 1;
+    if(depth + 1 > stats.maxPath) stats.maxPath = depth + 1;
+}
+
+/**
+ * Keeps the worst entries sorted by score, the list never grows beyond _worstCount.
+ * @param worst list of entries sorted highest score first
+ * @param entry candidate entry
+ */
+void TreeProfiler::keepWorst(std::vector<ImbalanceEntry>& worst, const ImbalanceEntry& entry) const {
+    if(_worstCount <= 0 || entry.score <= 0) return;
+    if((int) worst.size() == _worstCount && worst.back().score >= entry.score) return;
+
+    // Insertion into the sorted list, the list is short so a linear shift is fine
+    std::vector<ImbalanceEntry>::iterator pos = worst.begin();
+    while(pos != worst.end() && pos->score >= entry.score) pos++;
+    worst.insert(pos, entry);
+    if((int) worst.size() > _worstCount) worst.pop_back();
+}
+
+/**
+ * Writes the statistics of one node family and its depth histogram.
+ * @param title name of the node family
+ * @param stats ShapeStats to report
+ * @param sout stream to write to
+ */
+void TreeProfiler::reportShape(const char* title, const ShapeStats& stats, ostream& sout) const {
+    sout << title << ": " << stats.nodes << " nodes, search path avg " << stats.averagePath()
+         << ", max " << stats.maxPath << "\n";
+    for(unsigned int depth = 0; depth < stats.depthHistogram.size(); depth++){
+        sout << "  depth " << std::setw(3) << depth << ": " << stats.depthHistogram[depth] << "\n";
+    }
+}
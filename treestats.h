@@ -0,0 +1,100 @@
+/**
+ * CMSC 341 - Spring 2021
+ * Project 2 - Binary Trees
+ * TreeProfiler.h
+ * An interface for the TreeProfiler class, a shape analysis of a UTree and all of its DTrees.
+ */
+
+#pragma once
+
+#include "utree.h"
+#include <vector>
+
+#define PROFILE_WORST_COUNT 5
+#define PROFILE_VACANCY_BUCKETS 10
+
+/* One entry in a "worst balanced subtrees" list */
+struct ImbalanceEntry {
+    string username;    // Username of the UNode (or owner of the DTree)
+    int disc;           // Discriminator of the subtree root, INVALID_DISC for UNodes
+    int left;           // Left weight (DNode size) or height (UNode)
+    int right;          // Right weight (DNode size) or height (UNode)
+    double score;       // Weight ratio for DTrees, height difference for the UTree
+};
+
+/* Shape statistics for a single family of nodes (the UTree, or every DTree together) */
+struct ShapeStats {
+    long nodes = 0;                 // Nodes visited
+    long totalPath = 0;             // Sum of search path lengths (nodes visited to reach each node)
+    int maxPath = 0;                // Longest search path
+    std::vector<long> depthHistogram;   // Number of nodes at each depth, root is depth 0
+
+    double averagePath() const {return nodes == 0 ? 0.0 : (double) totalPath / nodes;}
+};
+
+/* Complete result of a profiling pass */
+struct TreeProfile {
+    ShapeStats utree;               // Shape of the username tree
+    ShapeStats dtrees;              // Shape of every DTree, depths measured from each DTree root
+    long numAccounts = 0;           // Non-vacant DNodes
+    long numVacant = 0;             // Vacant DNodes
+    long userPathTotal = 0;         // Sum of UTree + DTree path lengths for every DNode (retrieveUser cost)
+    int userPathMax = 0;            // Longest retrieveUser path
+    long vacancyHistogram[PROFILE_VACANCY_BUCKETS] = {};  // DTrees bucketed by _numVacant / _size
+    std::vector<ImbalanceEntry> worstDNodes;    // Worst subtrees by the DTree weight criterion
+    std::vector<ImbalanceEntry> worstUNodes;    // Worst subtrees by the UTree AVL criterion
+    long unodeBytes = 0;            // Estimated bytes held by UNodes, their DTree objects and usernames, inline accounts excluded
+    long dnodeBytes = 0;            // Estimated bytes held by DNodes
+    long arenaBytes = 0;            // Status text copied by loadData into this tree's arenas
+    long mappedBytes = 0;           // Files mapped by loadMapped and held by this tree
+    long hashBytes = 0;             // Bytes held by the UTree's hash index, 0 without one
+    long filterBytes = 0;           // Bytes held by the UTree's username filter, 0 without one
+    long cacheBytes = 0;            // Bytes held by the UTree's lookup cache, 0 without one
+    double cacheHitRate = 0.0;      // Hit rate of the lookup cache since it was enabled
+
+    double averageUserPath() const {return dtrees.nodes == 0 ? 0.0 : (double) userPathTotal / dtrees.nodes;}
+};
+
+class TreeProfiler {
+    friend class Grader;
+    friend class Tester;
+
+public:
+    TreeProfiler(int worstCount = PROFILE_WORST_COUNT): _worstCount(worstCount) {}
+
+    // Walks the UTree and every DTree once and returns the collected statistics
+    TreeProfile profile(const UTree& utree) const;
+
+    // Profiles a single DTree, depths are measured from the DTree root
+    TreeProfile profile(const DTree& dtree) const;
+
+    // Writes a human readable report of a profile
+    void report(const TreeProfile& profile, ostream& sout = cout) const;
+
+private:
+    int _worstCount;
+
+    // Recursively profiles a UNode subtree, returns the height of the subtree (-1 for nullptr)
+    int AssistProfile(UNode* node, int depth, TreeProfile& profile) const;
+
+    // Profiles one DTree and counts it into the vacancy distribution
+    void profileDTree(const DTree& dtree, int userDepth, TreeProfile& profile) const;
+
+    // Profiles the accounts of one UNode, inline or in its DTree
+    void profileAccounts(UNode* node, int userDepth, TreeProfile& profile) const;
+
+    // Counts one username's accounts into the vacancy distribution
+    void recordVacancy(long vacant, int size, TreeProfile& profile) const;
+
+    // Recursively profiles a DNode subtree, returns the number of nodes in the subtree
+    int AssistProfile(DNode* node, int depth, int userDepth, const string& username, TreeProfile& profile) const;
+
+    // Counts one node at the passed depth into the shape statistics
+    void record(ShapeStats& stats, int depth) const;
+
+    // Keeps the worst entries sorted by score, highest first
+    void keepWorst(std::vector<ImbalanceEntry>& worst, const ImbalanceEntry& entry) const;
+
+    // Writes a depth histogram as one row per depth
+    void reportShape(const char* title, const ShapeStats& stats, ostream& sout) const;
+};
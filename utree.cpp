@@ -6,25 +6,117 @@
  */
 
 #include "utree.h"
+#include "snapshot.h"
+#include "reclaimer.h"
+#include <stdexcept>
+#include <algorithm>
+#include <mutex>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/* Hooks of the core updates of the AVL engine. Every node on the way down is owned, and on the way
+ * back up the first unbalanced node is rotated. */
+struct UTree::PathHooks {
+    UTree& tree;
+
+    explicit PathHooks(UTree& tree): tree(tree) {}
+
+    UNode* enter(UNode* node) {return tree.own(node);}
+
+    UNode* leave(UNode* node) {
+        if(tree.checkImbalance(node)) tree.rebalance(node);
+        return node;
+    }
+};
+
+/* Hooks of the core insert of a username not yet in the tree */
+struct UTree::InsertHooks : UTree::PathHooks {
+    const Account& newAcct;
+    bool inserted;      // insert only comes here for new usernames, false if it was found anyway
+
+    InsertHooks(UTree& tree, const Account& newAcct): PathHooks(tree), newAcct(newAcct), inserted(false) {}
+
+    bool absorb(UNode*) const {return false;}
+
+    UNode* create() {
+        inserted = true;
+        return tree.createNode(newAcct);
+    }
+};
+
+/* Hooks of the core erase of a username. A node with two children is replaced by its successor,
+ * which is detached from the right subtree with the same hooks. */
+struct UTree::UnlinkHooks : UTree::PathHooks {
+    UNode* unlinked;    // UNode of the username, without children and still holding the link it had
+
+    explicit UnlinkHooks(UTree& tree): PathHooks(tree), unlinked(nullptr) {}
+
+    UNode* erase(UNode* node) {
+        unlinked = node;
+        if(node->_left == nullptr || node->_right == nullptr){
+            // The only child takes over the link, it does not change itself
+            UNode* child = node->_left != nullptr ? node->_left : node->_right;
+            node->_left = nullptr;
+            node->_right = nullptr;
+            return child;
+        }
+        UNode* successor;
+        UNode* right = Core::detachEdge(node->_right, true, *this, successor);
+        successor->_left = node->_left;
+        successor->_right = right;
+        node->_left = nullptr;
+        node->_right = nullptr;
+        UNodeTraits::augment(successor);
+        return leave(successor);
+    }
+};
+
+/**
+ * Constructor, creates an empty UTree.
+ * @param engine structure used to index the usernames
+ */
+UTree::UTree(UTreeEngine engine) {
+    _root = nullptr;
+    _engine = engine;
+    _btree = engine == ENGINE_BTREE ? new BTreeIndex() : nullptr;
+    _art = engine == ENGINE_ART ? new ARTIndex() : nullptr;
+    _hash = nullptr;
+    _filter = nullptr;
+    _cache = nullptr;
+    _bitmaps = nullptr;
+    _numNodes = 0;
+    _versioned = false;
+    _numAccounts = 0;
+    _retired = nullptr;
+}
 
 /**
- * Destructor, deletes all dynamic memory.
+ * Destructor, deletes all dynamic memory. The nodes are freed here rather than by the Reclaimer,
+ * which a UTree with static storage can outlive, and clear then has nothing to hand over.
  */
 UTree::~UTree() {
+    freeNodes();
     clear();
+    delete _btree;
+    delete _art;
+    delete _hash;
+    delete _filter;
+    delete _cache;
+    delete _bitmaps;
 }
 
 /**
- * Sources a .csv file to populate Account objects and insert them into the UTree.
+ * Sources a .csv file to populate Account objects and insert them into the UTree. The statuses are
+ * copied into an arena of this load, released by clear once no snapshot holds it either, so copies
+ * of the accounts must not read their status after that.
  * @param infile path to .csv file containing database of accounts
  * @param append true to append to an existing tree structure or false to clear before importing
  */
 void UTree::loadData(string infile, bool append) {
     std::ifstream instream(infile);
     string line;
-    char delim = ',';
-    const int numFields = 5;
-    string fields[numFields];
 
     /* Check to make sure the file was opened */
     if(!instream.is_open()) {
@@ -36,25 +128,55 @@ void UTree::loadData(string infile, bool append) {
     if(!append) this->clear();
 
     /* Read in the data from the .csv file and insert into the UTree */
+    std::shared_ptr<StringArena> arena = std::make_shared<StringArena>();
     while(std::getline(instream, line)) {
-        std::stringstream buffer(line);
+        Account newAcct = parseLine(line);
+        // The line is reused, so the status is copied into the arena of this load
+        newAcct.setStatus(arena->store(newAcct.getStatusView()));
+        this->insert(newAcct);
+    }
+    if(arena->bytes() > 0) _arenas.push_back(arena);
 
-        /* Quick check to make sure each line is formatted correctly */
-        int delimCount = 0;
-        for(unsigned int c = 0; c < buffer.str().length(); c++) if(buffer.str()[c] == delim) delimCount++;
-        if(delimCount != numFields - 1) {
-            throw std::invalid_argument("Malformed input file detected - ensure each line contains 5 fields deliminated by a ','");
-        }
+    finishLoad();
+}
+
+/**
+ * Like loadData, but the file is mapped read-only and kept mapped by the arena of this load.
+ * Statuses point straight into the mapping, so they cost no allocation. The file must not be
+ * truncated or rewritten while the tree, or a snapshot of it, holds the mapping.
+ * @param infile path to .csv file containing database of accounts
+ * @param append true to append to an existing tree structure or false to clear before importing
+ */
+void UTree::loadMapped(string infile, bool append) {
+    int fd = open(infile.c_str(), O_RDONLY);
+    struct stat info;
+    if(fd < 0 || fstat(fd, &info) < 0) {
+        std::cerr << __FUNCTION__ << ": File " << infile << " could not be opened or located" << endl;
+        exit(-1);
+    }
+    size_t length = info.st_size;
+    void* data = length == 0 ? nullptr : mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if(data == MAP_FAILED) {
+        throw std::runtime_error("File " + infile + " could not be mapped");
+    }
 
-        /* Populate the account attributes -
-         * Each line always has 5 sections of data */
-        for(int i = 0; i < numFields; i++) {
-            std::getline(buffer, line, delim);
-            fields[i] = line;
+    if(!append) this->clear();
+
+    if(data != nullptr){
+        std::shared_ptr<StringArena> arena = std::make_shared<StringArena>();
+        arena->keepMapping(data, length);
+        _arenas.push_back(arena);
+        std::string_view file((const char*) data, length);
+        while(!file.empty()) {
+            size_t end = file.find('\n');
+            std::string_view line = file.substr(0, end);
+            this->insert(parseLine(line));
+            file.remove_prefix(end == std::string_view::npos ? file.size() : end + 1);
         }
-        Account newAcct = Account(fields[0], std::stoi(fields[1]), std::stoi(fields[2]), fields[3], fields[4]);
-        this->insert(newAcct);
     }
+
+    finishLoad();
 }
 
 /**
@@ -65,36 +187,205 @@ void UTree::loadData(string infile, bool append) {
  * @return true if the account was inserted, false otherwise
  */
 bool UTree::insert(Account newAcct) {
+    if(_engine != ENGINE_AVL){
+        UNode* node = retrieve(newAcct.getUsername());
+        if(node == nullptr){
+            // Usernames are only indexed once their DTree holds an account
+            node = createNode(newAcct);
+            if(_btree != nullptr) _btree->insert(newAcct.getUsername(), node);
+            if(_art != nullptr) _art->insert(newAcct.getUsername(), node);
+            return true;
+        }
+        if(!node->insert(newAcct)){
+            return false;
+        }
+        _numAccounts++;
+        indexAccount(node, newAcct, true);
+        return true;
+    }
+
     if(_root == nullptr){ // Handle First Node
-        // Create a dynamic root node
-        cout << endl <<"<---" << newAcct.getUsername() << endl;
-        _root = new UNode();
-        // Insert the Account into the new root node
-        _root->getDTree()->insert(newAcct);
+        // Create a dynamic root node holding the Account
+        _root = createNode(newAcct);
         return true;
 
     }else{ // Handle All Future Nodes
         // Calls recursive assist insert
         if(retrieve(newAcct.getUsername()) == nullptr){
             // If the username does not already exist, a node for it must be created
-            return AssistInsert(_root, newAcct);
+            InsertHooks hooks(*this, newAcct);
+            _root = Core::insert(_root, newAcct.getUsername(), hooks);
+            return hooks.inserted;
         }else{
             // Inserts the account directly at the tree of this username
-            retrieve(newAcct.getUsername())->_dtree->insert(newAcct);
-            rebalance(_root);
+            UNode* node = _versioned ? ownPath(newAcct.getUsername()) : retrieve(newAcct.getUsername());
+            ownAccounts(node);
+            if(!node->insert(newAcct)){
+                return false;
+            }
+            _numAccounts++;
+            indexAccount(node, newAcct, true);
+            // The shape does not change, only the counts along the path
+            updatePath(newAcct.getUsername());
             return true;
         }
     }
 }
 
 /**
- * Removes a user with a matching username and discriminator.
+ * Moves every account of batch into this tree, like inserting each of them but far cheaper for
+ * usernames both trees hold: their DTrees are merged with DTree::merge, which joins ranges that do
+ * not overlap and only merges the overlapping range node by node. Accounts whose username and
+ * discriminator are already here keep the existing account.
+ * @param batch tree to merge, for example freshly loaded from a file, it is left empty
+ * @return number of accounts added
+ */
+long UTree::merge(UTree& batch) {
+    if(&batch == this){
+        return 0;
+    }
+    long added = 0;
+    // DTrees a snapshot of the batch can still read are copied rather than drained
+    batch.forEachNode([&](UNode* source) {added += mergeNode(source, batch._versioned);});
+    // The merged accounts still point at the status text of the batch's loads
+    _arenas.insert(_arenas.end(), batch._arenas.begin(), batch._arenas.end());
+    batch.clear();
+    finishLoad();
+    return added;
+}
+
+/**
+ * Removes every account matching a predicate in one pass, rather than a removeUser per account
+ * that finds its username again each time. The UNodes are split between threads in runs of
+ * consecutive usernames and each DTree is walked once. Counts, aggregates and the bitmap index are
+ * brought up to date once at the end, and usernames left without accounts are dropped. With a
+ * snapshot alive, a read-only pass finds the UNodes holding a match first, and only those are
+ * copied.
+ * @param predicate true for an account to remove, called from every thread at once
+ * @param compact true to rebuild each changed DTree without its vacant nodes, which invalidates
+ * the DNode pointers into it
+ * @param threads number of threads
+ * @return number of accounts removed
+ */
+long UTree::removeIf(const std::function<bool(const Account&)>& predicate, bool compact, int threads) {
+    TaskPool pool(threads);
+    std::vector<UNode*> nodes;
+    forEachNode([&](UNode* node) {nodes.push_back(node);});
+    if(_versioned){
+        std::vector<char> matches(nodes.size(), 0);
+        pool.parallelFor(nodes.size(), [&](size_t first, size_t last) {
+            for(size_t i = first; i < last; i++){
+                for(const Account& acct : *nodes[i]){
+                    if(predicate(acct)){
+                        matches[i] = 1;
+                        break;
+                    }
+                }
+            }
+        });
+        std::vector<string> usernames;
+        for(size_t i = 0; i < nodes.size(); i++){
+            if(matches[i]) usernames.push_back(nodes[i]->getUsername());
+        }
+        nodes.clear();
+        for(const string& username : usernames){
+            UNode* node = ownPath(username);
+            ownAccounts(node);
+            nodes.push_back(node);
+        }
+    }
+
+    // Bitmap ids of the removed accounts, the index is only written by this thread
+    struct Unindexed {
+        uint64_t id;
+        bool nitro;
+        uint8_t badge;
+    };
+    std::mutex lock;
+    long removed = 0;
+    std::vector<UNode*> emptied;
+    std::vector<Unindexed> unindexed;
+    auto finish = [&]() {
+        _numAccounts -= removed;
+        // The removed accounts are spread over every set, dropping everything is cheaper than finding them
+        if(_cache != nullptr && removed > 0) _cache->clear();
+        for(const Unindexed& entry : unindexed) _bitmaps->remove(entry.id, entry.nitro, entry.badge);
+        if(_engine == ENGINE_AVL && removed > 0) AssistCounts(_root);
+        for(UNode* node : emptied) removeNode(node);
+    };
+    try {
+        pool.parallelFor(nodes.size(), [&](size_t first, size_t last) {
+            long count = 0;
+            std::vector<UNode*> empty;
+            std::vector<Unindexed> ids;
+            for(size_t i = first; i < last; i++){
+                UNode* node = nodes[i];
+                std::function<void(const Account&)> visit;
+                if(_bitmaps != nullptr){
+                    visit = [&](const Account& acct) {ids.push_back({accountId(node, acct._disc), acct._nitro, acct._badge});};
+                }
+                int matched = node->removeIf(predicate, compact, visit);
+                count += matched;
+                if(matched > 0 && node->getNumUsers() == 0) empty.push_back(node);
+            }
+            std::lock_guard<std::mutex> guard(lock);
+            removed += count;
+            emptied.insert(emptied.end(), empty.begin(), empty.end());
+            unindexed.insert(unindexed.end(), ids.begin(), ids.end());
+        });
+    } catch(...) {
+        // Accounts removed before the predicate threw stay removed
+        finish();
+        throw;
+    }
+    finish();
+    return removed;
+}
+
+/**
+ * Runs a job on every DTree, spread over the threads of a pool. Each job is one task, and
+ * neighbouring DTrees are grouped by their number of accounts, so a few large DTrees do not leave
+ * the other threads idle. DTrees a snapshot still shares are copied first, one at a time. Jobs run
+ * concurrently and must not add or remove accounts, rebalancing, compacting or reading is fine.
+ * @param job function called once per DTree
+ * @param pool threads running the jobs
+ */
+void UTree::parallelForEachDTree(const std::function<void(DTree&)>& job, TaskPool& pool) {
+    std::vector<UNode*> nodes;
+    forEachNode([&](UNode* node) {
+        if(node->_dtree != nullptr) nodes.push_back(node);
+    });
+    if(_versioned){
+        for(UNode*& node : nodes){
+            node = ownPath(node->getUsername());
+            ownAccounts(node);
+        }
+    }
+    std::vector<long> cost(nodes.size());
+    long total = 0;
+    for(size_t i = 0; i < nodes.size(); i++){
+        total += nodes[i]->_dtree->root()->getSize();
+        cost[i] = total;
+    }
+    pool.parallelFor(nodes.size(), [&](size_t first, size_t last) {
+        for(size_t i = first; i < last; i++) job(*nodes[i]->_dtree);
+    }, cost);
+}
+
+/**
+ * Removes a user with a matching username and discriminator. The account stays in the tree as a
+ * vacant DNode, and removed points at it. It is only valid until the next call that changes the
+ * tree (insert, removeUser, removeIf, merge, clear or a load), so copy the account out before
+ * then. A username left without accounts keeps its UNode alive that long for this reason.
  * @param username username to match
  * @param disc discriminator to match
- * @param removed DNode object to hold removed account
+ * @param removed set to the vacant DNode of the removed account, valid until the next write
  * @return true if an account was removed, false otherwise
  */
 bool UTree::removeUser(string username, int disc, DNode*& removed) {
+    if(_cache != nullptr){
+        _cache->erase(username, disc);
+    }
     return AssistRemove(_root, username, disc, removed);
 }
 
@@ -104,6 +395,21 @@ bool UTree::removeUser(string username, int disc, DNode*& removed) {
  * @return UNode with a matching username, nullptr otherwise
  */
 UNode* UTree::retrieve(string username) {
+    if(_filter != nullptr && !_filter->mayContain(username)){
+        return nullptr;
+    }
+    if(_hash != nullptr){
+        return _hash->find(username);
+    }
+    if(_btree != nullptr){
+        return _btree->find(username);
+    }
+    if(_art != nullptr){
+        return _art->find(username);
+    }
+    if(_root == nullptr){
+        return nullptr;
+    }
     return AssistRetrieve(_root, username);
 }
 
@@ -114,7 +420,17 @@ UNode* UTree::retrieve(string username) {
  * @return DNode with a matching username and discriminator, nullptr otherwise
  */
 DNode* UTree::retrieveUser(string username, int disc) {
-    return retrieve(username)->_dtree->retrieve(disc);
+    if(_cache == nullptr){
+        UNode* node = retrieve(username);
+        return node == nullptr ? nullptr : node->retrieve(disc);
+    }
+    DNode* found = _cache->find(username, disc);
+    if(found == nullptr){
+        UNode* node = retrieve(username);
+        found = node == nullptr ? nullptr : node->retrieve(disc);
+        if(found != nullptr) _cache->insert(username, disc, node->getGeneration(), found);
+    }
+    return found;
 }
 
 /**
@@ -124,60 +440,418 @@ DNode* UTree::retrieveUser(string username, int disc) {
  */
 int UTree::numUsers(string username) {
     // Retrieve node and return the number of users for the tree
-    return retrieve(username)->_dtree->getNumUsers();
+    UNode* node = retrieve(username);
+    return node == nullptr ? 0 : node->getNumUsers();
 }
 
 /**
- * Helper for the destructor to clear dynamic memory.
+ * Empties the tree. The UNodes are detached and handed to the global Reclaimer, which frees them
+ * in the background, so the tree is empty and usable at once whatever its size.
  */
 void UTree::clear() {
-    AssistClear(_root);
+    if(_hash != nullptr){
+        _hash->clear();
+    }
+    if(_filter != nullptr){
+        _filter->clear();
+    }
+    if(_cache != nullptr){
+        _cache->clear();
+    }
+    if(_bitmaps != nullptr){
+        _bitmaps->clear();
+        _indexed.clear();
+    }
+    _numNodes = 0;
+    _versioned = false;
+    _numAccounts = 0;
+    // Freeing the nodes reads no status, so the text can go first unless a snapshot holds it
+    _arenas.clear();
+    bool detached = _root == nullptr && _retired == nullptr && (_btree == nullptr || _btree->size() == 0)
+                    && (_art == nullptr || _art->size() == 0);
+    if(detached){
+        return;
+    }
+
+    // The old index is walked on the background thread, each of its UNodes holds one link
+    Reclaimer& reclaimer = Reclaimer::global();
+    if(_btree != nullptr && _btree->size() > 0){
+        BTreeIndex* btree = _btree;
+        _btree = new BTreeIndex();
+        reclaimer.retire([btree, &reclaimer]() {
+            btree->forEach([&](UNode* node) {reclaimer.retire(node);});
+            delete btree;
+        });
+    }
+    if(_art != nullptr && _art->size() > 0){
+        ARTIndex* art = _art;
+        _art = new ARTIndex();
+        reclaimer.retire([art, &reclaimer]() {
+            art->forEach([&](UNode* node) {reclaimer.retire(node);});
+            delete art;
+        });
+    }
+    // Nodes still linked from a snapshot are left to it
+    reclaimer.retire(_root);
+    _root = nullptr;
+    reclaimer.retire(_retired);
+    _retired = nullptr;
+}
+
+/**
+ * Frees every UNode on the calling thread, leaving the indexes empty.
+ */
+void UTree::freeNodes() {
+    if(_engine != ENGINE_AVL){
+        forEachNode([](UNode* node) {delete node;});
+        if(_btree != nullptr) _btree->clear();
+        if(_art != nullptr) _art->clear();
+    }
+    // Nodes still linked from a snapshot are left to it
+    UNode::release(_root);
+    _root = nullptr;
+    UNode::release(_retired);
+    _retired = nullptr;
+}
+
+/**
+ * Adds a hash index from username to UNode in front of the engine. Exact lookups (retrieve,
+ * retrieveUser, numUsers, removeUser) become O(1), ordered traversal still uses the engine.
+ * UNodes never move during rebalancing, so only new and deleted UNodes touch the index.
+ * @param expectedUsers number of usernames to size the table for, at least the current count
+ */
+void UTree::enableHashIndex(size_t expectedUsers) {
+    delete _hash;
+    _hash = nullptr;
+    HashIndex* hash = new HashIndex(expectedUsers);
+    forEachNode([&](UNode* node) {hash->insert(node->getUsername(), node);});
+    _hash = hash;
+}
+
+/**
+ * Removes the hash index, lookups go back to the engine.
+ */
+void UTree::disableHashIndex() {
+    delete _hash;
+    _hash = nullptr;
+}
+
+/**
+ * Adds a counting Bloom filter in front of every username lookup. A username that was never
+ * inserted is rejected after reading one block (two cache lines) of counters. The filter is rebuilt by
+ * loadData when the tree grows past the size it was built for.
+ * @param expectedUsers number of usernames to size the filter for
+ * @param falsePositiveRate chance that a missing username still has to search the engine
+ */
+void UTree::enableFilter(size_t expectedUsers, double falsePositiveRate) {
+    CountingBloomFilter* filter = new CountingBloomFilter(expectedUsers, falsePositiveRate);
+    forEachNode([&](UNode* node) {filter->add(node->getUsername());});
+    delete _filter;
+    _filter = filter;
+}
+
+/**
+ * Removes the filter, every lookup searches the engine again.
+ */
+void UTree::disableFilter() {
+    delete _filter;
+    _filter = nullptr;
+}
+
+/**
+ * Adds a bounded cache in front of retrieveUser for skewed lookups. Each entry remembers the
+ * generation of its DTree, so entries left behind by a DTree rebalance or a refilled vacant node
+ * are dropped on their next lookup. removeUser and clear drop entries directly.
+ * @param capacity number of (username, discriminator) pairs to keep
+ */
+void UTree::enableLookupCache(size_t capacity) {
+    delete _cache;
+    _cache = new LookupCache(capacity);
+}
+
+/**
+ * Removes the lookup cache, every retrieveUser searches both trees again.
+ */
+void UTree::disableLookupCache() {
+    delete _cache;
+    _cache = nullptr;
+}
+
+/**
+ * Adds bitmap indexes on nitro and badge. Every UNode gets an id, and an account's id is its
+ * UNode's id followed by its discriminator. The UTree keeps bitmaps of account ids, and every DTree
+ * keeps bitmaps of discriminators. Insert and removeUser keep both up to date. Nodes a snapshot
+ * shares are copied first, the snapshot keeps them as they were.
+ */
+void UTree::enableBitmapIndex() {
+    if(_bitmaps != nullptr){
+        return;
+    }
+    if(_versioned) AssistOwn(_root);
+    _bitmaps = new AccountBitmaps();
+    forEachNode([&](UNode* node) {
+        node->_id = _indexed.size();
+        _indexed.push_back(node);
+        if(node->_dtree != nullptr) node->_dtree->enableBitmaps();
+        for(const Account& acct : *node) _bitmaps->add(accountId(node, acct._disc), acct._nitro, acct._badge);
+    });
+}
+
+/**
+ * Drops the bitmap indexes, the counts and scans walk the accounts again.
+ */
+void UTree::disableBitmapIndex() {
+    if(_bitmaps == nullptr){
+        return;
+    }
+    if(_versioned) AssistOwn(_root);
+    forEachNode([](UNode* node) {
+        if(node->_dtree != nullptr) node->_dtree->disableBitmaps();
+    });
+    delete _bitmaps;
+    _bitmaps = nullptr;
+    _indexed.clear();
+}
+
+/**
+ * Counts the accounts with nitro, in O(1) with the bitmap index.
+ * @return number of non-vacant accounts with nitro
+ */
+long UTree::countNitro() const {
+    if(_bitmaps != nullptr){
+        return _bitmaps->nitro().cardinality();
+    }
+    long count = 0;
+    for(const Account& acct : accounts()) count += acct.hasNitro();
+    return count;
+}
+
+/**
+ * Counts the accounts with a badge, in O(1) with the bitmap index, or by intersecting two
+ * bitmaps when only nitro accounts count.
+ * @param badge badge to match
+ * @param nitroOnly true to count only the accounts that also have nitro
+ * @return number of matching non-vacant accounts
+ */
+long UTree::countBadge(const string& badge, bool nitroOnly) const {
+    int index = Account::findBadge(badge);
+    if(index < 0){
+        return 0;
+    }
+    if(_bitmaps != nullptr){
+        const RoaringBitmap& matching = _bitmaps->badge(index);
+        return nitroOnly ? matching.andCardinality(_bitmaps->nitro()) : matching.cardinality();
+    }
+    long count = 0;
+    for(const Account& acct : accounts()) count += acct._badge == index && (!nitroOnly || acct._nitro);
+    return count;
+}
+
+/**
+ * Visits every account with nitro. With the bitmap index only matching accounts are read, in
+ * account id order, otherwise every account is walked in username order.
+ * @param visit function called once per matching account
+ */
+void UTree::forEachNitro(const std::function<void(const Account&)>& visit) const {
+    if(_bitmaps != nullptr){
+        _bitmaps->nitro().forEach([&](uint64_t id) {visit(indexedAccount(id));});
+        return;
+    }
+    for(const Account& acct : accounts()){
+        if(acct._nitro) visit(acct);
+    }
+}
+
+/**
+ * Visits every account with a badge, in the same order as forEachNitro.
+ * @param badge badge to match
+ * @param visit function called once per matching account
+ */
+void UTree::forEachBadge(const string& badge, const std::function<void(const Account&)>& visit) const {
+    int index = Account::findBadge(badge);
+    if(index < 0){
+        return;
+    }
+    if(_bitmaps != nullptr){
+        _bitmaps->badge(index).forEach([&](uint64_t id) {visit(indexedAccount(id));});
+        return;
+    }
+    for(const Account& acct : accounts()){
+        if(acct._badge == index) visit(acct);
+    }
+}
+
+/**
+ * Takes a snapshot in O(1). The snapshot shares every node with the tree, afterwards the tree
+ * copies a node, and the path above it, before writing to it. Only the AVL engine links its
+ * UNodes, the B-tree and ART engines cannot be versioned this way.
+ * @return read-only view of the current usernames and accounts
+ */
+UTreeSnapshot UTree::snapshot() {
+    if(_engine != ENGINE_AVL){
+        throw std::logic_error("Snapshots need the AVL engine");
+    }
+    _versioned = true;
+    return UTreeSnapshot(_root, _arenas);
 }
 
 /**
  * Prints all accounts' details within every DTree.
+ * @param sout stream to print to, flushed once at the end
  */
-void UTree::printUsers() const {
-    AssistPrint(_root);
+void UTree::printUsers(ostream& sout) const {
+    forEachNode([&](UNode* node) {printNode(node, sout);});
+    sout.flush();
+}
+
+/**
+ * Finds usernames starting with a prefix, for autocomplete. The ART engine only visits the
+ * subtree below the prefix, the AVL engine skips subtrees ordered entirely before the prefix.
+ * @param prefix start of the usernames to find
+ * @param limit largest number of results
+ * @return matching UNodes in username order
+ */
+std::vector<UNode*> UTree::prefixSearch(string prefix, int limit) const {
+    if(_art != nullptr){
+        return _art->prefixSearch(prefix, limit);
+    }
+    std::vector<UNode*> found;
+    if(_btree != nullptr){
+        _btree->scanFrom(prefix, [&](UNode* node) {
+            if((int) found.size() >= limit || node->getUsername().compare(0, prefix.size(), prefix) != 0) return false;
+            found.push_back(node);
+            return true;
+        });
+    }else{
+        AssistPrefix(_root, prefix, limit, found);
+    }
+    return found;
+}
+
+/**
+ * Dumps the UTree in the '()' notation. The B-tree and ART engines have no UNode links, each UNode
+ * is dumped on its own in username order.
+ * @param sout stream to dump to
+ */
+void UTree::dump(ostream& sout) const {
+    if(_engine != ENGINE_AVL){
+        forEachNode([&](UNode* node) {dump(node, sout);});
+    }else{
+        dump(_root, sout);
+    }
 }
 
 /**
  * Dumps the UTree in the '()' notation.
+ * @param node root of the subtree to dump
+ * @param sout stream to dump to
  */
-void UTree::dump(UNode* node) const {
-    if(node == nullptr) return;
-    cout << "(";
-    dump(node->_left);
-    cout << node->getUsername() << ":" << node->getHeight() << ":" << node->getDTree()->getNumUsers();
-    dump(node->_right);
-    cout << ")";
+void UTree::dump(UNode* node, ostream& sout) const {
+    Core::dump(node, sout, [&](UNode* label) {
+        sout << label->getUsername() << ":" << label->getHeight() << ":" << label->getNumUsers();
+    });
 }
 
 /**
- * Updates the height of the specified node.
+ * Updates the height of the specified node, one more than its taller child. A leaf has
+ * DEFAULT_HEIGHT.
  * @param node UNode object in which the height will be updated
  */
 void UTree::updateHeight(UNode* node) {
-    int left_height = 0;
-    int right_height = 0;
-
-    // Gather the height of the left node
-    if(node->_left != nullptr){
-        left_height = node->_left->getHeight();
+    int height = 1 + std::max(UNodeTraits::height(node->_left), UNodeTraits::height(node->_right));
+    // A node shared with a snapshot always has its current height, skipping the store leaves it untouched
+    if(node->_height != height){
+        node->_height = height;
     }
+    updateCounts(node);
+}
 
-    // Gather the height of the right node
-    if(node->_right != nullptr){
-        right_height = node->_right->getHeight();
+/**
+ * Returns the position of an account in (username, discriminator) order. The AVL engine adds up
+ * the subtree counts along one search path, in O(log n). The other engines keep no aggregates and
+ * count every username before it.
+ * @param username username to rank, it need not exist
+ * @param disc discriminator to rank, it need not exist
+ * @return number of non-vacant accounts ordered before (username, disc)
+ */
+long UTree::rank(const string& username, int disc) const {
+    long below = 0;
+    if(_engine != ENGINE_AVL){
+        const_iterator it = begin();
+        for(; it != end() && it->getUsername() < username; ++it) below += it->getNumUsers();
+        if(it != end() && it->getUsername() == username) below += it->rank(disc);
+        return below;
+    }
+    const UNode* node = _root;
+    while(node != nullptr){
+        int order = username.compare(node->getUsername());
+        if(order >= 0 && node->_left != nullptr) below += node->_left->_subtreeAccounts;
+        if(order == 0) return below + node->rank(disc);
+        if(order > 0) below += node->getNumUsers();
+        node = order < 0 ? node->_left : node->_right;
     }
+    return below;
+}
 
-    if(node->_right == nullptr && node->_left == nullptr){
-        node->_height = DEFAULT_HEIGHT;
-    }else{
-        // Add both the right and the left node
-        node->_height = right_height + left_height + 1;
+/**
+ * Finds the usernames with the most accounts. The AVL engine searches best first: a subtree is
+ * only opened once its largest username could still make the list, so the cost grows with k
+ * rather than with the tree. The other engines rank every username.
+ * @param k number of usernames to return
+ * @return up to k UNodes with at least one account, most accounts first, ties in username order
+ */
+std::vector<UNode*> UTree::mostAccounts(int k) const {
+    std::vector<UNode*> found;
+    if(k <= 0){
+        return found;
+    }
+    if(_engine != ENGINE_AVL){
+        forEachNode([&](UNode* node) {
+            if(node->getNumUsers() > 0) found.push_back(node);
+        });
+        // forEachNode is in username order, so a stable sort keeps ties in username order
+        std::stable_sort(found.begin(), found.end(), [](const UNode* first, const UNode* second) {
+            return first->getNumUsers() > second->getNumUsers();
+        });
+        if((int) found.size() > k) found.resize(k);
+        return found;
     }
 
+    // A candidate is a whole subtree, keyed by its largest count, or a single UNode. At equal keys
+    // subtrees are opened first, so every UNode of a count is queued before the first is taken.
+    struct Candidate {
+        int count;
+        bool subtree;
+        UNode* node;
+    };
+    auto later = [](const Candidate& first, const Candidate& second) {
+        if(first.count != second.count) return first.count < second.count;
+        if(first.subtree != second.subtree) return second.subtree;
+        return !first.subtree && first.node->getUsername() > second.node->getUsername();
+    };
+    std::vector<Candidate> heap;
+    if(_root != nullptr) heap.push_back({_root->_subtreeMax, true, _root});
+    while(!heap.empty() && (int) found.size() < k){
+        std::pop_heap(heap.begin(), heap.end(), later);
+        Candidate next = heap.back();
+        heap.pop_back();
+        if(next.count == 0){
+            break;
+        }
+        if(!next.subtree){
+            found.push_back(next.node);
+            continue;
+        }
+        UNode* children[] = {next.node->_left, next.node->_right};
+        for(UNode* child : children){
+            if(child == nullptr) continue;
+            heap.push_back({child->_subtreeMax, true, child});
+            std::push_heap(heap.begin(), heap.end(), later);
+        }
+        heap.push_back({next.node->getNumUsers(), false, next.node});
+        std::push_heap(heap.begin(), heap.end(), later);
+    }
+    return found;
 }
 
 /**
@@ -186,50 +860,32 @@ void UTree::updateHeight(UNode* node) {
  * @return (can change) returns true if an imbalance occurred, false otherwise
  */
 bool UTree::checkImbalance(UNode* node) {
-    int right = 0;
-    int left = 0;
-    // Case for left hand
-    if(node->_right != nullptr){
-        right = node->_right->getHeight();
-    }
-
-    // Case for right hand
-    if(node->_left != nullptr){
-        left = node->_left->getHeight();
-    }
-
-    // Determine from left and right if the node is balanced
-    if(right > 1+left || left > 1+right){
-        return true;
-    }else{
-        return false;
-    }
+    return _balance.unbalanced(node);
 }
 
 //----------------
 /**
- * Begins and manages the rebalance procedure for an AVL tree (pass by reference).
- * @param node UNode object where an imbalance occurred
+ * Begins and manages the rebalance procedure for an AVL tree (pass by reference). The children of
+ * node are balanced and off by at most two in height, so one single or double rotation is enough.
+ * @param node link to an owned UNode where an imbalance occurred, replaced by the new subtree root
  */
 void UTree::rebalance(UNode*& node) {
-    AssistRebalance(node);
-
-    /*
-    // Determine source of imbalance
-    if(node->_right == nullptr || node->_left > node->_right){
-        // Left is too large
-        cout << "LHS ROTATION NEEDED -------------" << endl;
+    int left = UNodeTraits::height(node->_left);
+    int right = UNodeTraits::height(node->_right);
+    if(left > right + 1){
+        // Left heavy, a left child leaning right is straightened first
+        UNode* child = node->_left;
+        if(UNodeTraits::height(child->_left) < UNodeTraits::height(child->_right)){
+            node->_left = RightRotation(own(node->_left));
+        }
         node = LeftRotation(node);
-        // Somewhere the balanced subtree is not being placed back into the main tree
-    }else if(node->_left == nullptr || node->_right > node->_left){
-        // Right is too large
-        cout << "RHS ROTATION NEEDED -------------" << endl;
+    }else if(right > left + 1){
+        UNode* child = node->_right;
+        if(UNodeTraits::height(child->_right) < UNodeTraits::height(child->_left)){
+            node->_right = LeftRotation(own(node->_right));
+        }
         node = RightRotation(node);
-        // Somewhere the balanced subtree is not being placed back into the main tree
-    }else{
-        cout << "Unknown Rebalance Issue" << endl;
     }
-     */
 }
 
 /**
@@ -245,61 +901,8 @@ void UTree::rebalance(UNode*& node) {
 // ---------- Private Helper Functions ----------
 
 /**
- * A recursive function to assist in the insertion of an account into a DTree in the UTree, will need to check for
- * the username before adding creation of a new UNode
- * @param node Root node to start, and assist in Recursion, will change at different recursive levels
- * @param newAcct Used to pass the new account to the DTree
- * @return returns a true if the function is successful, otherwise will return false
- */
-bool UTree::AssistInsert(UNode* node, Account newAcct){
-    bool InsValue;
-    if(newAcct.getUsername() == node->getUsername()){
-        cout << "eee" << endl;
-        node->_dtree->insert(newAcct);
-    }else{
-        // Navigate Right
-        if(newAcct.getUsername() > node->getUsername())
-        {
-            // Check for NULLPTR
-            if(node->_right == nullptr){
-                cout << "--" << newAcct.getUsername() << endl;
-                node->_right = new UNode;
-                node->_right->_dtree->insert(newAcct);
-                InsValue = true;
-            }else{
-                // Continue recursion
-                InsValue =AssistInsert(node->_right, newAcct);
-            }
-        }
-        // Navigate Left
-        else if(newAcct.getUsername() < node->getUsername())
-        {
-            // Check for NULLPTR
-            if(node->_left == nullptr){
-                cout << "--" << newAcct.getUsername() << endl;
-                node->_left = new UNode;
-                node->_left->_dtree->insert(newAcct);
-                InsValue = true;
-            }else{
-                // Continue recursion
-                InsValue = AssistInsert(node->_left, newAcct);
-            }
-        }
-        else{
-            InsValue = false;
-        }
-    }
-    // Exit Recursion Operations
-
-    updateHeight(node);
-    if(checkImbalance(node)){
-        rebalance(node);
-    }
-    return InsValue;
-}
-
-/**
- * Function to handle the recursive removal of an account from a DTree in the UTree
+ * Function to handle the removal of an account from a DTree in the UTree. A username left without
+ * accounts loses its UNode.
  * @param node Root for the start of recursion
  * @param disc Discriminator value of the desired node
  * @param removed pointer to the node being removed in the process
@@ -307,8 +910,22 @@ bool UTree::AssistInsert(UNode* node, Account newAcct){
  */
 bool UTree::AssistRemove(UNode* node,string username, int disc, DNode*& removed){
     UNode* ToRemove = retrieve(username);
-    if(ToRemove != nullptr){
-        ToRemove->getDTree()->remove(disc, removed);
+    DNode* found = ToRemove == nullptr ? nullptr : ToRemove->retrieve(disc);
+    // An account already removed stays as a vacant node, removing it again changes nothing
+    if(found != nullptr && !found->isVacant()){
+        // Only a removal that changes something copies what a snapshot shares
+        if(_versioned) ToRemove = ownPath(username);
+        ownAccounts(ToRemove);
+        if(!ToRemove->remove(disc, removed)){
+            return false;
+        }
+        _numAccounts--;
+        indexAccount(ToRemove, removed->_account, false);
+        if(ToRemove->getNumUsers() == 0){
+            removeNode(ToRemove);
+        }else{
+            updatePath(username);
+        }
         return true;
     }else{
         return false;
@@ -316,148 +933,840 @@ bool UTree::AssistRemove(UNode* node,string username, int disc, DNode*& removed)
 }
 
 /**
- * Performs the Left rotation of a AVL tree subtree, will be used in a Rebalance function
- * @param node pointer to the root of the subtree to be rotated left
+ * Performs the Left rotation of a AVL subtree: the left child is lifted into the place of node,
+ * which becomes its right child. The left child is owned first.
+ * @param node owned root of the subtree, it must have a left child
+ * @return the new root of the subtree, to be stored in the link to node
  */
 UNode* UTree::LeftRotation(UNode* node){
-    cout << endl << "L1=";
-    // May need handle for NullPTR
-    UNode* Left_temp = node->_left;
-    //UNode* Right_temp = node->_right;
-    UNode* Temp = node;
-
-    Temp->_left = Left_temp->_right;
-    cout << "L2=";
-    Left_temp->_right = Temp;
-
-    cout << "L3" << endl;
-    //dump(Left_temp);
-    //cout << endl;
+    UNode* Left_temp = own(node->_left);
+    node->_left = Left_temp->_right;
+    Left_temp->_right = node;
+    // Links only moved, every node keeps one link from the live tree
+    updateHeight(node);
+    updateHeight(Left_temp);
     return Left_temp;
-    // Needs to determine new heights
 }
 
 /**
- * Performs the Right rotation for an AVL subtree, will be used by the rebalance function
- * @param node pointer to the root of a subtree, which will be rotated to the right
+ * Performs the Right rotation for an AVL subtree: the right child is lifted into the place of
+ * node, which becomes its left child. The right child is owned first.
+ * @param node owned root of the subtree, it must have a right child
+ * @return the new root of the subtree, to be stored in the link to node
  */
 UNode* UTree::RightRotation(UNode* node){
-    /*
-     * Somewhere here and in the Left Rotation I am loosing nodes
-     * I will need to evaluate this again
-    */
-    cout << endl <<  "R1-";
-    UNode* Right_temp = node->_right;
-    //UNode* Left_temp = node->_left;
-    UNode* Temp = node;
-
-    Temp->_right = Right_temp->_left;
-    cout << "R2-";
+    UNode* Right_temp = own(node->_right);
+    node->_right = Right_temp->_left;
     Right_temp->_left = node;
-
-    cout << "R3" << endl;
-    //dump(Right_temp);
-    //cout << endl;
+    updateHeight(node);
+    updateHeight(Right_temp);
     return Right_temp;
-    // Need to determine new heights
+}
 
+/**
+ * Drops the UNode of a username whose accounts were all removed, from the engine and from every
+ * index. The UNode itself is retired rather than deleted, so the removed DNode handed back by
+ * removeUser stays readable until the next UNode is dropped.
+ * @param node owned UNode without any non-vacant account
+ */
+void UTree::removeNode(UNode* node){
+    string username = node->getUsername();
+    if(_cache != nullptr){
+        // Entries of accounts removed earlier may still point into the node, it is about to be freed
+        _cache->eraseUsername(username);
+    }
+    if(_engine == ENGINE_AVL){
+        // The unlinked node may be a copy made by own() on the way down
+        UnlinkHooks hooks(*this);
+        _root = Core::erase(_root, username, hooks);
+        node = hooks.unlinked;
+    }else{
+        if(_btree != nullptr) _btree->erase(username);
+        if(_art != nullptr) _art->erase(username);
+    }
+    if(_hash != nullptr){
+        _hash->erase(username);
+    }
+    if(_filter != nullptr){
+        _filter->remove(username);
+    }
+    if(_bitmaps != nullptr){
+        _indexed[node->_id] = nullptr;
+    }
+    _numNodes--;
+    UNode::release(_retired);
+    _retired = node;
 }
 
 /**
- * Assists in the retrieval of the UNode with the username passed to the function
- * @param node the starting node / recursive starting node for the traversal
- * @param username this username will be found within the tree
- * @return returns recursively the pointer to the node
+ * Makes sure the node behind a link belongs to this tree alone. A node a snapshot still links to
+ * is replaced by a copy sharing its DTree and children, so the parent must already be owned.
+ * @param link parent link, or _root, to the node
+ * @return the node now behind the link
  */
-UNode* UTree::AssistRetrieve(UNode* node, string username){
-    if(username == node->getUsername()){
+UNode* UTree::own(UNode*& link){
+    UNode* node = link;
+    if(node->_refs.load(std::memory_order_acquire) == 1){
         return node;
-    }else{
-        if(username > node->getUsername()){
-            // Handles Right Progression
-            if(node->_right != nullptr){
-                // Recursion to the right
-                return AssistRetrieve(node->_right, username);
-            }else{
-                // If this Username doesn't exist
-                return nullptr;
-            }
-        }else if(username < node->getUsername()){
-            // Handles Left Progression
-            if(node->_left != nullptr) {
-                // Recursion to the left
-                return AssistRetrieve(node->_left, username);
-            }else{
-                // If this Username doesn't exist
-                return nullptr;
-            }
+    }
+    UNode* copy = new UNode(*node);
+    string username = node->getUsername();
+    if(_hash != nullptr){
+        _hash->erase(username);
+        _hash->insert(username, copy);
+    }
+    if(_cache != nullptr){
+        // Cached inline accounts belong to the snapshot from now on, which frees them
+        _cache->eraseUsername(username);
+    }
+    if(_bitmaps != nullptr){
+        _indexed[copy->_id] = copy;
+    }
+    link = copy;
+    UNode::release(node);
+    return copy;
+}
+
+/**
+ * Owns every node on the search path of a username, so the UNode found can be written.
+ * @param username username to find
+ * @return the owned UNode of the username, nullptr if there is none
+ */
+UNode* UTree::ownPath(const string& username){
+    UNode** link = &_root;
+    while(*link != nullptr){
+        UNode* node = own(*link);
+        int order = UNodeTraits::compare(username, node);
+        if(order == 0){
+            return node;
         }
+        link = order < 0 ? &node->_left : &node->_right;
     }
-    // Typically will return anything other than this, however this is present to catch outliers
     return nullptr;
 }
 
 /**
- * This is a shot in the dark, but this may work as a recursive rebalance
- * What it should do is iterate through the tree, and at any existing imbalance it will call the appropriate
- * rotation
- * @param node the node passed for use in recursion
+ * Gives an owned UNode a DTree of its own when a snapshot still shares its DTree. The copy is a
+ * single copy of the node array.
+ * @param node UNode whose accounts are about to change
+ */
+void UTree::ownAccounts(UNode* node){
+    if(!node->sharesAccounts()){
+        return;
+    }
+    DTree* shared = node->_dtree;
+    DTree* copy = new DTree();
+    *copy = *shared;
+    if(_cache != nullptr){
+        // Cached accounts of the shared DTree belong to the snapshot from now on, which frees them
+        _cache->eraseUsername(node->getUsername());
+    }
+    node->_dtree = copy;
+    if(shared->_owners.fetch_sub(1, std::memory_order_acq_rel) == 1){
+        delete shared;
+    }
+}
+
+/**
+ * Owns every node below a link, and the DTree of each, so a snapshot sharing them is not written.
+ * @param link parent link, or _root, to the subtree
+ */
+void UTree::AssistOwn(UNode*& link){
+    if(link == nullptr){
+        return;
+    }
+    UNode* node = own(link);
+    ownAccounts(node);
+    AssistOwn(node->_left);
+    AssistOwn(node->_right);
+}
+
+/**
+ * Recomputes the account count and the largest username count of a subtree from its children.
+ * Values that did not change are not stored, so nodes shared with a snapshot are not written.
+ * @param node root of the subtree
+ */
+void UTree::updateCounts(UNode* node){
+    int own = node->getNumUsers();
+    int accounts = own;
+    int most = own;
+    UNode* children[] = {node->_left, node->_right};
+    for(UNode* child : children){
+        if(child == nullptr) continue;
+        accounts += child->_subtreeAccounts;
+        most = std::max(most, child->_subtreeMax);
+    }
+    if(node->_subtreeAccounts != accounts) node->_subtreeAccounts = accounts;
+    if(node->_subtreeMax != most) node->_subtreeMax = most;
+}
+
+/**
+ * Recomputes the subtree aggregates of a whole subtree, children before their parent.
+ * @param node root of the subtree, may be nullptr
+ */
+void UTree::AssistCounts(UNode* node){
+    if(node == nullptr){
+        return;
+    }
+    AssistCounts(node->_left);
+    AssistCounts(node->_right);
+    updateCounts(node);
+}
+
+/**
+ * Recomputes the subtree aggregates of every node on the search path of a username, deepest
+ * first. The nodes must already be owned.
+ * @param username username whose account count changed
+ */
+void UTree::updatePath(const string& username){
+    std::vector<UNode*> path;
+    for(UNode* node = _root; node != nullptr;){
+        path.push_back(node);
+        int order = UNodeTraits::compare(username, node);
+        if(order == 0) break;
+        node = order < 0 ? node->_left : node->_right;
+    }
+    for(auto it = path.rbegin(); it != path.rend(); ++it) updateCounts(*it);
+}
+
+/**
+ * Prints the username of a UNode followed by every Account of its DTree.
+ * @param node UNode to print
+ * @param sout stream to print to
+ */
+void UTree::printNode(UNode* node, ostream& sout) const{
+    sout << node->getUsername() << " : \n";
+    if(node->_dtree != nullptr){
+        if(node->_dtree->root() != nullptr) DTree::AssistPrint(node->_dtree->root(), sout, 0);
+        return;
+    }
+    for(int i = 0; i < node->_numInline; i++){
+        DTree::AssistPrint(&node->_inline[i], sout, 0);
+    }
+}
+
+/**
+ * Merges the accounts of a UNode of another tree into the UNode of the same username, creating it
+ * from the smallest account if needed. Inline accounts are simply inserted.
+ * @param source UNode of the other tree, its DTree is left empty unless shared
+ * @param shared true if snapshots of the other tree may read the DTree of source
+ * @return number of accounts added
+ */
+int UTree::mergeNode(UNode* source, bool shared){
+    int added = 0;
+    if(source->isInline()){
+        for(const Account& acct : *source) added += insert(acct);
+        return added;
+    }
+    DTree* accounts = source->_dtree;
+    DTree copy;
+    if(shared){
+        copy = *accounts;
+        accounts = &copy;
+    }
+    if(accounts->begin() == accounts->end()){
+        return 0;
+    }
+    string username = source->getUsername();
+    if(retrieve(username) == nullptr){
+        insert(*accounts->begin());
+        added++;
+    }
+    UNode* node = _engine == ENGINE_AVL && _versioned ? ownPath(username) : retrieve(username);
+    ownAccounts(node);
+    if(node->isInline()) node->spill();
+    std::function<void(const Account&)> index;
+    if(_bitmaps != nullptr){
+        if(node->_dtree->getBitmaps() == nullptr) node->_dtree->enableBitmaps();
+        index = [&](const Account& acct) {_bitmaps->add(accountId(node, acct._disc), acct._nitro, acct._badge);};
+    }
+    int merged = node->_dtree->merge(std::move(*accounts), index);
+    _numAccounts += merged;
+    if(_engine == ENGINE_AVL) updatePath(username);
+    return added + merged;
+}
+
+/**
+ * Allocates a UNode holding newAcct and registers it with the hash index.
+ * @param newAcct first Account of the username
+ * @return the new UNode, not yet linked into the engine
  */
-void UTree::AssistRebalance(UNode* node){
-    int right = 0;
-    int left = 0;
-    if(node->_left != nullptr){
-        AssistRebalance(node->_left);
-        left = node->_left->getHeight();
+UNode* UTree::createNode(Account newAcct){
+    UNode* node = new UNode();
+    node->insert(newAcct);
+    updateCounts(node);
+    _numAccounts++;
+    if(_bitmaps != nullptr){
+        node->_id = _indexed.size();
+        _indexed.push_back(node);
+        indexAccount(node, newAcct, true);
     }
-    if(node->_right != nullptr){
-        AssistRebalance(node->_right);
-        right = node->_right->getHeight();
+    if(_hash != nullptr){
+        _hash->insert(newAcct.getUsername(), node);
     }
+    if(_filter != nullptr){
+        _filter->add(newAcct.getUsername());
+    }
+    _numNodes++;
+    return node;
+}
+
+/**
+ * Keeps the bitmap index in step with one account of a UNode. A UNode whose accounts just moved
+ * into a DTree gives it bitmaps built from its accounts.
+ * @param node UNode holding the account
+ * @param acct account inserted or removed
+ * @param present true if the account was inserted, false if it was removed
+ */
+void UTree::indexAccount(UNode* node, const Account& acct, bool present){
+    if(_bitmaps == nullptr){
+        return;
+    }
+    if(node->_dtree != nullptr && node->_dtree->getBitmaps() == nullptr){
+        node->_dtree->enableBitmaps();
+    }
+    if(present){
+        _bitmaps->add(accountId(node, acct._disc), acct._nitro, acct._badge);
+    }else{
+        _bitmaps->remove(accountId(node, acct._disc), acct._nitro, acct._badge);
+    }
+}
 
-    if(checkImbalance(node)){
-        //cout << "IMBALANCE PRESENT" << endl;
-        // Imbalance will be repaired here
-        if(right > left+2){
-            //cout << "right rotation needed" << endl;
-            // RightRotation(node);
-        }else if(left > right+2){
-            //cout << "left rotation needed" << endl;
-            // LeftRotation(node);
+/**
+ * Finds the account behind an id of the bitmap index.
+ * @param id account id, it must be in the index
+ * @return the account
+ */
+const Account& UTree::indexedAccount(uint64_t id) const{
+    const UNode* node = _indexed[id >> ACCOUNT_ID_DISC_BITS];
+    return node->find(id & ((1 << ACCOUNT_ID_DISC_BITS) - 1))->_account;
+}
+
+/**
+ * Visits every UNode in username order, whatever the engine.
+ * @param visit function called once per UNode
+ */
+void UTree::forEachNode(const std::function<void(UNode*)>& visit) const{
+    if(_btree != nullptr){
+        _btree->forEach(visit);
+    }else if(_art != nullptr){
+        _art->forEach(visit);
+    }else{
+        TreeCore<UNodeTraits>::inOrder(_root, visit);
+    }
+}
+
+/**
+ * Returns an iterator to the smallest username.
+ * @return iterator to the first UNode, end() if the tree is empty
+ */
+UTree::const_iterator UTree::begin() const {
+    const_iterator it(this);
+    if(_btree != nullptr){
+        it._cursor = _btree->first();
+        it._current = it._cursor.leaf == nullptr ? nullptr : it._cursor.value();
+    }else if(_art != nullptr){
+        _art->first(it._path);
+        it._current = it._path.empty() ? nullptr : ARTIndex::value(it._path);
+    }else{
+        it.descend(_root);
+    }
+    return it;
+}
+
+/**
+ * Finds the first username not less than username in O(log n), the engine is searched like
+ * retrieve does and nothing is copied.
+ * @param username username to search for
+ * @return iterator to the first UNode with a username >= username, end() if there is none
+ */
+UTree::const_iterator UTree::lower_bound(const string& username) const {
+    const_iterator it(this);
+    if(_btree != nullptr){
+        it._cursor = _btree->seek(username);
+        it._current = it._cursor.leaf == nullptr ? nullptr : it._cursor.value();
+    }else if(_art != nullptr){
+        _art->seek(it._path, username);
+        it._current = it._path.empty() ? nullptr : ARTIndex::value(it._path);
+    }else{
+        const UNode* node = _root;
+        while(node != nullptr){
+            int order = username.compare(node->getUsername());
+            if(order <= 0) it._stack.push_back(node);
+            if(order == 0) break;
+            node = order < 0 ? node->_left : node->_right;
         }
+        it.descend(nullptr);
+    }
+    return it;
+}
+
+/**
+ * Finds the first username greater than username.
+ * @param username username to search for
+ * @return iterator to the first UNode with a username > username, end() if there is none
+ */
+UTree::const_iterator UTree::upper_bound(const string& username) const {
+    const_iterator it = lower_bound(username);
+    if(it != end() && it->getUsername() == username) ++it;
+    return it;
+}
+
+/**
+ * Moves to the next username.
+ * @return this iterator
+ */
+UTree::const_iterator& UTree::const_iterator::operator++() {
+    if(_tree->_btree != nullptr){
+        BTreeIndex::advance(_cursor);
+        _current = _cursor.leaf == nullptr ? nullptr : _cursor.value();
+    }else if(_tree->_art != nullptr){
+        ARTIndex::advance(_path);
+        _current = _path.empty() ? nullptr : ARTIndex::value(_path);
     }else{
+        descend(_current->_right);
+    }
+    return *this;
+}
+
+/**
+ * Pushes the left spine of an AVL subtree, then makes the nearest pending node current.
+ * @param node root of the subtree to visit first, may be nullptr
+ */
+void UTree::const_iterator::descend(const UNode* node) {
+    for(; node != nullptr; node = node->_left) _stack.push_back(node);
+    if(_stack.empty()){
+        _current = nullptr;
         return;
     }
-    updateHeight(node);
+    _current = _stack.back();
+    _stack.pop_back();
 }
 
 /**
- * Recursively clears the tree, will delete the node after it's children
- * @param node passed for recursion.
+ * Creates an iterator on the first non-vacant account at or after a UNode.
+ * @param node position of the UNode
  */
-void UTree::AssistClear(UNode* node){
-    if(node->_right != nullptr){
-        AssistClear(node->_right);
+UTree::account_iterator::account_iterator(const_iterator node) : _node(node) {
+    if(_node != const_iterator()){
+        _account = _node->begin();
     }
-    if(node->_left != nullptr){
-        AssistClear(node->_left);
+    settle();
+}
+
+/**
+ * Moves to the next non-vacant account, crossing into the next UNode when needed.
+ * @return this iterator
+ */
+UTree::account_iterator& UTree::account_iterator::operator++() {
+    ++_account;
+    settle();
+    return *this;
+}
+
+/**
+ * Moves past the end of the accounts of a UNode, and past UNodes with only vacant accounts.
+ */
+void UTree::account_iterator::settle() {
+    while(_node != const_iterator() && _account == _node->end()){
+        ++_node;
+        _account = _node != const_iterator() ? _node->begin() : UNode::const_iterator();
     }
-    delete node;
 }
 
 /**
- * Print all nodes and the Accounts for their DTrees, this should be done using in-order traversal
- * @param node the Node used for recursion, and should start at the _root
+ * Collects UNodes whose username starts with prefix using in-order traversal. A subtree is skipped
+ * when its root orders before the prefix, since everything on its left does too.
+ * @param node root of the subtree, may be nullptr
+ * @param prefix start of the usernames to find
+ * @param limit largest number of results
+ * @param found matches in username order
  */
-void UTree::AssistPrint(UNode* node) const{
-    if(node->_left != nullptr){
-        AssistPrint(node->_left);
+void UTree::AssistPrefix(UNode* node, const string& prefix, int limit, std::vector<UNode*>& found) const{
+    if(node == nullptr || (int) found.size() >= limit) return;
+    string username = node->getUsername();
+    int order = username.compare(0, prefix.size(), prefix);
+    if(order >= 0){
+        AssistPrefix(node->_left, prefix, limit, found);
     }
+    if(order == 0 && (int) found.size() < limit){
+        found.push_back(node);
+    }
+    if(order <= 0){
+        AssistPrefix(node->_right, prefix, limit, found);
+    }
+}
 
-    cout << node->getUsername() << " : " << endl;
-    node->getDTree()->printAccounts();
+/**
+ * Parses one line of a .csv file. The status of the returned Account points into line.
+ * @param line 5 fields deliminated by a ','
+ * @return the Account described by the line
+ */
+Account UTree::parseLine(std::string_view line) const{
+    const char delim = ',';
+    const int numFields = 5;
+    std::string_view fields[numFields];
+
+    /* Quick check to make sure each line is formatted correctly */
+    int delimCount = 0;
+    for(char c : line) if(c == delim) delimCount++;
+    if(delimCount != numFields - 1) {
+        throw std::invalid_argument("Malformed input file detected - ensure each line contains 5 fields deliminated by a ','");
+    }
+
+    /* Populate the account attributes -
+     * Each line always has 5 sections of data */
+    for(int i = 0; i < numFields - 1; i++) {
+        size_t end = line.find(delim);
+        fields[i] = line.substr(0, end);
+        line.remove_prefix(end + 1);
+    }
+    fields[numFields - 1] = line;
 
-    if(node->_right != nullptr){
-        AssistPrint(node->_right);
+    Account newAcct = Account(string(fields[0]), std::stoi(string(fields[1])), std::stoi(string(fields[2])),
+                              string(fields[3]), DEFAULT_STATUS);
+    newAcct.setStatus(fields[4]);
+    return newAcct;
+}
+
+/**
+ * Work left after a bulk load: the load can outgrow the filter, it is rebuilt for the new number
+ * of users.
+ */
+void UTree::finishLoad(){
+    if(_filter != nullptr && (size_t) _numNodes > _filter->expectedItems()){
+        enableFilter(_numNodes, _filter->falsePositiveRate());
     }
-}
\ No newline at end of file
+}
+
+// ---------- UNode Functions ----------
+
+/**
+ * Copy used by path copying. The copy shares the DTree and both children of other, each gains a
+ * link, and inline accounts are copied.
+ * @param other UNode to copy
+ */
+UNode::UNode(const UNode& other) {
+    for(int i = 0; i < other._numInline; i++){
+        _inline[i] = other._inline[i];
+    }
+    _numInline = other._numInline;
+    _generation = 0;
+    _dtree = other._dtree;
+    if(_dtree != nullptr) _dtree->_owners.fetch_add(1, std::memory_order_relaxed);
+    _height = other._height;
+    _subtreeAccounts = other._subtreeAccounts;
+    _subtreeMax = other._subtreeMax;
+    _id = other._id;
+    _left = other._left;
+    _right = other._right;
+    if(_left != nullptr) _left->_refs.fetch_add(1, std::memory_order_relaxed);
+    if(_right != nullptr) _right->_refs.fetch_add(1, std::memory_order_relaxed);
+    _refs = 1;
+}
+
+/**
+ * Drops one link to a subtree. A node left without links is deleted after its children lose
+ * their link from it, nodes still linked from a snapshot or the UTree are kept.
+ * @param node root of the subtree, may be nullptr
+ */
+void UNode::release(UNode* node) {
+    TreeCore<UNodeTraits>::destroy(node,
+        [](UNode* unlinked) {return unlinked->_refs.fetch_sub(1, std::memory_order_acq_rel) == 1;},
+        [](UNode* unlinked) {delete unlinked;});
+}
+
+/**
+ * Finds the DNode holding a discriminator, vacant or not, without freezing or counting reads.
+ * @param disc discriminator to match
+ * @return DNode with a matching discriminator, nullptr otherwise
+ */
+const DNode* UNode::find(int disc) const {
+    if(_dtree != nullptr){
+        return _dtree->find(disc);
+    }
+    for(int i = 0; i < _numInline; i++){
+        if(_inline[i].getDiscriminator() == disc) return &_inline[i];
+    }
+    return nullptr;
+}
+
+/**
+ * Collects the DNodes of the username, vacant or not, sorted by discriminator.
+ * @param accounts list the DNodes are appended to
+ */
+void UNode::collectAccounts(std::vector<const DNode*>& accounts) const {
+    if(_dtree == nullptr){
+        for(int i = 0; i < _numInline; i++) accounts.push_back(&_inline[i]);
+        return;
+    }
+    std::vector<const DNode*> stack;
+    const DNode* node = _dtree->root();
+    while(node != nullptr || !stack.empty()){
+        while(node != nullptr){
+            stack.push_back(node);
+            node = node->left();
+        }
+        node = stack.back();
+        stack.pop_back();
+        accounts.push_back(node);
+        node = node->right();
+    }
+}
+
+/**
+ * Creates an iterator and moves it off vacant accounts.
+ * @param node UNode holding the accounts
+ * @param slot inline slot, ignored once the accounts are in a DTree
+ * @param it position in the DTree, ignored while the accounts are inline
+ */
+UNode::const_iterator::const_iterator(const UNode* node, int slot, DTree::const_iterator it)
+    : _node(node), _slot(slot), _it(it) {
+    if(_node->_dtree == nullptr){
+        while(_slot < _node->_numInline && _node->_inline[_slot].isVacant()) _slot++;
+    }
+}
+
+/**
+ * Moves to the next non-vacant account.
+ * @return this iterator
+ */
+UNode::const_iterator& UNode::const_iterator::operator++() {
+    if(_node->_dtree != nullptr){
+        ++_it;
+        return *this;
+    }
+    do {
+        _slot++;
+    } while(_slot < _node->_numInline && _node->_inline[_slot].isVacant());
+    return *this;
+}
+
+/**
+ * Returns the iterator past the last account of the username.
+ * @return end iterator
+ */
+UNode::const_iterator UNode::end() const {
+    if(_dtree != nullptr){
+        return const_iterator(this, 0, _dtree->end());
+    }
+    return const_iterator(this, _numInline, DTree::const_iterator());
+}
+
+/**
+ * Finds the first account whose discriminator is not less than disc, in O(log n) once the
+ * accounts are in a DTree.
+ * @param disc discriminator to search for
+ * @return iterator to the first non-vacant account with a discriminator >= disc
+ */
+UNode::const_iterator UNode::lower_bound(int disc) const {
+    if(_dtree != nullptr){
+        return const_iterator(this, 0, _dtree->lower_bound(disc));
+    }
+    int slot = 0;
+    while(slot < _numInline && _inline[slot].getDiscriminator() < disc) slot++;
+    return const_iterator(this, slot, DTree::const_iterator());
+}
+
+/**
+ * Counts the accounts of the username ordered before a discriminator.
+ * @param disc discriminator to rank, it need not exist
+ * @return number of non-vacant accounts with a smaller discriminator
+ */
+int UNode::rank(int disc) const {
+    if(_dtree != nullptr){
+        return _dtree->rank(disc);
+    }
+    int below = 0;
+    for(int i = 0; i < _numInline && _inline[i].getDiscriminator() < disc; i++){
+        if(!_inline[i].isVacant()) below++;
+    }
+    return below;
+}
+
+/**
+ * Counts the accounts of the username with nitro.
+ * @return number of non-vacant accounts with nitro
+ */
+int UNode::countNitro() const {
+    if(_dtree != nullptr && _dtree->getBitmaps() != nullptr){
+        return _dtree->getBitmaps()->nitro().cardinality();
+    }
+    int count = 0;
+    for(const Account& acct : *this) count += acct._nitro;
+    return count;
+}
+
+/**
+ * Counts the accounts of the username with a badge.
+ * @param badge badge to match
+ * @param nitroOnly true to count only the accounts that also have nitro
+ * @return number of matching non-vacant accounts
+ */
+int UNode::countBadge(const string& badge, bool nitroOnly) const {
+    int index = Account::findBadge(badge);
+    if(index < 0){
+        return 0;
+    }
+    if(_dtree != nullptr && _dtree->getBitmaps() != nullptr){
+        const AccountBitmaps* bitmaps = _dtree->getBitmaps();
+        return nitroOnly ? bitmaps->badge(index).andCardinality(bitmaps->nitro()) : bitmaps->badge(index).cardinality();
+    }
+    int count = 0;
+    for(const Account& acct : *this) count += acct._badge == index && (!nitroOnly || acct._nitro);
+    return count;
+}
+
+/**
+ * Visits the accounts of the username with nitro in discriminator order.
+ * @param visit function called once per matching account
+ */
+void UNode::forEachNitro(const std::function<void(const Account&)>& visit) const {
+    if(_dtree != nullptr && _dtree->getBitmaps() != nullptr){
+        _dtree->getBitmaps()->nitro().forEach([&](uint64_t disc) {visit(_dtree->find(disc)->_account);});
+        return;
+    }
+    for(const Account& acct : *this){
+        if(acct._nitro) visit(acct);
+    }
+}
+
+/**
+ * Returns the number of non-vacant accounts of the username.
+ * @return number of users with the username of this node
+ */
+int UNode::getNumUsers() const {
+    if(_dtree != nullptr){
+        return _dtree->getNumUsers();
+    }
+    int count = 0;
+    for(int i = 0; i < _numInline; i++){
+        if(!_inline[i].isVacant()) count++;
+    }
+    return count;
+}
+
+/**
+ * Adds an account to the username. The account is kept inline while there is room, a vacant
+ * inline account gives up its slot, and only then are the accounts moved into a DTree.
+ * @param newAcct Account with the username of this node
+ * @return true if the account was inserted, false if the discriminator already exists
+ */
+bool UNode::insert(Account newAcct) {
+    if(_dtree != nullptr){
+        return _dtree->insert(newAcct);
+    }
+    if(retrieve(newAcct.getDiscriminator()) != nullptr){
+        return false;
+    }
+    if(_numInline > 0){
+        newAcct.shareUsername(_inline[0]._account);
+    }
+    if(_numInline == UNODE_INLINE_ACCOUNTS){
+        // Removed accounts are only kept while they cost nothing
+        int kept = 0;
+        for(int i = 0; i < _numInline; i++){
+            if(!_inline[i].isVacant()) _inline[kept++] = _inline[i];
+        }
+        for(int i = kept; i < _numInline; i++) _inline[i] = DNode();
+        _numInline = kept;
+        _generation++;
+    }
+    if(_numInline == UNODE_INLINE_ACCOUNTS){
+        spill();
+        return _dtree->insert(newAcct);
+    }
+
+    // Shifts larger discriminators up to keep the slots sorted
+    int slot = _numInline;
+    while(slot > 0 && _inline[slot - 1].getDiscriminator() > newAcct.getDiscriminator()) slot--;
+    if(slot != _numInline){
+        // The spill above leaves a free slot, so there is always one to shift into
+        std::move_backward(_inline + slot, _inline + _numInline, _inline + _numInline + 1);
+        _generation++;
+    }
+    _inline[slot] = DNode(newAcct);
+    _numInline++;
+    return true;
+}
+
+/**
+ * Finds the DNode holding a discriminator, vacant or not, like DTree::retrieve.
+ * @param disc discriminator to match
+ * @return DNode with a matching discriminator, nullptr otherwise
+ */
+DNode* UNode::retrieve(int disc) {
+    if(_dtree != nullptr){
+        return _dtree->retrieve(disc);
+    }
+    for(int i = 0; i < _numInline; i++){
+        if(_inline[i].getDiscriminator() == disc) return &_inline[i];
+    }
+    return nullptr;
+}
+
+/**
+ * Marks the DNode holding a discriminator vacant, like DTree::remove.
+ * @param disc discriminator to match
+ * @param removed DNode object to hold removed account
+ * @return true if an account was removed, false otherwise
+ */
+bool UNode::remove(int disc, DNode*& removed) {
+    if(_dtree != nullptr){
+        return _dtree->remove(disc, removed);
+    }
+    DNode* node = retrieve(disc);
+    if(node == nullptr){
+        return false;
+    }
+    removed = node;
+    node->setVacant(true);
+    node->_numVacant = 1;
+    return true;
+}
+
+/**
+ * Marks every matching account vacant, like DTree::removeIf. Inline slots are not compacted, the
+ * next insert reuses vacant ones anyway, and a DTree left without accounts is kept as it is.
+ * @param predicate true for an account to remove
+ * @param compact true to rebuild the DTree without its vacant nodes
+ * @param visit function called with every removed account, may be empty
+ * @return number of accounts removed
+ */
+int UNode::removeIf(const std::function<bool(const Account&)>& predicate, bool compact,
+                    const std::function<void(const Account&)>& visit) {
+    if(_dtree != nullptr){
+        int removed = _dtree->removeIf(predicate, false, visit);
+        // The username of the node is read from its DTree, an empty one would have none
+        if(compact && _dtree->getNumUsers() > 0) _dtree->compact();
+        return removed;
+    }
+    int removed = 0;
+    for(int i = 0; i < _numInline; i++){
+        DNode& slot = _inline[i];
+        if(!slot.isVacant() && predicate(slot._account)){
+            slot.setVacant(true);
+            slot._numVacant = 1;
+            if(visit) visit(slot._account);
+            removed++;
+        }
+    }
+    return removed;
+}
+
+/**
+ * Moves every inline account into a new DTree, vacant accounts stay vacant.
+ */
+void UNode::spill() {
+    _dtree = new DTree();
+    for(int i = 0; i < _numInline; i++){
+        _dtree->insert(_inline[i].getAccount());
+    }
+    for(int i = 0; i < _numInline; i++){
+        DNode* removed;
+        if(_inline[i].isVacant()) _dtree->remove(_inline[i].getDiscriminator(), removed);
+        _inline[i] = DNode();
+    }
+    _numInline = 0;
+    _generation++;
+}
@@ -8,52 +8,194 @@
 #pragma once
 
 #include "dtree.h"
+#include "btreeindex.h"
+#include "hashindex.h"
+#include "artindex.h"
+#include "bloomfilter.h"
+#include "lookupcache.h"
+#include "bitmapindex.h"
+#include "taskpool.h"
 #include <fstream>
 #include <sstream>
+#include <vector>
+#include <functional>
+#include <atomic>
+#include <memory>
 
 #define DEFAULT_HEIGHT 0
+#define UNODE_INLINE_ACCOUNTS 1     // Accounts a UNode holds before it allocates a DTree
+#define ACCOUNT_ID_DISC_BITS 14     // Account ids are the UNode id followed by the discriminator
+
+/* Structure used to index the usernames of a UTree */
+enum UTreeEngine {
+    ENGINE_AVL,     // UNodes linked as an AVL tree
+    ENGINE_BTREE,   // UNodes held by a BTreeIndex, the UNode links are unused
+    ENGINE_ART      // UNodes held by an ARTIndex, the UNode links are unused
+};
 
 class Grader;   /* For grading purposes */
 class Tester;   /* Forward declaration for testing class */
+class UTreeSnapshot;
 
 class UNode {
     friend class Grader;
     friend class Tester;
     friend class UTree;
+    friend class TreeProfiler;
+    friend class AccountExporter;
+    friend class UTreeSnapshot;
+    friend class Reclaimer;
+    friend struct UNodeTraits;
 public:
     UNode() {
-        _dtree = new DTree();
+        _dtree = nullptr;
+        _numInline = 0;
+        _generation = 0;
         _height = DEFAULT_HEIGHT;
         _left = nullptr;
         _right = nullptr;
+        _refs = 1;
+        _subtreeAccounts = 0;
+        _subtreeMax = 0;
+        _id = 0;
     }
 
     ~UNode() {
-        delete _dtree;
+        // The DTree may still be shared with a copy of this node held by a snapshot
+        if(_dtree != nullptr && _dtree->_owners.fetch_sub(1, std::memory_order_acq_rel) == 1) delete _dtree;
         _dtree = nullptr;
     }
 
     /* Getters */
-    DTree*& getDTree() {return _dtree;}
+    DTree*& getDTree() {return _dtree;}     // nullptr while the accounts are held inline
     int getHeight() const {return _height;}
-    string getUsername() const {return _dtree->getUsername();}
+    string getUsername() const {return username();}
+    int getNumUsers() const;
+    bool isInline() const {return _dtree == nullptr;}
+    int getSubtreeAccounts() const {return _subtreeAccounts;}  // AVL engine only
+    int getSubtreeMax() const {return _subtreeMax;}            // AVL engine only
+
+    /* Filtered counts and scans of the accounts, answered by the DTree bitmaps when they are enabled */
+
+    int countNitro() const;
+    int countBadge(const string& badge, bool nitroOnly = false) const;
+    void forEachNitro(const std::function<void(const Account&)>& visit) const;
+
+    /* Accounts of the username in discriminator order, vacant accounts are skipped */
+
+    class const_iterator {
+        friend class UNode;
+    public:
+        typedef std::forward_iterator_tag iterator_category;
+        typedef Account value_type;
+        typedef std::ptrdiff_t difference_type;
+        typedef const Account* pointer;
+        typedef const Account& reference;
+
+        const_iterator(): _node(nullptr), _slot(0) {}
+        reference operator*() const {return node()->_account;}
+        pointer operator->() const {return &node()->_account;}
+        const DNode* node() const {return _node->_dtree != nullptr ? _it.node() : &_node->_inline[_slot];}
+        const_iterator& operator++();
+        const_iterator operator++(int) {const_iterator old = *this; ++*this; return old;}
+        bool operator==(const const_iterator& other) const {return _node == other._node && _slot == other._slot && _it == other._it;}
+        bool operator!=(const const_iterator& other) const {return !(*this == other);}
+
+    private:
+        const UNode* _node;
+        int _slot;                  // Inline slot, _numInline at the end
+        DTree::const_iterator _it;  // Used once the accounts moved to a DTree
+
+        const_iterator(const UNode* node, int slot, DTree::const_iterator it);
+    };
+
+    const_iterator begin() const {return lower_bound(MIN_DISC);}
+    const_iterator end() const;
+    const_iterator lower_bound(int disc) const;
+    const_iterator upper_bound(int disc) const {return lower_bound(disc + 1);}
+    IteratorRange<const_iterator> range(int first, int last) const {return {lower_bound(first), lower_bound(last)};}
 
 private:
+    // The first UNODE_INLINE_ACCOUNTS accounts live here sorted by discriminator, without children.
+    // The DTree is only allocated once the username outgrows them, then every account moves into it.
+    DNode _inline[UNODE_INLINE_ACCOUNTS];
+    int _numInline;
+    unsigned _generation;   // Changes whenever an inline DNode is moved or refilled
     DTree* _dtree;
     int _height;
     UNode* _left;
     UNode* _right;
+    std::atomic<int> _refs;     // Links to this node from parents, the live root and snapshot roots
+    int _subtreeAccounts;       // Non-vacant accounts in this subtree
+    int _subtreeMax;            // Most non-vacant accounts of one username in this subtree
+    uint32_t _id;               // Position in the UTree's bitmap index, copies keep it
 
     /* IMPLEMENT (optional): Additional helper functions */
 
+    // Copy for path copying: shares the DTree and both children with other
+    UNode(const UNode& other);
+
+    // Finds the DNode of a discriminator without writing anything, for snapshots
+    const DNode* find(int disc) const;
+
+    // Non-vacant accounts with a smaller discriminator
+    int rank(int disc) const;
+
+    // Appends every DNode, vacant or not, in discriminator order without writing anything
+    void collectAccounts(std::vector<const DNode*>& accounts) const;
+
+    // True if a snapshot may still read this node's accounts
+    bool sharesAccounts() const {return _dtree != nullptr && _dtree->_owners.load(std::memory_order_acquire) > 1;}
+
+    // Drops one link to a subtree, nodes left without links are deleted
+    static void release(UNode* node);
+
+    // Adds an account inline, or to the DTree once the inline slots are full
+    bool insert(Account newAcct);
+
+    // Finds the DNode of a discriminator, vacant or not
+    DNode* retrieve(int disc);
+
+    // Marks the DNode of a discriminator vacant
+    bool remove(int disc, DNode*& removed);
+
+    // Marks every matching account vacant, like DTree::removeIf
+    int removeIf(const std::function<bool(const Account&)>& predicate, bool compact,
+                 const std::function<void(const Account&)>& visit);
+
+    // Generation counter of whichever structure holds the DNodes
+    const unsigned& getGeneration() const {return _dtree != nullptr ? _dtree->getGeneration() : _generation;}
+
+    // Moves the inline accounts into a new DTree
+    void spill();
+
+    // Username text, shared by every account of the node
+    const string& username() const {return _dtree != nullptr ? _dtree->root()->_account.getUsername() : _inline[0]._account.getUsername();}
+
 };
 
-class UTree {
+/* How the AVL engine links its UNodes, for the TreeCore algorithms */
+struct UNodeTraits {
+    typedef UNode* node_ptr;
+    typedef string key_type;
+
+    static UNode* left(UNode* node) {return node->_left;}
+    static UNode* right(UNode* node) {return node->_right;}
+    static void setLeft(UNode* node, UNode* child) {node->_left = child;}
+    static void setRight(UNode* node, UNode* child) {node->_right = child;}
+    static int compare(const string& username, const UNode* node) {return username.compare(node->username());}
+    static void augment(UNode* node);
+    static int height(const UNode* node) {return node == nullptr ? DEFAULT_HEIGHT - 1 : node->_height;}
+};
+
+class UTree : private BalancedTree<UNodeTraits, AVLBalance<UNodeTraits>> {
     friend class Grader;
     friend class Tester;
+    friend class TreeProfiler;
+    friend class AccountExporter;
 
 public:
-    UTree():_root(nullptr){}
+    UTree(UTreeEngine engine = ENGINE_AVL);
 
     /* IMPLEMENT: destructor */
     ~UTree();
@@ -61,20 +203,136 @@ public:
     /* IMPLEMENT: Basic operations */
 
     void loadData(string infile, bool append = true);
+    void loadMapped(string infile, bool append = true);
     bool insert(Account newAcct);
+    long merge(UTree& batch);
+    long removeIf(const std::function<bool(const Account&)>& predicate, bool compact = false, int threads = 1);
+    void parallelForEachDTree(const std::function<void(DTree&)>& job, TaskPool& pool);
     bool removeUser(string username, int disc, DNode*& removed);
     UNode* retrieve(string username);
     DNode* retrieveUser(string username, int disc);
     int numUsers(string username);
     void clear();
-    void printUsers() const;
-    void dump() const {dump(_root);}
-    void dump(UNode* node) const;
+    void printUsers(ostream& sout = cout) const;
+    std::vector<UNode*> prefixSearch(string prefix, int limit) const;
+    void dump(ostream& sout = cout) const;
+    void dump(UNode* node, ostream& sout = cout) const;
+    UTreeEngine getEngine() const {return _engine;}
+
+    /* Counting queries, answered from subtree aggregates by the AVL engine */
+
+    long numAccounts() const {return _numAccounts;}
+    long rank(const string& username, int disc) const;
+    std::vector<UNode*> mostAccounts(int k) const;
+
+    /* Optional exact match index */
+
+    void enableHashIndex(size_t expectedUsers = 0);
+    void disableHashIndex();
+    const HashIndex* getHashIndex() const {return _hash;}
+
+    /* Optional filter answering username misses before the engine is searched */
+
+    void enableFilter(size_t expectedUsers, double falsePositiveRate = BLOOM_DEFAULT_RATE);
+    void disableFilter();
+    const CountingBloomFilter* getFilter() const {return _filter;}
+
+    /* Optional cache of recent retrieveUser results */
+
+    void enableLookupCache(size_t capacity = LOOKUP_CACHE_DEFAULT);
+    void disableLookupCache();
+    const LookupCache* getLookupCache() const {return _cache;}
+
+    /* Optional bitmap indexes on nitro and badge, over every account and within every DTree */
+
+    void enableBitmapIndex();
+    void disableBitmapIndex();
+    const AccountBitmaps* getBitmapIndex() const {return _bitmaps;}
+    long countNitro() const;
+    long countBadge(const string& badge, bool nitroOnly = false) const;
+    void forEachNitro(const std::function<void(const Account&)>& visit) const;
+    void forEachBadge(const string& badge, const std::function<void(const Account&)>& visit) const;
+
+    /* Read-only view of the current state, it shares every node until the tree writes to it */
+
+    UTreeSnapshot snapshot();
+
+    /* Ordered iteration over the UNodes of any engine, usernames in string order. Iterators are
+     * invalidated by any write to the tree. */
+
+    class const_iterator {
+        friend class UTree;
+    public:
+        typedef std::forward_iterator_tag iterator_category;
+        typedef UNode value_type;
+        typedef std::ptrdiff_t difference_type;
+        typedef const UNode* pointer;
+        typedef const UNode& reference;
+
+        const_iterator(): _tree(nullptr), _current(nullptr), _cursor{nullptr, 0} {}
+        reference operator*() const {return *_current;}
+        pointer operator->() const {return _current;}
+        const_iterator& operator++();
+        const_iterator operator++(int) {const_iterator old = *this; ++*this; return old;}
+        bool operator==(const const_iterator& other) const {return _current == other._current;}
+        bool operator!=(const const_iterator& other) const {return _current != other._current;}
+
+    private:
+        const UTree* _tree;
+        const UNode* _current;              // nullptr at the end
+        std::vector<const UNode*> _stack;   // AVL: ancestors still to visit, nearest last
+        BTreeCursor _cursor;                // B-tree position of _current
+        ARTCursor _path;                    // ART position of _current
+
+        explicit const_iterator(const UTree* tree): _tree(tree), _current(nullptr), _cursor{nullptr, 0} {}
+
+        // Takes the next AVL node from the stack, after descending the left spine of node
+        void descend(const UNode* node);
+    };
+
+    /* Every account of the tree in (username, discriminator) order, vacant accounts are skipped */
+
+    class account_iterator {
+        friend class UTree;
+    public:
+        typedef std::forward_iterator_tag iterator_category;
+        typedef Account value_type;
+        typedef std::ptrdiff_t difference_type;
+        typedef const Account* pointer;
+        typedef const Account& reference;
+
+        account_iterator() {}
+        reference operator*() const {return *_account;}
+        pointer operator->() const {return &*_account;}
+        account_iterator& operator++();
+        account_iterator operator++(int) {account_iterator old = *this; ++*this; return old;}
+        bool operator==(const account_iterator& other) const {return _node == other._node && _account == other._account;}
+        bool operator!=(const account_iterator& other) const {return !(*this == other);}
+
+    private:
+        const_iterator _node;
+        UNode::const_iterator _account;     // Default constructed at the end
+
+        explicit account_iterator(const_iterator node);
+
+        // Moves past UNodes whose accounts are all vacant
+        void settle();
+    };
+
+    const_iterator begin() const;
+    const_iterator end() const {return const_iterator(this);}
+    const_iterator lower_bound(const string& username) const;
+    const_iterator upper_bound(const string& username) const;
+    IteratorRange<const_iterator> range(const string& from, const string& to) const {return {lower_bound(from), lower_bound(to)};}
+    IteratorRange<account_iterator> accounts() const {return {account_iterator(begin()), account_iterator(end())};}
+    IteratorRange<account_iterator> accounts(const string& from, const string& to) const {
+        return {account_iterator(lower_bound(from)), account_iterator(lower_bound(to))};
+    }
 
 
     /* IMPLEMENT: "Helper" functions */
 
-    void updateHeight(UNode* node);
+    static void updateHeight(UNode* node);
     bool checkImbalance(UNode* node);
     //----------------
     void rebalance(UNode*& node);
@@ -84,31 +342,106 @@ public:
 
 private:
     UNode* _root;
+    UTreeEngine _engine;
+    BTreeIndex* _btree;     // Only used by ENGINE_BTREE
+    ARTIndex* _art;         // Only used by ENGINE_ART
+    HashIndex* _hash;       // Exact match index, nullptr unless enabled
+    CountingBloomFilter* _filter;   // Username filter, nullptr unless enabled
+    LookupCache* _cache;    // retrieveUser cache, nullptr unless enabled
+    AccountBitmaps* _bitmaps;       // Account ids by nitro and badge, nullptr unless enabled
+    std::vector<UNode*> _indexed;   // UNode of each id the bitmaps use
+    int _numNodes;          // Number of UNodes, used to size the filter on bulk loads
+    bool _versioned;        // A snapshot was taken since the last clear, writes copy shared nodes
+    long _numAccounts;      // Non-vacant accounts, whatever the engine
+    std::vector<std::shared_ptr<StringArena>> _arenas;  // Status text of each load since the last clear
+    UNode* _retired;        // Last UNode dropped by removeUser, kept so removed stays valid until the next write
 
     /* IMPLEMENT (optional): any additional helper functions here! */
 
-    // Assist in recursive insertion
-    bool AssistInsert(UNode* node, Account newAcct);
+    // Hooks of the core updates, owning the path and rotating on the way back up
+    struct PathHooks;
+
+    // Hooks of the core insert, creating the UNode of a new username
+    struct InsertHooks;
 
     // Assist in recursive deletion
     bool AssistRemove(UNode* node, string username, int disc, DNode*& removed);
 
-    // Performs a Left rotation at the passed node
+    // Lifts the left child of the passed node into its place, returns the new subtree root
     UNode* LeftRotation(UNode* node);
 
-    // Performs a Right rotation at the passed node
+    // Lifts the right child of the passed node into its place, returns the new subtree root
     UNode* RightRotation(UNode* node);
 
-    // Assists in recursive retrieval of a UNode
-    UNode* AssistRetrieve(UNode* node, string username);
+    // Drops the UNode of a username left without accounts from the engine and every index
+    void removeNode(UNode* node);
+
+    // Hooks of the core erase, unlinking a UNode from the AVL engine
+    struct UnlinkHooks;
+
+    // Search of the AVL engine from node down
+    UNode* AssistRetrieve(UNode* node, const string& username) const {return TreeCore<UNodeTraits>::find(node, username);}
 
-    // Assists in the rebalance of the UTree
-    void AssistRebalance(UNode* node);
+    // Replaces a link to a node shared with a snapshot by a private copy, returns the node now linked
+    UNode* own(UNode*& link);
 
-    // Recursive deletion of the UTree
-    void AssistClear(UNode* node);
+    // Owns every node from the root down to a username, returns its UNode or nullptr
+    UNode* ownPath(const string& username);
 
-    // Recursive function to print all Accounts in all trees
-    void AssistPrint(UNode* node) const;
+    // Gives a UNode its own DTree before its accounts change
+    void ownAccounts(UNode* node);
 
-};
\ No newline at end of file
+    // Frees every UNode synchronously, for the destructor
+    void freeNodes();
+
+    // Owns every node and DTree of a subtree, before a write that reaches all of them
+    void AssistOwn(UNode*& link);
+
+    // Recomputes the subtree aggregates of a node from its children
+    static void updateCounts(UNode* node);
+
+    // Recomputes the subtree aggregates of every node below node, children first
+    void AssistCounts(UNode* node);
+
+    // Recomputes the subtree aggregates from a username's UNode up to the root
+    void updatePath(const string& username);
+
+    // Prints the Accounts of a single UNode
+    void printNode(UNode* node, ostream& sout) const;
+
+    // Parses one .csv line, the status of the Account points into line
+    Account parseLine(std::string_view line) const;
+
+    // Rebuilds anything a bulk load has outgrown
+    void finishLoad();
+
+    // Moves the accounts of a UNode of another tree into this one, returns how many were added
+    int mergeNode(UNode* source, bool shared);
+
+    // Allocates the UNode for a new username and registers it with the hash index
+    UNode* createNode(Account newAcct);
+
+    // Account id of a discriminator of a UNode in the bitmap index
+    static uint64_t accountId(const UNode* node, int disc) {return ((uint64_t) node->_id << ACCOUNT_ID_DISC_BITS) | disc;}
+
+    // Adds or drops an account in the bitmap index, and gives a new DTree its bitmaps
+    void indexAccount(UNode* node, const Account& acct, bool present);
+
+    // Account behind an id of the bitmap index
+    const Account& indexedAccount(uint64_t id) const;
+
+    // Visits every UNode in username order, whatever the engine
+    void forEachNode(const std::function<void(UNode*)>& visit) const;
+
+    // Recursive prefix search of the AVL engine
+    void AssistPrefix(UNode* node, const string& prefix, int limit, std::vector<UNode*>& found) const;
+
+};
+
+/**
+ * Recomputes the height and the subtree aggregates of a UNode from its children.
+ * @param node UNode to update
+ */
+inline void UNodeTraits::augment(UNode* node) {
+    UTree::updateHeight(node);
+}